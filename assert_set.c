@@ -1,6 +1,7 @@
 /* Author: Magnus Stenhaug <magnus.stenhaug@uit.no> */
 #include "set.h"
 #include <stdlib.h>
+#include <unistd.h>
 
 /*
  * Parameters for the test case:
@@ -351,7 +352,17 @@ void validate_set_operations(unsigned int seed)
 
 int main(int argc, char **argv)
 {
-    int i;
+    int i, opt;
+    const set_ops_t *ops;
+
+    /* -b <backend> selects the set backend */
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        if (opt != 'b' || (ops = set_findbackend(optarg)) == NULL) {
+            fprintf(stderr, "usage: %s [-b backend]\n", argv[0]);
+            return 1;
+        }
+        set_usebackend(ops);
+    }
 	
 	srand(1);
 	
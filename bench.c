@@ -0,0 +1,373 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "common.h"
+#include "instrument.h"
+
+/* Counters collected by probes, and the names of their metrics */
+static perfcount_t *counters;
+static char counter_metrics[PERF_MAX_COUNTERS][64];
+
+volatile long bench_sink;
+
+struct bench_report {
+    FILE *out;
+    int format;
+    int rows;
+};
+
+unsigned long long bench_now(void) {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+        fatal_error("clock_gettime() failed");
+
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void bench_usecounters(perfcount_t *pc) {
+    int i;
+
+    counters = pc;
+    for (i = 0; pc != NULL && i < perfcount_num(pc); i++)
+        snprintf(counter_metrics[i], sizeof(counter_metrics[i]), "%s_per_elem",
+                 perfcount_name(pc, i));
+}
+
+void bench_start(bench_probe_t *probe) {
+    probe->elapsed = 0;
+    memset(probe->counts, 0, sizeof(probe->counts));
+    probe->cmps = 0;
+    probe->allocs = 0;
+    probe->bytes = 0;
+    bench_resume(probe);
+}
+
+void bench_stop(bench_probe_t *probe) {
+    bench_pause(probe);
+}
+
+void bench_pause(bench_probe_t *probe) {
+    unsigned long long counts[PERF_MAX_COUNTERS];
+    int i;
+
+    probe->elapsed += bench_now() - probe->start;
+    if (counters != NULL) {
+        perfcount_stop(counters, counts);
+        for (i = 0; i < perfcount_num(counters); i++)
+            probe->counts[i] += counts[i];
+    }
+#ifdef INSTRUMENT
+    instr_counts_t totals;
+
+    instr_totals(&totals);
+    probe->cmps += totals.cmps;
+    probe->allocs += totals.allocs;
+    probe->bytes += totals.bytes;
+#endif
+}
+
+/*
+ * The instrumentation totals are subtracted here and added back when
+ * pausing, which leaves the counts of the measured stretches.
+ */
+void bench_resume(bench_probe_t *probe) {
+#ifdef INSTRUMENT
+    instr_counts_t totals;
+
+    instr_totals(&totals);
+    probe->cmps -= totals.cmps;
+    probe->allocs -= totals.allocs;
+    probe->bytes -= totals.bytes;
+#endif
+    if (counters != NULL)
+        perfcount_start(counters);
+    probe->start = bench_now();
+}
+
+/*
+ * Adds the median of the given per-trial counts, divided by the size
+ * of the input, to the given row.
+ */
+static void add_per_elem(bench_row_t *row, char *name,
+                         unsigned long long *counts, int trials) {
+    bench_stats_t stats;
+
+    bench_summarize(counts, trials, &stats);
+    bench_metric(row, name, row->n > 0 ? stats.median / row->n : 0);
+}
+
+static int compare_samples(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *) a;
+    unsigned long long y = *(const unsigned long long *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Returns the p-quantile of the given sorted samples, using the
+ * nearest-rank method.
+ */
+static double percentile(unsigned long long *sorted, int n, double p) {
+    int rank = (int) (p * n + 0.999999);
+
+    if (rank < 1)
+        rank = 1;
+    if (rank > n)
+        rank = n;
+    return sorted[rank - 1];
+}
+
+void bench_summarize(unsigned long long *samples, int n, bench_stats_t *stats) {
+    double sum = 0;
+    int i;
+
+    memset(stats, 0, sizeof(bench_stats_t));
+    stats->trials = n;
+    if (n == 0)
+        return;
+
+    qsort(samples, n, sizeof(unsigned long long), compare_samples);
+    for (i = 0; i < n; i++)
+        sum += samples[i];
+
+    stats->min = samples[0];
+    stats->max = samples[n - 1];
+    stats->mean = sum / n;
+    if (n % 2 == 1)
+        stats->median = samples[n / 2];
+    else
+        stats->median = (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
+    stats->p95 = percentile(samples, n, 0.95);
+    stats->p99 = percentile(samples, n, 0.99);
+}
+
+/*
+ * The 97.5% quantiles of Student's t-distribution with 1 to 30 degrees
+ * of freedom.  Beyond that, the normal quantile is close enough.
+ */
+static const double tquantiles[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+int bench_fit(double *x, double *y, int n, bench_fit_t *fit) {
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, sse = 0;
+    double meanx, meany, slope, intercept, t, err;
+    int i, k = 0;
+
+    memset(fit, 0, sizeof(bench_fit_t));
+    for (i = 0; i < n; i++) {
+        if (x[i] <= 0 || y[i] <= 0)
+            continue;
+        sx += log(x[i]);
+        sy += log(y[i]);
+        k++;
+    }
+    fit->points = k;
+    if (k < 2)
+        return 0;
+
+    meanx = sx / k;
+    meany = sy / k;
+    for (i = 0; i < n; i++) {
+        if (x[i] <= 0 || y[i] <= 0)
+            continue;
+        sxx += (log(x[i]) - meanx) * (log(x[i]) - meanx);
+        sxy += (log(x[i]) - meanx) * (log(y[i]) - meany);
+    }
+    if (sxx == 0)
+        return 0;
+    slope = sxy / sxx;
+    intercept = meany - slope * meanx;
+
+    fit->exponent = slope;
+    fit->coefficient = exp(intercept);
+    if (k == 2) {
+        fit->low = -HUGE_VAL;
+        fit->high = HUGE_VAL;
+        return 1;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (x[i] <= 0 || y[i] <= 0)
+            continue;
+        err = log(y[i]) - intercept - slope * log(x[i]);
+        sse += err * err;
+    }
+    t = k - 2 <= 30 ? tquantiles[k - 3] : 1.960;
+    err = t * sqrt(sse / (k - 2) / sxx);
+    fit->low = slope - err;
+    fit->high = slope + err;
+    return 1;
+}
+
+void bench_measure(bench_op_t op, void *arg, int warmup, int trials,
+                   bench_row_t *row) {
+    unsigned long long *samples, *counts[PERF_MAX_COUNTERS + 3];
+    int i, c, ncounters = counters != NULL ? perfcount_num(counters) : 0;
+    int nlib = 0;
+    bench_probe_t probe;
+
+#ifdef INSTRUMENT
+    /* The library counts are kept after the hardware counts */
+    nlib = 3;
+#endif
+
+    samples = malloc(sizeof(unsigned long long) * (trials > 0 ? trials : 1));
+    if (samples == NULL)
+        fatal_error("out of memory");
+    for (c = 0; c < ncounters + nlib; c++) {
+        counts[c] = malloc(sizeof(unsigned long long) * (trials > 0 ? trials : 1));
+        if (counts[c] == NULL)
+            fatal_error("out of memory");
+    }
+
+    memset(&probe, 0, sizeof(probe));
+    probe.warmup = 1;
+    for (i = 0; i < warmup; i++)
+        op(arg, &probe);
+    for (i = 0; i < trials; i++) {
+        memset(&probe, 0, sizeof(probe));
+        op(arg, &probe);
+        samples[i] = probe.elapsed;
+        for (c = 0; c < ncounters; c++)
+            counts[c][i] = probe.counts[c];
+        if (nlib > 0) {
+            counts[ncounters][i] = probe.cmps;
+            counts[ncounters + 1][i] = probe.allocs;
+            counts[ncounters + 2][i] = probe.bytes;
+        }
+    }
+
+    bench_summarize(samples, trials, &row->stats);
+    for (c = 0; c < ncounters; c++)
+        add_per_elem(row, counter_metrics[c], counts[c], trials);
+    if (nlib > 0) {
+        add_per_elem(row, "cmps_per_elem", counts[ncounters], trials);
+        add_per_elem(row, "allocs_per_elem", counts[ncounters + 1], trials);
+        add_per_elem(row, "alloc_bytes_per_elem", counts[ncounters + 2], trials);
+    }
+    for (c = 0; c < ncounters + nlib; c++)
+        free(counts[c]);
+    free(samples);
+}
+
+void bench_metric(bench_row_t *row, char *name, double value) {
+    if (row->nmetrics == BENCH_MAX_METRICS)
+        fatal_error("too many benchmark metrics");
+
+    row->names[row->nmetrics] = name;
+    row->values[row->nmetrics] = value;
+    row->nmetrics++;
+}
+
+int bench_selectops(char *names, char **opnames, size_t stride, int nops,
+                    int *selected) {
+    char *copy = strdup(names), *name, *opname;
+    int i, found;
+
+    if (copy == NULL)
+        fatal_error("out of memory");
+    for (name = strtok(copy, ","); name != NULL; name = strtok(NULL, ",")) {
+        found = 0;
+        for (i = 0; i < nops; i++) {
+            opname = *(char **) ((char *) opnames + i * stride);
+            if (strcmp(name, "all") == 0 || strcmp(name, opname) == 0) {
+                selected[i] = 1;
+                found = 1;
+            }
+        }
+        if (!found) {
+            free(copy);
+            return 0;
+        }
+    }
+    free(copy);
+    return 1;
+}
+
+int bench_format(char *name) {
+    if (strcmp(name, "csv") == 0)
+        return BENCH_CSV;
+    if (strcmp(name, "json") == 0)
+        return BENCH_JSON;
+    return -1;
+}
+
+bench_report_t *bench_report_create(FILE *out, int format) {
+    bench_report_t *report = malloc(sizeof(bench_report_t));
+
+    if (report == NULL)
+        return NULL;
+
+    report->out = out;
+    report->format = format;
+    report->rows = 0;
+
+    if (format == BENCH_JSON)
+        fprintf(out, "[");
+
+    return report;
+}
+
+static void write_csv(bench_report_t *report, bench_row_t *row) {
+    FILE *out = report->out;
+    int i;
+
+    if (report->rows == 0) {
+        fprintf(out, "suite,backend,op,input,n,trials,min_ns,median_ns,mean_ns,"
+                     "p95_ns,p99_ns,max_ns,median_ns_per_elem");
+        for (i = 0; i < row->nmetrics; i++)
+            fprintf(out, ",%s", row->names[i]);
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "%s,%s,%s,%s,%d,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.3f",
+            row->suite, row->backend, row->op, row->input, row->n,
+            row->stats.trials, row->stats.min, row->stats.median,
+            row->stats.mean, row->stats.p95, row->stats.p99, row->stats.max,
+            row->n > 0 ? row->stats.median / row->n : 0.0);
+    for (i = 0; i < row->nmetrics; i++)
+        fprintf(out, ",%.6g", row->values[i]);
+    fprintf(out, "\n");
+}
+
+static void write_json(bench_report_t *report, bench_row_t *row) {
+    FILE *out = report->out;
+    int i;
+
+    fprintf(out, "%s\n  {\"suite\": \"%s\", \"backend\": \"%s\", \"op\": \"%s\", "
+                 "\"input\": \"%s\", \"n\": %d, \"trials\": %d, "
+                 "\"min_ns\": %.0f, \"median_ns\": %.0f, \"mean_ns\": %.0f, "
+                 "\"p95_ns\": %.0f, \"p99_ns\": %.0f, \"max_ns\": %.0f, "
+                 "\"median_ns_per_elem\": %.3f",
+            report->rows > 0 ? "," : "",
+            row->suite, row->backend, row->op, row->input, row->n,
+            row->stats.trials, row->stats.min, row->stats.median,
+            row->stats.mean, row->stats.p95, row->stats.p99, row->stats.max,
+            row->n > 0 ? row->stats.median / row->n : 0.0);
+    for (i = 0; i < row->nmetrics; i++)
+        fprintf(out, ", \"%s\": %.6g", row->names[i], row->values[i]);
+    fprintf(out, "}");
+}
+
+void bench_report_row(bench_report_t *report, bench_row_t *row) {
+    if (report->format == BENCH_JSON)
+        write_json(report, row);
+    else
+        write_csv(report, row);
+    report->rows++;
+    fflush(report->out);
+}
+
+void bench_report_destroy(bench_report_t *report) {
+    if (report->format == BENCH_JSON)
+        fprintf(report->out, "\n]\n");
+    fflush(report->out);
+    free(report);
+}
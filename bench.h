@@ -0,0 +1,174 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+
+#include "perfcount.h"
+
+/*
+ * Returns the time of the monotonic clock, in nanoseconds.
+ */
+unsigned long long bench_now(void);
+
+/*
+ * A probe measures one run of a benchmarked operation.  The operation
+ * calls bench_start() and bench_stop() around the part that should be
+ * measured, so that setup and cleanup are not included.  Besides the
+ * elapsed time, a probe collects the hardware counters selected with
+ * bench_usecounters().  warmup is set during the warmup runs, which an
+ * operation recording its own measurements should skip.
+ */
+typedef struct bench_probe {
+    unsigned long long start;
+    unsigned long long elapsed;
+    unsigned long long counts[PERF_MAX_COUNTERS];
+    unsigned long long cmps;
+    unsigned long long allocs;
+    unsigned long long bytes;
+    int warmup;
+} bench_probe_t;
+
+void bench_start(bench_probe_t *probe);
+void bench_stop(bench_probe_t *probe);
+
+/*
+ * Pauses and resumes a started probe, so that work in between, such as
+ * fixing up state for the next measured call, is left out.
+ */
+void bench_pause(bench_probe_t *probe);
+void bench_resume(bench_probe_t *probe);
+
+/*
+ * The type of benchmarked operations.
+ */
+typedef void (*bench_op_t)(void *arg, bench_probe_t *probe);
+
+/*
+ * Operations store a result of the measured work here, such as a count
+ * of hits, so that the compiler cannot optimize the work away.
+ */
+extern volatile long bench_sink;
+
+/*
+ * Summary statistics over the trials of an operation, in nanoseconds.
+ */
+typedef struct bench_stats {
+    int trials;
+    double min;
+    double median;
+    double mean;
+    double p95;
+    double p99;
+    double max;
+} bench_stats_t;
+
+/*
+ * Computes statistics over the given samples.  Sorts the samples.
+ */
+void bench_summarize(unsigned long long *samples, int n, bench_stats_t *stats);
+
+/*
+ * A power law y = coefficient * x^exponent fitted to a series of
+ * measurements, with the 95% confidence interval of the exponent.
+ */
+typedef struct bench_fit {
+    int points;
+    double exponent;
+    double low;
+    double high;
+    double coefficient;
+} bench_fit_t;
+
+/*
+ * Fits a power law to the given n points by least squares on log y
+ * against log x.  Points where x or y is not positive are skipped.
+ * Returns 0 if fewer than two points remain.  With only two points,
+ * the confidence interval is unbounded.
+ */
+int bench_fit(double *x, double *y, int n, bench_fit_t *fit);
+
+/*
+ * The maximum number of extra metrics in a result row.
+ */
+#define BENCH_MAX_METRICS 32
+
+/*
+ * One labeled result: an operation on an input of size n.
+ */
+typedef struct bench_row {
+    char *suite;
+    char *backend;
+    char *op;
+    char *input;
+    int n;
+    bench_stats_t stats;
+    int nmetrics;
+    char *names[BENCH_MAX_METRICS];
+    double values[BENCH_MAX_METRICS];
+} bench_row_t;
+
+/*
+ * Adds an extra named metric to the given row.
+ */
+void bench_metric(bench_row_t *row, char *name, double value);
+
+/*
+ * Selects the hardware counters that probes collect, or none if pc is
+ * NULL.  The counter set must stay open while benchmarks are run.
+ */
+void bench_usecounters(perfcount_t *pc);
+
+/*
+ * Runs the given operation warmup times without recording anything,
+ * then trials times, and stores statistics over the measured times in
+ * the given row.  For every selected hardware counter, the median count
+ * divided by row->n is added to the row as "<counter>_per_elem".  In
+ * instrumented builds, "cmps_per_elem", "allocs_per_elem" and
+ * "alloc_bytes_per_elem" are added the same way.
+ */
+void bench_measure(bench_op_t op, void *arg, int warmup, int trials,
+                   bench_row_t *row);
+
+/*
+ * Marks the operations named in the given comma-separated list, where
+ * "all" names every operation, as selected.  The nops operation names
+ * are read as in a table of structs: the first is at opnames, and each
+ * next one stride bytes further on.  Returns 0 if a name is unknown.
+ */
+int bench_selectops(char *names, char **opnames, size_t stride, int nops,
+                    int *selected);
+
+/*
+ * Output formats.
+ */
+enum { BENCH_CSV, BENCH_JSON };
+
+/*
+ * Returns the output format with the given name ("csv" or "json"),
+ * or -1 if there is no such format.
+ */
+int bench_format(char *name);
+
+/*
+ * The type of report writers.
+ */
+struct bench_report;
+typedef struct bench_report bench_report_t;
+
+/*
+ * Creates a report writing rows to the given file in the given format.
+ */
+bench_report_t *bench_report_create(FILE *out, int format);
+
+/*
+ * Writes a row.  In CSV format, the header is taken from the first
+ * row, so all rows of a report should have the same extra metrics.
+ */
+void bench_report_row(bench_report_t *report, bench_row_t *row);
+
+/*
+ * Finishes and destroys the given report.
+ */
+void bench_report_destroy(bench_report_t *report);
+
+#endif
@@ -0,0 +1,395 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "set.h"
+#include "bench.h"
+#include "workload.h"
+
+/*
+ * Benchmark harness for sets shared between threads.
+ *
+ * For each input size n (doubling from the minimum to the maximum size),
+ * each selected workload and each selected backend, every selected
+ * operation is run with 1, 2, 4, ... threads, up to the number given
+ * with -j.  The "skiplist" backend is called directly, and every other
+ * backend is wrapped in a mutex, which is how a set that is not
+ * thread-safe has to be shared.
+ *
+ * add splits the keys of the first operand between the threads, which
+ * add them to one empty set.  contains looks up the keys of the second
+ * operand, split the same way, in a set of the first.  mixed adds the
+ * keys of the first operand to an empty set and looks up those of the
+ * second, alternating.  Only the time from when all threads are ready
+ * until they are joined is measured.  Besides the usual statistics,
+ * each row has the number of threads, the throughput in millions of
+ * operations per second at the median time, and the speedup over one
+ * thread.
+ */
+
+/* Maximum number of backends and workloads in one run */
+#define MAX_BACKENDS 16
+#define MAX_WORKLOADS 16
+
+/*
+ * The input of a benchmark round.  The keys are owned by the workload,
+ * so the sets never own their elements.  set holds the keys of the
+ * first operand, and target is the set the threads work on.
+ */
+typedef struct input {
+    workload_t *keys;
+    const set_ops_t *ops;
+    set_t *set;
+    set_t *target;
+    int locked;
+    int threads;
+    pthread_mutex_t lock;
+
+    /* Holds the threads back until all are ready */
+    pthread_mutex_t gate;
+    pthread_cond_t cond;
+    int ready;
+    int go;
+} input_t;
+
+typedef struct job {
+    input_t *in;
+    int id;
+    long hits;
+    void (*func)(struct job *job);
+    pthread_t thread;
+} job_t;
+
+static void add(input_t *in, void *elem) {
+    if (in->locked) {
+        pthread_mutex_lock(&in->lock);
+        set_add(in->target, elem);
+        pthread_mutex_unlock(&in->lock);
+    } else {
+        set_add(in->target, elem);
+    }
+}
+
+static int contains(input_t *in, void *elem) {
+    int found;
+
+    if (!in->locked)
+        return set_contains(in->target, elem);
+    pthread_mutex_lock(&in->lock);
+    found = set_contains(in->target, elem);
+    pthread_mutex_unlock(&in->lock);
+    return found;
+}
+
+/*
+ * Stores the bounds of the given job's share of n keys.
+ */
+static void share(job_t *job, int n, int *first, int *last) {
+    *first = (long) n * job->id / job->in->threads;
+    *last = (long) n * (job->id + 1) / job->in->threads;
+}
+
+static void *worker(void *arg) {
+    job_t *job = arg;
+    input_t *in = job->in;
+
+    pthread_mutex_lock(&in->gate);
+    in->ready++;
+    pthread_cond_broadcast(&in->cond);
+    while (!in->go)
+        pthread_cond_wait(&in->cond, &in->gate);
+    pthread_mutex_unlock(&in->gate);
+
+    job->func(job);
+    return NULL;
+}
+
+/*
+ * Runs the given function in in->threads threads on in->target, and
+ * measures the time from when all are ready until all are done.
+ */
+static void runjobs(input_t *in, void (*func)(job_t *job), bench_probe_t *probe) {
+    job_t *jobs = calloc(in->threads, sizeof(job_t));
+    long hits = 0;
+    int i;
+
+    if (jobs == NULL)
+        fatal_error("out of memory");
+    in->ready = in->go = 0;
+    for (i = 0; i < in->threads; i++) {
+        jobs[i].in = in;
+        jobs[i].id = i;
+        jobs[i].func = func;
+        if (pthread_create(&jobs[i].thread, NULL, worker, &jobs[i]) != 0)
+            fatal_error("cannot create thread");
+    }
+
+    pthread_mutex_lock(&in->gate);
+    while (in->ready < in->threads)
+        pthread_cond_wait(&in->cond, &in->gate);
+    bench_start(probe);
+    in->go = 1;
+    pthread_cond_broadcast(&in->cond);
+    pthread_mutex_unlock(&in->gate);
+
+    for (i = 0; i < in->threads; i++) {
+        pthread_join(jobs[i].thread, NULL);
+        hits += jobs[i].hits;
+    }
+    bench_stop(probe);
+    free(jobs);
+    bench_sink = hits;
+}
+
+static void job_add(job_t *job) {
+    workload_t *keys = job->in->keys;
+    int i, first, last;
+
+    share(job, keys->na, &first, &last);
+    for (i = first; i < last; i++)
+        add(job->in, keys->a[i]);
+}
+
+static void job_contains(job_t *job) {
+    workload_t *keys = job->in->keys;
+    int i, first, last;
+
+    share(job, keys->nb, &first, &last);
+    for (i = first; i < last; i++)
+        job->hits += contains(job->in, keys->b[i]);
+}
+
+static void job_mixed(job_t *job) {
+    workload_t *keys = job->in->keys;
+    int i, first, last;
+
+    share(job, keys->na > keys->nb ? keys->na : keys->nb, &first, &last);
+    for (i = first; i < last; i++) {
+        if (i < keys->na)
+            add(job->in, keys->a[i]);
+        if (i < keys->nb)
+            job->hits += contains(job->in, keys->b[i]);
+    }
+}
+
+static set_t *create(input_t *in) {
+    set_t *set = set_create_backend(in->ops, in->keys->cmpfunc);
+
+    if (set == NULL)
+        fatal_error("out of memory");
+    return set;
+}
+
+static void bench_add(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+
+    in->target = create(in);
+    runjobs(in, job_add, probe);
+    set_destroy(in->target);
+}
+
+static void bench_contains(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+
+    in->target = in->set;
+    runjobs(in, job_contains, probe);
+}
+
+static void bench_mixed(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+
+    in->target = create(in);
+    runjobs(in, job_mixed, probe);
+    set_destroy(in->target);
+}
+
+/*
+ * count returns the number of set operations a run makes.
+ */
+typedef struct concop {
+    char *name;
+    bench_op_t func;
+    int (*count)(workload_t *keys);
+} concop_t;
+
+static int count_add(workload_t *keys) {
+    return keys->na;
+}
+
+static int count_contains(workload_t *keys) {
+    return keys->nb;
+}
+
+static int count_mixed(workload_t *keys) {
+    return keys->na + keys->nb;
+}
+
+static concop_t concops[] = {
+    { "add", bench_add, count_add },
+    { "contains", bench_contains, count_contains },
+    { "mixed", bench_mixed, count_mixed },
+};
+
+#define NUM_CONCOPS ((int) (sizeof(concops) / sizeof(concops[0])))
+
+static void usage(char *prog) {
+    fprintf(stderr,
+            "usage: %s [-b backends] [-o ops] [-i workloads] [-n min:max] [-t trials]\n"
+            "          [-w warmup] [-s seed] [-f csv|json] [-j threads]\n"
+            "  backends: comma-separated list of backends, or all\n"
+            "         (default skiplist,array)\n"
+            "  ops:   comma-separated list of add, contains, mixed, or all (default all)\n"
+            "  workloads: comma-separated list of workloads (default random)\n"
+            "  -j:    maximum number of threads (default one per processor)\n"
+            "  workload specs:\n",
+            prog);
+    workload_list(stderr);
+    exit(1);
+}
+
+/*
+ * Measures the given operation on the given input with 1, 2, 4, ...
+ * threads up to maxthreads, and writes a row for each.
+ */
+static void measure(concop_t *op, input_t *in, char *spec, int n, int maxthreads,
+                    int warmup, int trials, bench_report_t *report) {
+    char backend[64];
+    double base = 0;
+    bench_row_t row;
+
+    snprintf(backend, sizeof(backend), "%s%s", set_backendname(in->ops),
+             in->locked ? "+mutex" : "");
+    for (in->threads = 1; ; in->threads *= 2) {
+        if (in->threads > maxthreads)
+            in->threads = maxthreads;
+
+        memset(&row, 0, sizeof(row));
+        row.suite = "concurrent";
+        row.backend = backend;
+        row.op = op->name;
+        row.input = spec;
+        row.n = n;
+        bench_measure(op->func, in, warmup, trials, &row);
+        if (in->threads == 1)
+            base = row.stats.median;
+        bench_metric(&row, "threads", in->threads);
+        bench_metric(&row, "mops", row.stats.median > 0 ?
+                     op->count(in->keys) * 1e3 / row.stats.median : 0);
+        bench_metric(&row, "speedup", row.stats.median > 0 ? base / row.stats.median : 0);
+        bench_report_row(report, &row);
+
+        if (in->threads == maxthreads)
+            break;
+    }
+}
+
+int main(int argc, char **argv) {
+    int selected[NUM_CONCOPS] = { 0 };
+    const set_ops_t *backends[MAX_BACKENDS];
+    int minsize = 1024, maxsize = 16384;
+    int trials = 5, warmup = 1, format = BENCH_CSV;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    char defaults[] = "random";
+    char *specs[MAX_WORKLOADS];
+    int nspecs = -1, nbackends = 0;
+    unsigned long long seed = 1;
+    bench_report_t *report;
+    int opt, n, i, k, w, any = 0;
+
+    if (threads < 1)
+        threads = 1;
+    while ((opt = getopt(argc, argv, "b:o:i:n:t:w:s:f:j:")) != -1) {
+        switch (opt) {
+        case 'b':
+            if ((nbackends = set_selectbackends(optarg, backends, nbackends, MAX_BACKENDS)) < 0)
+                usage(argv[0]);
+            break;
+        case 'o':
+            if (!bench_selectops(optarg, &concops[0].name, sizeof(concop_t), NUM_CONCOPS,
+                                 selected))
+                usage(argv[0]);
+            any = 1;
+            break;
+        case 'i':
+            if ((nspecs = workload_select(optarg, specs, MAX_WORKLOADS)) < 1)
+                usage(argv[0]);
+            break;
+        case 'n':
+            if (sscanf(optarg, "%d:%d", &minsize, &maxsize) != 2)
+                minsize = maxsize = atoi(optarg);
+            break;
+        case 't':
+            trials = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'f':
+            if ((format = bench_format(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || minsize < 1 || maxsize < minsize || trials < 1 || warmup < 0
+        || threads < 1)
+        usage(argv[0]);
+    if (nbackends == 0)
+        nbackends = set_selectbackends("skiplist,array", backends, 0, MAX_BACKENDS);
+    if (!any)
+        bench_selectops("all", &concops[0].name, sizeof(concop_t), NUM_CONCOPS, selected);
+    if (nspecs < 0)
+        nspecs = workload_select(defaults, specs, MAX_WORKLOADS);
+
+    report = bench_report_create(stdout, format);
+    if (report == NULL)
+        fatal_error("out of memory");
+
+    for (n = minsize; n <= maxsize; n *= 2) {
+        for (w = 0; w < nspecs; w++) {
+            for (k = 0; k < nbackends; k++) {
+                input_t in;
+
+                memset(&in, 0, sizeof(in));
+                in.keys = workload_create(specs[w], n, seed);
+                if (in.keys == NULL)
+                    fatal_error("out of memory");
+                in.ops = backends[k];
+                in.locked = strcmp(set_backendname(in.ops), "skiplist") != 0;
+                pthread_mutex_init(&in.lock, NULL);
+                pthread_mutex_init(&in.gate, NULL);
+                pthread_cond_init(&in.cond, NULL);
+                in.set = in.target = create(&in);
+                for (i = 0; i < in.keys->na; i++)
+                    set_add(in.set, in.keys->a[i]);
+
+                for (i = 0; i < NUM_CONCOPS; i++) {
+                    if (selected[i])
+                        measure(&concops[i], &in, specs[w], n, threads, warmup, trials,
+                                report);
+                }
+
+                set_destroy(in.set);
+                pthread_cond_destroy(&in.cond);
+                pthread_mutex_destroy(&in.gate);
+                pthread_mutex_destroy(&in.lock);
+                workload_destroy(in.keys);
+            }
+        }
+
+        if (n > maxsize / 2)
+            break;
+    }
+
+    bench_report_destroy(report);
+    return 0;
+}
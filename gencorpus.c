@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "workload.h"
+
+/*
+ * Generates a synthetic mail corpus for the spam filter.
+ *
+ * The corpus directory gets three subdirectories in the layout that
+ * spamfilter expects: spam/ and nonspam/ with training mails, and mail/
+ * with the mails to classify.  Mail bodies are drawn from a random
+ * vocabulary with Zipf-distributed word frequencies.  A signature of
+ * words that are not in the vocabulary is planted in every spam mail,
+ * so spamfilter should classify exactly the spam mails under mail/ as
+ * spam.  The planted words are written to signature.txt, and the true
+ * label of every mail under mail/ to labels.txt.
+ *
+ * The corpus depends only on the options and the seed.
+ */
+
+/* Words per line of a mail body */
+#define LINE_WORDS 10
+
+/* Rough number of bytes per body word, used to place the planted words */
+#define WORD_BYTES 6
+
+typedef struct corpus {
+    workload_rng_t rng;
+    workload_zipf_t *zipf;
+    char **vocab;
+    char **planted;
+    int nplanted;
+    double mailsize;
+} corpus_t;
+
+static void usage(char *prog) {
+    fprintf(stderr,
+            "usage: %s [-s seed] [-n mails] [-S size] [-t train] [-v vocab]\n"
+            "          [-z skew] [-k words] [-p spam] <corpusdir>\n"
+            "  -n: number of mails to classify (default 1000)\n"
+            "  -S: total size of the mails to classify, with an optional\n"
+            "      k, M or G suffix (default 10M)\n"
+            "  -t: number of spam and of nonspam training mails (default 100)\n"
+            "  -v: vocabulary size (default 50000)\n"
+            "  -z: Zipf exponent of the word frequencies (default 1.0)\n"
+            "  -k: number of planted signature words (default 5)\n"
+            "  -p: fraction of the mails to classify that are spam (default 0.5)\n",
+            prog);
+    exit(1);
+}
+
+/*
+ * Parses a size with an optional k, M or G suffix.  Returns -1 if the
+ * size is not valid.
+ */
+static double parse_size(char *s) {
+    char *end;
+    double size = strtod(s, &end);
+
+    if (end == s || size < 0)
+        return -1;
+    if (*end == 'k' || *end == 'K')
+        size *= 1024, end++;
+    else if (*end == 'm' || *end == 'M')
+        size *= 1024 * 1024, end++;
+    else if (*end == 'g' || *end == 'G')
+        size *= 1024 * 1024 * 1024, end++;
+    return *end == 0 ? size : -1;
+}
+
+static void makedir(char *path) {
+    if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+        perror(path);
+        fatal_error("mkdir() failed");
+    }
+}
+
+static int compare_words(const void *a, const void *b) {
+    return strcmp(*(char **) a, *(char **) b);
+}
+
+/*
+ * Generates n distinct words of at least minlen characters that are not
+ * among the nexclude sorted words in exclude.  Returns the words sorted.
+ */
+static char **genwords(corpus_t *c, char **exclude, int nexclude, int n, int minlen) {
+    char **result = malloc(sizeof(char *) * (n > 0 ? n : 1));
+    char buf[WORKLOAD_MAX_WORD + 1], *word = buf;
+    int num = 0, i, j;
+
+    if (result == NULL)
+        fatal_error("out of memory");
+    while (num < n) {
+        /* Fill up with new words, then drop the duplicates */
+        while (num < n) {
+            if (workload_word(&c->rng, buf) < minlen ||
+                bsearch(&word, exclude, nexclude, sizeof(char *), compare_words) != NULL)
+                continue;
+            result[num] = strdup(buf);
+            if (result[num++] == NULL)
+                fatal_error("out of memory");
+        }
+        qsort(result, num, sizeof(char *), compare_words);
+        for (i = j = 1; i < num; i++) {
+            if (strcmp(result[i], result[j - 1]) == 0)
+                free(result[i]);
+            else
+                result[j++] = result[i];
+        }
+        num = j;
+    }
+    return result;
+}
+
+static char *randomword(corpus_t *c) {
+    return c->vocab[workload_zipf_next(c->zipf, &c->rng)];
+}
+
+/*
+ * Writes one mail of about the average mail size to the given path.
+ */
+static void writemail(corpus_t *c, char *path, int spam) {
+    FILE *f = fopen(path, "w");
+    long size, written = 0, words = 0, *positions;
+    int i;
+
+    if (f == NULL) {
+        perror(path);
+        fatal_error("fopen() failed");
+    }
+
+    /* Between half and one and a half times the average size */
+    size = (long) (c->mailsize * (0.5 + workload_uniform(&c->rng)));
+
+    fprintf(f, "From: %s@%s.com\n", randomword(c), randomword(c));
+    fprintf(f, "To: %s@%s.com\n", randomword(c), randomword(c));
+    fprintf(f, "Subject: %s %s %s\n\n", randomword(c), randomword(c), randomword(c));
+
+    /* Spam mails carry the planted words at random places in the body */
+    positions = malloc(sizeof(long) * c->nplanted);
+    if (positions == NULL)
+        fatal_error("out of memory");
+    for (i = 0; i < c->nplanted; i++)
+        positions[i] = spam ? (long) workload_below(&c->rng, size / WORD_BYTES + 1) : -1;
+
+    while (written < size) {
+        for (i = 0; i < c->nplanted; i++) {
+            if (positions[i] == words)
+                written += fprintf(f, "%s ", c->planted[i]);
+        }
+        written += fprintf(f, "%s%s", randomword(c),
+                           ++words % LINE_WORDS == 0 ? "\n" : " ");
+    }
+
+    /* The body may be shorter than estimated */
+    for (i = 0; i < c->nplanted; i++) {
+        if (positions[i] >= words)
+            fprintf(f, "%s ", c->planted[i]);
+    }
+    fprintf(f, "\n");
+    free(positions);
+
+    if (fclose(f) != 0) {
+        perror(path);
+        fatal_error("fclose() failed");
+    }
+}
+
+/*
+ * Writes n mails named <prefix><i>.txt in the given directory.  If spam
+ * is 1 all mails are spam, if 0 none are, and if -1 each one is spam
+ * with the given probability, and its label is written to labels.
+ */
+static void writemails(corpus_t *c, char *root, char *dir, char *prefix,
+                       int n, int spam, double fraction, FILE *labels) {
+    char *path = malloc(strlen(root) + strlen(dir) + strlen(prefix) + 32);
+    int i, isspam;
+
+    if (path == NULL)
+        fatal_error("out of memory");
+    sprintf(path, "%s/%s", root, dir);
+    makedir(path);
+
+    for (i = 1; i <= n; i++) {
+        isspam = spam >= 0 ? spam : workload_uniform(&c->rng) < fraction;
+        sprintf(path, "%s/%s/%s%d.txt", root, dir, prefix, i);
+        writemail(c, path, isspam);
+        if (labels != NULL)
+            fprintf(labels, "%s %s\n", path, isspam ? "SPAM" : "Not spam");
+    }
+    free(path);
+}
+
+int main(int argc, char **argv) {
+    unsigned long long seed = 1;
+    int nmails = 1000, ntrain = 100, nvocab = 50000, opt, i, j;
+    double size = 10 * 1024 * 1024, skew = 1.0, fraction = 0.5;
+    corpus_t c;
+    char *root, *path, *tmp;
+    FILE *f;
+
+    c.nplanted = 5;
+    while ((opt = getopt(argc, argv, "s:n:S:t:v:z:k:p:")) != -1) {
+        switch (opt) {
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'n':
+            nmails = atoi(optarg);
+            break;
+        case 'S':
+            size = parse_size(optarg);
+            break;
+        case 't':
+            ntrain = atoi(optarg);
+            break;
+        case 'v':
+            nvocab = atoi(optarg);
+            break;
+        case 'z':
+            skew = atof(optarg);
+            break;
+        case 'k':
+            c.nplanted = atoi(optarg);
+            break;
+        case 'p':
+            fraction = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || nmails < 1 || size < 0 || ntrain < 1 || nvocab < 1 ||
+        skew <= 0 || c.nplanted < 1 || fraction < 0 || fraction > 1)
+        usage(argv[0]);
+    root = argv[optind];
+
+    workload_seed(&c.rng, seed);
+    c.mailsize = size / nmails;
+    c.zipf = workload_zipf_create(nvocab, skew);
+    if (c.zipf == NULL)
+        fatal_error("out of memory");
+
+    /* The planted words are kept out of the vocabulary */
+    c.vocab = genwords(&c, NULL, 0, nvocab, 1);
+    c.planted = genwords(&c, c.vocab, nvocab, c.nplanted, 6);
+
+    /* Shuffle the vocabulary, so that word frequency doesn't follow the alphabet */
+    for (i = nvocab - 1; i > 0; i--) {
+        j = workload_below(&c.rng, i + 1);
+        tmp = c.vocab[i];
+        c.vocab[i] = c.vocab[j];
+        c.vocab[j] = tmp;
+    }
+
+    makedir(root);
+    writemails(&c, root, "spam", "spam", ntrain, 1, 0, NULL);
+    writemails(&c, root, "nonspam", "nonspam", ntrain, 0, 0, NULL);
+
+    path = malloc(strlen(root) + 32);
+    if (path == NULL)
+        fatal_error("out of memory");
+    sprintf(path, "%s/labels.txt", root);
+    f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        fatal_error("fopen() failed");
+    }
+    writemails(&c, root, "mail", "mail", nmails, -1, fraction, f);
+    fclose(f);
+
+    sprintf(path, "%s/signature.txt", root);
+    f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        fatal_error("fopen() failed");
+    }
+    for (i = 0; i < c.nplanted; i++)
+        fprintf(f, "%s\n", c.planted[i]);
+    fclose(f);
+    free(path);
+
+    for (i = 0; i < nvocab; i++)
+        free(c.vocab[i]);
+    for (i = 0; i < c.nplanted; i++)
+        free(c.planted[i]);
+    free(c.vocab);
+    free(c.planted);
+    workload_zipf_destroy(c.zipf);
+    return 0;
+}
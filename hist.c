@@ -0,0 +1,163 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hist.h"
+
+/*
+ * Values below SUB_COUNT get a bucket each.  A larger value is shifted
+ * right until it is below SUB_COUNT, which leaves it in the upper half,
+ * and the shift selects a group of SUB_COUNT / 2 buckets.
+ */
+#define SUB_BITS 8
+#define SUB_COUNT (1 << SUB_BITS)
+#define HALF_COUNT (SUB_COUNT / 2)
+#define NUM_BUCKETS (SUB_COUNT + (64 - SUB_BITS) * HALF_COUNT)
+
+struct hist {
+    unsigned long long count;
+    unsigned long long min;
+    unsigned long long max;
+    double sum;
+    unsigned long long buckets[NUM_BUCKETS];
+};
+
+/*
+ * Returns the number of bits to shift the given value right to bring it
+ * below SUB_COUNT.
+ */
+static int shiftof(unsigned long long value) {
+    int msb = 63 - __builtin_clzll(value | 1);
+
+    return msb < SUB_BITS ? 0 : msb - SUB_BITS + 1;
+}
+
+static int bucketof(unsigned long long value) {
+    int shift = shiftof(value);
+
+    if (shift == 0)
+        return value;
+    return SUB_COUNT + (shift - 1) * HALF_COUNT + (int) (value >> shift) - HALF_COUNT;
+}
+
+/*
+ * Returns the lowest value of the given bucket, and stores the highest
+ * in *high.
+ */
+static unsigned long long rangeof(int bucket, unsigned long long *high) {
+    int shift, sub;
+    unsigned long long low;
+
+    if (bucket < SUB_COUNT) {
+        *high = bucket;
+        return bucket;
+    }
+    shift = (bucket - SUB_COUNT) / HALF_COUNT + 1;
+    sub = (bucket - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+    low = (unsigned long long) sub << shift;
+    *high = low + ((1ULL << shift) - 1);
+    return low;
+}
+
+hist_t *hist_create(void) {
+    hist_t *hist = malloc(sizeof(hist_t));
+
+    if (hist != NULL)
+        hist_reset(hist);
+    return hist;
+}
+
+void hist_destroy(hist_t *hist) {
+    free(hist);
+}
+
+void hist_reset(hist_t *hist) {
+    memset(hist, 0, sizeof(hist_t));
+}
+
+void hist_record(hist_t *hist, unsigned long long value) {
+    if (hist->count == 0 || value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+    hist->count++;
+    hist->sum += value;
+    hist->buckets[bucketof(value)]++;
+}
+
+void hist_merge(hist_t *into, hist_t *from) {
+    int i;
+
+    if (from->count == 0)
+        return;
+    if (into->count == 0 || from->min < into->min)
+        into->min = from->min;
+    if (from->max > into->max)
+        into->max = from->max;
+    into->count += from->count;
+    into->sum += from->sum;
+    for (i = 0; i < NUM_BUCKETS; i++)
+        into->buckets[i] += from->buckets[i];
+}
+
+unsigned long long hist_count(hist_t *hist) {
+    return hist->count;
+}
+
+unsigned long long hist_min(hist_t *hist) {
+    return hist->min;
+}
+
+unsigned long long hist_max(hist_t *hist) {
+    return hist->max;
+}
+
+double hist_mean(hist_t *hist) {
+    return hist->count > 0 ? hist->sum / hist->count : 0;
+}
+
+unsigned long long hist_percentile(hist_t *hist, double percent) {
+    unsigned long long rank, seen = 0, high;
+    int i;
+
+    if (hist->count == 0)
+        return 0;
+
+    /* The rank of the value, counting from 1 */
+    rank = (unsigned long long) (percent / 100 * hist->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > hist->count)
+        rank = hist->count;
+
+    for (i = 0; i < NUM_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            rangeof(i, &high);
+            return high < hist->max ? high : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+void hist_summary(hist_t *hist, FILE *out) {
+    fprintf(out, "n=%llu p50=%.3fus p99=%.3fus p999=%.3fus max=%.3fus\n",
+            hist->count, hist_percentile(hist, 50) / 1e3,
+            hist_percentile(hist, 99) / 1e3, hist_percentile(hist, 99.9) / 1e3,
+            hist->max / 1e3);
+}
+
+void hist_export(hist_t *hist, FILE *out, char *label, int header) {
+    unsigned long long low, high, seen = 0;
+    int i;
+
+    if (header)
+        fprintf(out, "label,low,high,count,fraction\n");
+    for (i = 0; i < NUM_BUCKETS; i++) {
+        if (hist->buckets[i] == 0)
+            continue;
+        seen += hist->buckets[i];
+        low = rangeof(i, &high);
+        fprintf(out, "%s,%llu,%llu,%llu,%.6f\n", label, low, high,
+                hist->buckets[i], (double) seen / hist->count);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdio.h>
+
+/*
+ * Latency histograms with log-linear buckets, in the style of HDR
+ * histograms.
+ *
+ * Values below 256 are counted exactly.  Above that, every power of two
+ * is split into 128 equal buckets, so a recorded value is known to
+ * within 1/128 (0.8%) of itself, over the whole range of 64-bit values.
+ * Recording is a few instructions and needs no allocation, and two
+ * histograms can be merged by adding their buckets, so each thread can
+ * record into its own histogram and merge them afterwards.
+ */
+struct hist;
+typedef struct hist hist_t;
+
+/*
+ * Creates an empty histogram.  Returns NULL if out of memory.
+ */
+hist_t *hist_create(void);
+
+void hist_destroy(hist_t *hist);
+
+/*
+ * Removes all recorded values.
+ */
+void hist_reset(hist_t *hist);
+
+/*
+ * Records one value, eg. a latency in nanoseconds.
+ */
+void hist_record(hist_t *hist, unsigned long long value);
+
+/*
+ * Adds the values recorded in from to into.
+ */
+void hist_merge(hist_t *into, hist_t *from);
+
+/*
+ * Returns the number of recorded values.
+ */
+unsigned long long hist_count(hist_t *hist);
+
+/*
+ * Return the exact smallest and largest recorded value, and the mean,
+ * or 0 if no values are recorded.
+ */
+unsigned long long hist_min(hist_t *hist);
+unsigned long long hist_max(hist_t *hist);
+double hist_mean(hist_t *hist);
+
+/*
+ * Returns the value below or at which the given percentage (0 to 100)
+ * of the recorded values lie, eg. 99.9 for the p999 latency.  The value
+ * is the highest value of its bucket, but never above hist_max().
+ */
+unsigned long long hist_percentile(hist_t *hist, double percent);
+
+/*
+ * Writes a one-line summary of the given histogram: count, p50, p99,
+ * p999 and max, with values in nanoseconds printed as microseconds.
+ */
+void hist_summary(hist_t *hist, FILE *out);
+
+/*
+ * Writes the full histogram as CSV, one line per non-empty bucket:
+ * label, the lowest and highest value of the bucket, its count, and the
+ * fraction of all values up to and including the bucket.  The label
+ * identifies the histogram when several are written to one file.  If
+ * header is set, a header line is written first.
+ */
+void hist_export(hist_t *hist, FILE *out, char *label, int header);
+
+#endif
@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "instrument.h"
+
+/* This file calls the real allocator */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+#undef aligned_alloc
+
+static char *names[INSTR_NUM_CALLS] = {
+    "set_create",
+    "set_destroy",
+    "set_size",
+    "set_add",
+    "set_contains",
+    "set_union",
+    "set_intersection",
+    "set_difference",
+    "set_copy",
+    "set_createiter",
+    "set_destroyiter",
+    "set_hasnext",
+    "set_next",
+    "set_next_batch",
+    "list_create",
+    "list_destroy",
+    "list_addfirst",
+    "list_addlast",
+    "list_popfirst",
+    "list_poplast",
+    "list_contains",
+    "list_sort",
+    "list_createiter",
+    "list_destroyiter",
+    "list_from_array",
+    "list_splice",
+};
+
+static instr_counts_t totals;
+static instr_counts_t percall[INSTR_NUM_CALLS];
+
+/*
+ * Nesting depth of API calls, the outermost call in progress, and the
+ * totals when it began
+ */
+static int depth;
+static int outermost;
+static instr_counts_t entry;
+
+/*
+ * The comparison functions are wrapped by a fixed set of counting
+ * trampolines, one per distinct comparison function, since cmpfunc_t
+ * has no room for a context argument.
+ */
+#define MAX_CMPFUNCS 8
+
+static cmpfunc_t realcmp[MAX_CMPFUNCS];
+
+#define COUNTING_CMP(i) \
+    static int counting_cmp##i(void *a, void *b) { \
+        totals.cmps++; \
+        return realcmp[i](a, b); \
+    }
+
+COUNTING_CMP(0)
+COUNTING_CMP(1)
+COUNTING_CMP(2)
+COUNTING_CMP(3)
+COUNTING_CMP(4)
+COUNTING_CMP(5)
+COUNTING_CMP(6)
+COUNTING_CMP(7)
+
+static cmpfunc_t counting[MAX_CMPFUNCS] = {
+    counting_cmp0, counting_cmp1, counting_cmp2, counting_cmp3,
+    counting_cmp4, counting_cmp5, counting_cmp6, counting_cmp7,
+};
+
+cmpfunc_t instr_wrapcmp(cmpfunc_t cmpfunc) {
+    int i;
+
+    for (i = 0; i < MAX_CMPFUNCS; i++) {
+        /* Don't count twice when a wrapped function is passed on */
+        if (counting[i] == cmpfunc)
+            return cmpfunc;
+        if (realcmp[i] == NULL)
+            realcmp[i] = cmpfunc;
+        if (realcmp[i] == cmpfunc)
+            return counting[i];
+    }
+    fatal_error("too many comparison functions to instrument");
+    return NULL;
+}
+
+void instr_enter(int call) {
+    if (depth++ == 0) {
+        entry = totals;
+        outermost = call;
+    }
+}
+
+void instr_leave(int call) {
+    instr_counts_t *c = &percall[call];
+
+    if (--depth > 0)
+        return;
+    if (depth < 0 || call != outermost)
+        fatal_error("instrumented calls left in the wrong order");
+    c->calls++;
+    c->cmps += totals.cmps - entry.cmps;
+    c->allocs += totals.allocs - entry.allocs;
+    c->frees += totals.frees - entry.frees;
+    c->bytes += totals.bytes - entry.bytes;
+}
+
+void instr_totals(instr_counts_t *counts) {
+    *counts = totals;
+}
+
+void instr_get(int call, instr_counts_t *counts) {
+    *counts = percall[call];
+}
+
+char *instr_name(int call) {
+    return names[call];
+}
+
+void instr_reset(void) {
+    int i;
+
+    for (i = 0; i < INSTR_NUM_CALLS; i++)
+        percall[i] = (instr_counts_t) { 0, 0, 0, 0, 0 };
+}
+
+void instr_report(FILE *out) {
+    instr_counts_t *c;
+    int i;
+
+    fprintf(out, "%-18s %12s %14s %14s %14s %16s\n",
+            "call", "calls", "cmps/call", "allocs/call", "frees/call", "bytes/call");
+    for (i = 0; i < INSTR_NUM_CALLS; i++) {
+        c = &percall[i];
+        if (c->calls == 0)
+            continue;
+        fprintf(out, "%-18s %12llu %14.2f %14.2f %14.2f %16.2f\n",
+                names[i], c->calls,
+                (double) c->cmps / c->calls, (double) c->allocs / c->calls,
+                (double) c->frees / c->calls, (double) c->bytes / c->calls);
+    }
+}
+
+void *instr_malloc(size_t size) {
+    totals.allocs++;
+    totals.bytes += size;
+    return malloc(size);
+}
+
+void *instr_calloc(size_t nmemb, size_t size) {
+    totals.allocs++;
+    totals.bytes += nmemb * size;
+    return calloc(nmemb, size);
+}
+
+void *instr_realloc(void *ptr, size_t size) {
+    totals.allocs++;
+    totals.bytes += size;
+    return realloc(ptr, size);
+}
+
+void *instr_aligned_alloc(size_t alignment, size_t size) {
+    totals.allocs++;
+    totals.bytes += size;
+    return aligned_alloc(alignment, size);
+}
+
+void instr_free(void *ptr) {
+    if (ptr != NULL)
+        totals.frees++;
+    free(ptr);
+}
@@ -0,0 +1,138 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+
+/*
+ * Instrumentation of the set and list libraries.
+ *
+ * When compiled with -DINSTRUMENT, the libraries count comparisons
+ * (by wrapping the comparison functions given to set_create() and
+ * list_create()), and calls to malloc, calloc, realloc, aligned_alloc
+ * and free along with the bytes requested.  The counts are attributed
+ * to the outermost public API call that is in progress, so the
+ * comparisons that set_list_simple.c makes through list_sort() are
+ * reported under set_add().  Without -DINSTRUMENT the hooks compile to
+ * nothing.
+ */
+
+/*
+ * The instrumented API calls.
+ */
+enum {
+    INSTR_SET_CREATE,
+    INSTR_SET_DESTROY,
+    INSTR_SET_SIZE,
+    INSTR_SET_ADD,
+    INSTR_SET_CONTAINS,
+    INSTR_SET_UNION,
+    INSTR_SET_INTERSECTION,
+    INSTR_SET_DIFFERENCE,
+    INSTR_SET_COPY,
+    INSTR_SET_CREATEITER,
+    INSTR_SET_DESTROYITER,
+    INSTR_SET_HASNEXT,
+    INSTR_SET_NEXT,
+    INSTR_SET_NEXTBATCH,
+    INSTR_LIST_CREATE,
+    INSTR_LIST_DESTROY,
+    INSTR_LIST_ADDFIRST,
+    INSTR_LIST_ADDLAST,
+    INSTR_LIST_POPFIRST,
+    INSTR_LIST_POPLAST,
+    INSTR_LIST_CONTAINS,
+    INSTR_LIST_SORT,
+    INSTR_LIST_CREATEITER,
+    INSTR_LIST_DESTROYITER,
+    INSTR_LIST_FROMARRAY,
+    INSTR_LIST_SPLICE,
+    INSTR_NUM_CALLS
+};
+
+/*
+ * Counts for one API call, or totals.
+ */
+typedef struct instr_counts {
+    unsigned long long calls;
+    unsigned long long cmps;
+    unsigned long long allocs;
+    unsigned long long frees;
+    unsigned long long bytes;
+} instr_counts_t;
+
+/*
+ * Returns a comparison function that counts its calls and then calls
+ * the given one.
+ */
+cmpfunc_t instr_wrapcmp(cmpfunc_t cmpfunc);
+
+/*
+ * Marks the start and end of a call to the given API function.  The
+ * INSTR_ENTER(), INSTR_LEAVE() and INSTR_RETURN() macros below call
+ * these in instrumented builds only.
+ */
+void instr_enter(int call);
+void instr_leave(int call);
+
+/*
+ * Stores the total counts since the start of the program in *counts.
+ * The totals include counts made outside of API calls.
+ */
+void instr_totals(instr_counts_t *counts);
+
+/*
+ * Stores the counts attributed to the given API call in *counts.
+ */
+void instr_get(int call, instr_counts_t *counts);
+
+/*
+ * Returns the name of the given API call, eg. "set_add".
+ */
+char *instr_name(int call);
+
+/*
+ * Clears the per-call counts.
+ */
+void instr_reset(void);
+
+/*
+ * Writes a table of the per-call counts to the given file.
+ */
+void instr_report(FILE *out);
+
+void *instr_malloc(size_t size);
+void *instr_calloc(size_t nmemb, size_t size);
+void *instr_realloc(void *ptr, size_t size);
+void instr_free(void *ptr);
+void *instr_aligned_alloc(size_t alignment, size_t size);
+
+#ifdef INSTRUMENT
+
+#define INSTR_WRAPCMP(cmpfunc) instr_wrapcmp(cmpfunc)
+#define INSTR_ENTER(call) instr_enter(call)
+#define INSTR_LEAVE(call) instr_leave(call)
+#define INSTR_RETURN(call, value) do { instr_leave(call); return value; } while (0)
+
+/*
+ * Route the allocations of the including file through the counters.
+ * This header must be included after <stdlib.h>.
+ */
+#define malloc(size) instr_malloc(size)
+#define calloc(nmemb, size) instr_calloc(nmemb, size)
+#define realloc(ptr, size) instr_realloc(ptr, size)
+#define free(ptr) instr_free(ptr)
+#define aligned_alloc(alignment, size) instr_aligned_alloc(alignment, size)
+
+#else
+
+#define INSTR_WRAPCMP(cmpfunc) (cmpfunc)
+#define INSTR_ENTER(call) ((void) 0)
+#define INSTR_LEAVE(call) ((void) 0)
+#define INSTR_RETURN(call, value) return value
+
+#endif
+
+#endif
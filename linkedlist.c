@@ -2,6 +2,10 @@
 #include "list.h"
 
 #include <stdlib.h>
+#include <pthread.h>
+
+#include "instrument.h"
+#include "strsort.h"
 
 struct node;
 
@@ -18,15 +22,15 @@ struct list {
     node_t *tail;
     int size;
     cmpfunc_t cmpfunc;
+    pool_t *pool;
 };
 
-struct list_iter {
-    node_t *node;
-};
+/* The pool selected with list_usepool(), if any */
+static pool_t *sharedpool;
 
-static node_t *newnode(void *elem)
+static node_t *newnode(list_t *list, void *elem)
 {
-    node_t *node = malloc(sizeof(node_t));
+    node_t *node = pool_alloc(list->pool);
     if (node == NULL)
         return NULL;
     
@@ -36,28 +40,50 @@ static node_t *newnode(void *elem)
     return node;
 }
 
+void list_usepool(pool_t *pool)
+{
+    if (pool != NULL && pool_objsize(pool) < sizeof(node_t))
+        fatal_error("pool objects are too small for list nodes");
+    sharedpool = pool;
+}
+
 list_t *list_create(cmpfunc_t cmpfunc)
 {
+    INSTR_ENTER(INSTR_LIST_CREATE);
     list_t *list = malloc(sizeof(list_t));
     if (list == NULL)
-	    return NULL;
+	    INSTR_RETURN(INSTR_LIST_CREATE, NULL);
     
+    if (sharedpool != NULL) {
+        list->pool = sharedpool;
+        pool_retain(sharedpool);
+    }
+    else if ((list->pool = pool_create(sizeof(node_t))) == NULL) {
+        free(list);
+        INSTR_RETURN(INSTR_LIST_CREATE, NULL);
+    }
     list->head = NULL;
     list->tail = NULL;
     list->size = 0;
-    list->cmpfunc = cmpfunc;
-    return list;
+    list->cmpfunc = INSTR_WRAPCMP(cmpfunc);
+    INSTR_RETURN(INSTR_LIST_CREATE, list);
 }
 
 void list_destroy(list_t *list)
 {
-    node_t *node = list->head;
-    while (node != NULL) {
-	    node_t *tmp = node;
-	    node = node->next;
-	    free(tmp);
+    INSTR_ENTER(INSTR_LIST_DESTROY);
+    /* A private pool goes with all its nodes at once */
+    if (pool_shared(list->pool)) {
+        node_t *node = list->head;
+        while (node != NULL) {
+	        node_t *tmp = node;
+	        node = node->next;
+	        pool_free(list->pool, tmp);
+        }
     }
+    pool_release(list->pool);
     free(list);
+    INSTR_LEAVE(INSTR_LIST_DESTROY);
 }
 
 int list_size(list_t *list)
@@ -67,9 +93,10 @@ int list_size(list_t *list)
 
 int list_addfirst(list_t *list, void *elem)
 {
-    node_t *node = newnode(elem);
+    INSTR_ENTER(INSTR_LIST_ADDFIRST);
+    node_t *node = newnode(list, elem);
     if (node == NULL)
-        return 0;
+        INSTR_RETURN(INSTR_LIST_ADDFIRST, 0);
     
     if (list->head == NULL) {
 	    list->head = list->tail = node;
@@ -80,14 +107,15 @@ int list_addfirst(list_t *list, void *elem)
 	    list->head = node;
     }
     list->size++;
-    return 1;
+    INSTR_RETURN(INSTR_LIST_ADDFIRST, 1);
 }
 
 int list_addlast(list_t *list, void *elem)
 {
-    node_t *node = newnode(elem);
+    INSTR_ENTER(INSTR_LIST_ADDLAST);
+    node_t *node = newnode(list, elem);
     if (node == NULL)
-        return 0;
+        INSTR_RETURN(INSTR_LIST_ADDLAST, 0);
     
     if (list->head == NULL) {
 	    list->head = list->tail = node;
@@ -98,13 +126,107 @@ int list_addlast(list_t *list, void *elem)
 	    list->tail = node;
     }
     list->size++;
+    INSTR_RETURN(INSTR_LIST_ADDLAST, 1);
+}
+
+list_t *list_from_array(cmpfunc_t cmpfunc, void **elems, int n)
+{
+    INSTR_ENTER(INSTR_LIST_FROMARRAY);
+    list_t *list = list_create(cmpfunc);
+    node_t *node, *prev = NULL;
+    int i;
+
+    if (list == NULL)
+	    INSTR_RETURN(INSTR_LIST_FROMARRAY, NULL);
+
+    /* Link the nodes as they come; only the ends need fixing */
+    for (i = 0; i < n; i++) {
+	    node = newnode(list, elems[i]);
+	    if (node == NULL) {
+	        list->tail = prev;
+	        list_destroy(list);
+	        INSTR_RETURN(INSTR_LIST_FROMARRAY, NULL);
+	    }
+	    node->prev = prev;
+	    if (prev == NULL)
+	        list->head = node;
+	    else
+	        prev->next = node;
+	    prev = node;
+    }
+    list->tail = prev;
+    list->size = n;
+    INSTR_RETURN(INSTR_LIST_FROMARRAY, list);
+}
+
+int list_to_array(list_t *list, void **elems)
+{
+    node_t *node;
+    int n = 0;
+
+    for (node = list->head; node != NULL; node = node->next)
+	    elems[n++] = node->elem;
+    return n;
+}
+
+/*
+ * Lets list and other share the pool of list, if the nodes of other
+ * can move there.  Returns 1 if so, or 0 if not.
+ */
+static int sharepool(list_t *list, list_t *other)
+{
+    if (other->pool == list->pool)
+	    return 1;
+    if (pool_shared(other->pool) || !pool_merge(list->pool, other->pool))
+	    return 0;
+    other->pool = list->pool;
+    pool_retain(list->pool);
     return 1;
 }
 
+int list_splice(list_t *list, list_t *other)
+{
+    INSTR_ENTER(INSTR_LIST_SPLICE);
+    if (other->head == NULL)
+	    INSTR_RETURN(INSTR_LIST_SPLICE, 1);
+
+    if (!sharepool(list, other)) {
+	    /* The nodes cannot change pools, so the elements move instead */
+	    while (other->head != NULL) {
+	        node_t *node = newnode(list, other->head->elem);
+	        if (node == NULL)
+		        INSTR_RETURN(INSTR_LIST_SPLICE, 0);
+	        node->prev = list->tail;
+	        if (list->tail == NULL)
+		        list->head = node;
+	        else
+		        list->tail->next = node;
+	        list->tail = node;
+	        list->size++;
+	        list_popfirst(other);
+	    }
+	    INSTR_RETURN(INSTR_LIST_SPLICE, 1);
+    }
+
+    if (list->tail == NULL) {
+	    list->head = other->head;
+    }
+    else {
+	    list->tail->next = other->head;
+	    other->head->prev = list->tail;
+    }
+    list->tail = other->tail;
+    list->size += other->size;
+    other->head = other->tail = NULL;
+    other->size = 0;
+    INSTR_RETURN(INSTR_LIST_SPLICE, 1);
+}
+
 void *list_popfirst(list_t *list)
 {
+    INSTR_ENTER(INSTR_LIST_POPFIRST);
     if (list->head == NULL) {
-	    return NULL;
+	    INSTR_RETURN(INSTR_LIST_POPFIRST, NULL);
     }
     else {
         void *elem = list->head->elem;
@@ -117,15 +239,16 @@ void *list_popfirst(list_t *list)
 	        list->head->prev = NULL;
 	    }
 	    list->size--;
-	    free(tmp);
-	    return elem;
+	    pool_free(list->pool, tmp);
+	    INSTR_RETURN(INSTR_LIST_POPFIRST, elem);
     }
 }
 
 void *list_poplast(list_t *list)
 {
+    INSTR_ENTER(INSTR_LIST_POPLAST);
     if (list->tail == NULL) {
-        return NULL;
+        INSTR_RETURN(INSTR_LIST_POPLAST, NULL);
     }
     else {
         void *elem = list->tail->elem;
@@ -137,113 +260,359 @@ void *list_poplast(list_t *list)
 	    else {
 	        list->tail->next = NULL;
 	    }
-	    free(tmp);
+	    pool_free(list->pool, tmp);
 	    list->size--;
-	    return elem;
+	    INSTR_RETURN(INSTR_LIST_POPLAST, elem);
     }
 }
 
 int list_contains(list_t *list, void *elem)
 {
+    INSTR_ENTER(INSTR_LIST_CONTAINS);
     node_t *node = list->head;
     while (node != NULL) {
 	    if (list->cmpfunc(elem, node->elem) == 0)
-	        return 1;
+	        INSTR_RETURN(INSTR_LIST_CONTAINS, 1);
 	    node = node->next;
     }
-    return 0;
+    INSTR_RETURN(INSTR_LIST_CONTAINS, 0);
 }
 
 /*
- * Merges two sorted lists a and b using the given comparison function.
- * Only assigns the next pointers; the prev pointers will have to be
- * fixed by the caller.  Returns the head of the merged list.
+ * list_sort is a natural merge sort in the style of TimSort.  The list
+ * is cut into runs that are already in order: ascending runs are kept
+ * as they are, strictly descending runs are reversed (strictly, so that
+ * equal elements keep their order), and runs shorter than minrun are
+ * extended with insertion sort.  The runs are pushed on a stack, and
+ * merged bottom-up whenever the lengths at the top of the stack break
+ * TimSort's invariants, which keeps the merges balanced and the stack
+ * shallow without any recursion.  A sorted or reversed list is a single
+ * run, and costs n - 1 comparisons.
+ *
+ * While sorting, runs are NULL-terminated chains of next pointers only.
+ * The prev pointers are fixed when the sort is done.
  */
-static node_t *merge(node_t *a, node_t *b, cmpfunc_t cmpfunc)
-{
-	node_t *head, *tail;
-	
-	/* Pick the smallest head node */
-	if (cmpfunc(a->elem, b->elem) < 0) {
-		head = tail = a;
-		a = a->next;
+
+/*
+ * Lists shorter than this are sorted with insertion sort alone.  Insertion
+ * into a list is a linear scan rather than a binary search, so runs are
+ * kept shorter than in TimSort on arrays.
+ */
+#define MIN_MERGE 16
+
+/* Initial number of wins in a row that switches a merge to galloping */
+#define MIN_GALLOP 7
+
+/* Run lengths on the stack grow faster than the Fibonacci numbers */
+#define MAX_RUNS 64
+
+typedef struct run {
+	node_t *head;
+	node_t *tail;
+	int len;
+} run_t;
+
+typedef struct sorter {
+	cmpfunc_t cmpfunc;
+	int mingallop;
+	int nruns;
+	run_t runs[MAX_RUNS];
+} sorter_t;
+
+/*
+ * Returns the minimum run length for a list of n elements: n itself if
+ * the list is short, and otherwise a length between MIN_MERGE / 2 and
+ * MIN_MERGE such that n / minrun is a power of two, or just below one.
+ */
+static int minrunlength(int n)
+{
+	int r = 0;
+
+	while (n >= MIN_MERGE) {
+		r |= n & 1;
+		n >>= 1;
+	}
+	return n + r;
+}
+
+/*
+ * Inserts the given node into the given sorted run, after any elements
+ * equal to it.
+ */
+static void insert(sorter_t *s, run_t *run, node_t *node)
+{
+	node_t *prev;
+
+	if (s->cmpfunc(node->elem, run->tail->elem) >= 0) {
+		node->next = NULL;
+		run->tail->next = node;
+		run->tail = node;
+	}
+	else if (s->cmpfunc(node->elem, run->head->elem) < 0) {
+		node->next = run->head;
+		run->head = node;
 	}
 	else {
-		head = tail = b;
-		b = b->next;
+		/* The tail is greater, so this stops before the end */
+		prev = run->head;
+		while (s->cmpfunc(node->elem, prev->next->elem) >= 0)
+			prev = prev->next;
+		node->next = prev->next;
+		prev->next = node;
+	}
+}
+
+/*
+ * Cuts the next run off the front of the chain starting at node, and
+ * stores it in run.  Returns the rest of the chain.
+ */
+static node_t *nextrun(sorter_t *s, node_t *node, int minrun, run_t *run)
+{
+	node_t *rest = node->next, *next;
+	int len = 1;
+
+	if (rest != NULL && s->cmpfunc(rest->elem, node->elem) < 0) {
+		/* Strictly descending; reverse it while walking it */
+		node->next = NULL;
+		run->tail = node;
+		while (rest != NULL && s->cmpfunc(rest->elem, node->elem) < 0) {
+			next = rest->next;
+			rest->next = node;
+			node = rest;
+			rest = next;
+			len++;
+		}
+		run->head = node;
+	}
+	else {
+		run->head = node;
+		while (rest != NULL && s->cmpfunc(rest->elem, node->elem) >= 0) {
+			node = rest;
+			rest = rest->next;
+			len++;
+		}
+		node->next = NULL;
+		run->tail = node;
+	}
+
+	/* Extend a short run with insertion sort */
+	while (len < minrun && rest != NULL) {
+		node = rest;
+		rest = rest->next;
+		insert(s, run, node);
+		len++;
+	}
+	run->len = len;
+	return rest;
+}
+
+/*
+ * Returns the node n steps after the given one.
+ */
+static node_t *skip(node_t *node, long n)
+{
+	while (n-- > 0)
+		node = node->next;
+	return node;
+}
+
+/*
+ * Returns whether elem goes before key in a merge.  With ties set, elem
+ * is from the first run and goes before equal elements of the second.
+ */
+static int before(sorter_t *s, void *elem, void *key, int ties)
+{
+	int cmp = s->cmpfunc(elem, key);
+
+	return ties ? cmp <= 0 : cmp < 0;
+}
+
+/*
+ * Counts the leading elements, of the len elements from node on, that
+ * go before key, and stores the last of them in *last.  The elements at
+ * positions 1, 2, 4, 8, ... are probed until one does not go before
+ * key, and the count is then found by binary search between the last
+ * two probes.  This takes O(log k) comparisons for a count of k, at the
+ * cost of walking up to twice as many nodes.
+ */
+static int gallop(sorter_t *s, node_t *node, int len, void *key, int ties,
+                  node_t **last)
+{
+	node_t *lownode = NULL, *probe;
+	long low = 0, high = (long) len + 1, pos, mid;
+
+	/* Positions are counted from 1, and lownode is at position low */
+	for (pos = 1; pos <= len; pos *= 2) {
+		probe = lownode == NULL ? skip(node, pos - 1) : skip(lownode, pos - low);
+		if (!before(s, probe->elem, key, ties)) {
+			high = pos;
+			break;
+		}
+		low = pos;
+		lownode = probe;
 	}
-	/* Now repeatedly pick the smallest head node */
-	while (a != NULL && b != NULL) {
-		if (cmpfunc(a->elem, b->elem) < 0) {
-			tail->next = a;
-			tail = a;
-			a = a->next;
+	while (high - low > 1) {
+		mid = low + (high - low) / 2;
+		probe = lownode == NULL ? skip(node, mid - 1) : skip(lownode, mid - low);
+		if (before(s, probe->elem, key, ties)) {
+			low = mid;
+			lownode = probe;
 		}
 		else {
-			tail->next = b;
-			tail = b;
-			b = b->next;
+			high = mid;
+		}
+	}
+	*last = lownode;
+	return low;
+}
+
+/*
+ * Merges run b into run a, which precedes it.  Ties are taken from a,
+ * so the merge is stable.  After MIN_GALLOP wins in a row for the same
+ * run, the merge gallops, moving whole stretches of each run at a time,
+ * until the stretches get short again.  mingallop adapts to how well
+ * galloping pays off on the list being sorted.
+ */
+static void mergeruns(sorter_t *s, run_t *a, run_t *b)
+{
+	node_t head, *tail = &head, *x = a->head, *y = b->head, *last;
+	int nx = a->len, ny = b->len, xwins = 0, ywins = 0, k, j;
+
+	/* Runs that are already in order are just joined */
+	if (s->cmpfunc(y->elem, a->tail->elem) >= 0) {
+		a->tail->next = y;
+		a->tail = b->tail;
+		a->len += b->len;
+		return;
+	}
+
+	while (nx > 0 && ny > 0) {
+		if (xwins < s->mingallop && ywins < s->mingallop) {
+			if (s->cmpfunc(y->elem, x->elem) < 0) {
+				tail->next = y;
+				tail = y;
+				y = y->next;
+				ny--;
+				ywins++;
+				xwins = 0;
+			}
+			else {
+				tail->next = x;
+				tail = x;
+				x = x->next;
+				nx--;
+				xwins++;
+				ywins = 0;
+			}
+			continue;
+		}
+
+		k = gallop(s, x, nx, y->elem, 1, &last);
+		if (k > 0) {
+			tail->next = x;
+			tail = last;
+			x = last->next;
+			nx -= k;
+		}
+		if (nx == 0)
+			break;
+		/* Now y is less than x, so j is at least 1 */
+		j = gallop(s, y, ny, x->elem, 0, &last);
+		tail->next = y;
+		tail = last;
+		y = last->next;
+		ny -= j;
+
+		if (k < MIN_GALLOP && j < MIN_GALLOP) {
+			s->mingallop++;
+			xwins = ywins = 0;
+		}
+		else if (s->mingallop > 1) {
+			s->mingallop--;
 		}
 	}
-	/* Append the remaining non-empty list (if any) */
-	if (a != NULL) {
-		tail->next = a;
+
+	/* Append the rest of the run that is left */
+	if (nx > 0) {
+		tail->next = x;
 	}
 	else {
-		tail->next = b;
+		tail->next = y;
+		a->tail = b->tail;
 	}
-	return head;
+	a->head = head.next;
+	a->len += b->len;
+}
+
+/*
+ * Merges the runs at index i and i + 1 on the stack.
+ */
+static void mergeat(sorter_t *s, int i)
+{
+	mergeruns(s, &s->runs[i], &s->runs[i + 1]);
+	if (i + 2 < s->nruns)
+		s->runs[i + 1] = s->runs[i + 2];
+	s->nruns--;
 }
 
 /*
- * Splits the given list in two halves, and returns the head of
- * the second half.
+ * Merges runs at the top of the stack until TimSort's invariants hold
+ * for the top four runs again: each run is longer than the one above
+ * it, and than the two above it together.
  */
-static node_t *splitlist(node_t *head)
-{
-	node_t *slow, *fast, *half;
-	
-	/* Move two pointers, a 'slow' one and a 'fast' one which moves
-	 * twice as fast.  When the fast one reaches the end of the list,
-	 * the slow one will be at the middle.
-	 */
-	slow = head;
-	fast = head->next;
-	while (fast != NULL && fast->next != NULL) {
-		slow = slow->next;
-		fast = fast->next->next;
+static void collapse(sorter_t *s)
+{
+	run_t *r = s->runs;
+	int i;
+
+	while (s->nruns > 1) {
+		i = s->nruns - 2;
+		if ((i > 0 && r[i - 1].len <= r[i].len + r[i + 1].len) ||
+		    (i > 1 && r[i - 2].len <= r[i - 1].len + r[i].len)) {
+			if (r[i - 1].len < r[i + 1].len)
+				i--;
+		}
+		else if (r[i].len > r[i + 1].len) {
+			break;
+		}
+		mergeat(s, i);
 	}
-	/* Now 'cut' the list and return the second half */
-	half = slow->next;
-	slow->next = NULL;
-	return half;
 }
 
 /*
- * Recursive merge sort.  This function is named mergesort_ to avoid
- * collision with the mergesort function that is defined by the standard
- * library on some platforms.
+ * Sorts the chain of size nodes from head on, and returns its new head.
+ * Only the next pointers are assigned.
  */
-static node_t *mergesort_(node_t *head, cmpfunc_t cmpfunc)
+static node_t *sortchain(node_t *head, int size, cmpfunc_t cmpfunc)
 {
-    if (head->next == NULL) {
-        return head;
-    }
-    else {
-        node_t *half = splitlist(head);
-        head = mergesort_(head, cmpfunc);
-        half = mergesort_(half, cmpfunc);
-        return merge(head, half, cmpfunc);
-    }
+	sorter_t s;
+	int minrun = minrunlength(size), i;
+
+	s.cmpfunc = cmpfunc;
+	s.mingallop = MIN_GALLOP;
+	s.nruns = 0;
+
+	/* Push the runs one by one, merging as they come */
+	while (head != NULL) {
+		head = nextrun(&s, head, minrun, &s.runs[s.nruns++]);
+		collapse(&s);
+	}
+	/* Merge what is left on the stack */
+	while (s.nruns > 1) {
+		i = s.nruns - 2;
+		if (i > 0 && s.runs[i - 1].len < s.runs[i + 1].len)
+			i--;
+		mergeat(&s, i);
+	}
+	return s.runs[0].head;
 }
 
-void list_sort(list_t *list)
+static void sortlist(list_t *list)
 {
     if (list->head != NULL) {
         node_t *prev, *n;
     
-        /* Recursively sort the list */
-        list->head = mergesort_(list->head, list->cmpfunc);
+        list->head = sortchain(list->head, list->size, list->cmpfunc);
     
         /* Fix the tail and prev links */
         prev = NULL;
@@ -255,6 +624,266 @@ void list_sort(list_t *list)
     }
 }
 
+void list_sort(list_t *list)
+{
+    INSTR_ENTER(INSTR_LIST_SORT);
+    sortlist(list);
+    INSTR_LEAVE(INSTR_LIST_SORT);
+}
+
+/*
+ * list_parallelsort cuts the list into one segment per thread, and the
+ * threads sort their segments concurrently with sortchain().  Each
+ * thread then writes the nodes of its sorted segment into an array, and
+ * the segments are merged pairwise, in rounds, between that array and a
+ * second one.  In every round each thread produces an equal share of the
+ * output.  Where its share starts on the merge path of a pair of
+ * segments is found by binary search along a diagonal, so the threads
+ * never wait on each other within a round.  Finally each thread relinks
+ * the next and prev pointers of its share of the nodes.
+ *
+ * Ties are always taken from the earlier segment, so the result is the
+ * same as that of list_sort.
+ */
+
+/* Lists with fewer nodes than this per thread use fewer threads */
+#define MIN_SEGMENT 8192
+
+#define MAX_THREADS 64
+
+/* The state shared by all threads of a parallel sort */
+typedef struct sortstate {
+	cmpfunc_t cmpfunc;
+	int size;
+	int nthreads;
+	/* Segment i is at bounds[i] to bounds[i + 1] in the arrays */
+	int nsegs;
+	int bounds[MAX_THREADS + 1];
+	/* The unsorted segments, before they are written to src */
+	node_t *heads[MAX_THREADS];
+	node_t **src;
+	node_t **dst;
+} sortstate_t;
+
+typedef struct sortjob {
+	sortstate_t *state;
+	int id;
+	pthread_t thread;
+} sortjob_t;
+
+/*
+ * Runs func on every job and waits for them all.  The first job runs in
+ * the calling thread, and the others in threads of their own.  A job
+ * whose thread cannot be created also runs in the calling thread.
+ */
+static void runjobs(sortjob_t *jobs, int n, void *(*func)(void *))
+{
+	int started[MAX_THREADS], i;
+
+	for (i = 1; i < n; i++)
+		started[i] = pthread_create(&jobs[i].thread, NULL, func, &jobs[i]) == 0;
+	func(&jobs[0]);
+	for (i = 1; i < n; i++) {
+		if (started[i])
+			pthread_join(jobs[i].thread, NULL);
+		else
+			func(&jobs[i]);
+	}
+}
+
+/*
+ * Returns the first index of the share of the given job in an array of
+ * the sort's size.
+ */
+static int sharestart(sortstate_t *state, int id)
+{
+	return (long) state->size * id / state->nthreads;
+}
+
+/*
+ * Sorts the job's segment, and writes its nodes to src.
+ */
+static void *sortsegment(void *arg)
+{
+	sortjob_t *job = arg;
+	sortstate_t *state = job->state;
+	int i = state->bounds[job->id];
+	node_t *node;
+
+	node = sortchain(state->heads[job->id],
+	                 state->bounds[job->id + 1] - i, state->cmpfunc);
+	for (; node != NULL; node = node->next)
+		state->src[i++] = node;
+	return NULL;
+}
+
+/*
+ * Returns how many of the first d nodes of the merge of a and b come
+ * from a.  Ties are taken from a.
+ */
+static int splitpath(node_t **a, int na, node_t **b, int nb, int d,
+                     cmpfunc_t cmpfunc)
+{
+	int low = d > nb ? d - nb : 0, high = d < na ? d : na, mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (cmpfunc(a[mid]->elem, b[d - mid - 1]->elem) <= 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/*
+ * Writes nodes first to last - 1 of the merge of a and b to out.
+ */
+static void mergepath(node_t **a, int na, node_t **b, int nb,
+                      int first, int last, node_t **out, cmpfunc_t cmpfunc)
+{
+	int i = splitpath(a, na, b, nb, first, cmpfunc), j = first - i, k;
+
+	for (k = first; k < last; k++) {
+		if (j == nb || (i < na && cmpfunc(a[i]->elem, b[j]->elem) <= 0))
+			out[k] = a[i++];
+		else
+			out[k] = b[j++];
+	}
+}
+
+/*
+ * Produces the job's share of the next round of merges, from src to dst.
+ * The last segment has no partner if the number of segments is odd, and
+ * is merged with an empty one.
+ */
+static void *mergeshare(void *arg)
+{
+	sortjob_t *job = arg;
+	sortstate_t *state = job->state;
+	int low = sharestart(state, job->id), high = sharestart(state, job->id + 1);
+	int k, start, mid, end, first, last;
+
+	for (k = 0; k < state->nsegs; k += 2) {
+		start = state->bounds[k];
+		mid = state->bounds[k + 1];
+		end = k + 2 <= state->nsegs ? state->bounds[k + 2] : mid;
+		if (end <= low || start >= high)
+			continue;
+		first = low > start ? low : start;
+		last = high < end ? high : end;
+		mergepath(state->src + start, mid - start, state->src + mid, end - mid,
+		          first - start, last - start, state->dst + start, state->cmpfunc);
+	}
+	return NULL;
+}
+
+/*
+ * Links the nodes of the job's share of the sorted array to their
+ * neighbours.
+ */
+static void *relink(void *arg)
+{
+	sortjob_t *job = arg;
+	sortstate_t *state = job->state;
+	node_t **nodes = state->src;
+	int k, high = sharestart(state, job->id + 1);
+
+	for (k = sharestart(state, job->id); k < high; k++) {
+		nodes[k]->prev = k > 0 ? nodes[k - 1] : NULL;
+		nodes[k]->next = k + 1 < state->size ? nodes[k + 1] : NULL;
+	}
+	return NULL;
+}
+
+void list_parallelsort(list_t *list, int nthreads)
+{
+    INSTR_ENTER(INSTR_LIST_SORT);
+    sortstate_t state;
+    sortjob_t jobs[MAX_THREADS];
+    node_t **arrays = NULL, **tmp, *node, *next;
+    int i, k;
+
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+    if (nthreads > list->size / MIN_SEGMENT)
+        nthreads = list->size / MIN_SEGMENT;
+    if (nthreads > 1)
+        arrays = malloc(2 * sizeof(node_t *) * list->size);
+    if (arrays == NULL) {
+        sortlist(list);
+        INSTR_LEAVE(INSTR_LIST_SORT);
+        return;
+    }
+
+    state.cmpfunc = list->cmpfunc;
+    state.size = list->size;
+    state.nthreads = nthreads;
+    state.nsegs = nthreads;
+    state.src = arrays;
+    state.dst = arrays + list->size;
+
+    /* Cut the list into segments */
+    node = list->head;
+    for (i = 0; i < nthreads; i++) {
+        state.bounds[i] = sharestart(&state, i);
+        state.heads[i] = node;
+        for (k = sharestart(&state, i + 1) - state.bounds[i]; k > 1; k--)
+            node = node->next;
+        next = node->next;
+        node->next = NULL;
+        node = next;
+    }
+    state.bounds[nthreads] = list->size;
+
+    for (i = 0; i < nthreads; i++) {
+        jobs[i].state = &state;
+        jobs[i].id = i;
+    }
+    runjobs(jobs, nthreads, sortsegment);
+
+    while (state.nsegs > 1) {
+        runjobs(jobs, nthreads, mergeshare);
+        for (i = 0; 2 * i < state.nsegs; i++)
+            state.bounds[i] = state.bounds[2 * i];
+        state.nsegs = i;
+        state.bounds[i] = list->size;
+        tmp = state.src;
+        state.src = state.dst;
+        state.dst = tmp;
+    }
+
+    runjobs(jobs, nthreads, relink);
+    list->head = state.src[0];
+    list->tail = state.src[list->size - 1];
+    free(arrays);
+    INSTR_LEAVE(INSTR_LIST_SORT);
+}
+
+void list_sortstrings(list_t *list, int nocase)
+{
+    INSTR_ENTER(INSTR_LIST_SORT);
+    if (list->size > 1) {
+        char **strs = malloc(sizeof(char *) * list->size);
+        node_t *n;
+        int i;
+
+        if (strs == NULL)
+            fatal_error("out of memory");
+
+        /* Sort the elements, and put them back in the same nodes */
+        i = 0;
+        for (n = list->head; n != NULL; n = n->next)
+            strs[i++] = n->elem;
+        strsort(strs, list->size, nocase);
+        i = 0;
+        for (n = list->head; n != NULL; n = n->next)
+            n->elem = strs[i++];
+        free(strs);
+    }
+    INSTR_LEAVE(INSTR_LIST_SORT);
+}
+
 /*
  * Not actually used.
  */
@@ -282,17 +911,26 @@ static void list_selection_sort(list_t *list)
 
 list_iter_t *list_createiter(list_t *list)
 {
+    INSTR_ENTER(INSTR_LIST_CREATEITER);
     list_iter_t *iter = malloc(sizeof(list_iter_t));
     if (iter == NULL)
-	    return NULL;
+	    INSTR_RETURN(INSTR_LIST_CREATEITER, NULL);
     
+    list_iter_init(iter, list);
+    INSTR_RETURN(INSTR_LIST_CREATEITER, iter);
+}
+
+list_iter_t *list_iter_init(list_iter_t *iter, list_t *list)
+{
     iter->node = list->head;
     return iter;
 }
 
 void list_destroyiter(list_iter_t *iter)
 {
+    INSTR_ENTER(INSTR_LIST_DESTROYITER);
     free(iter);
+    INSTR_LEAVE(INSTR_LIST_DESTROYITER);
 }
 
 int list_hasnext(list_iter_t *iter)
@@ -309,9 +947,22 @@ void *list_next(list_iter_t *iter)
 	    return NULL;
     }
     else {
-	    void *elem = iter->node->elem;
-	    iter->node = iter->node->next;
-	    return elem;
+	    node_t *node = iter->node;
+	    iter->node = node->next;
+	    return node->elem;
+    }
+}
+
+int list_next_batch(list_iter_t *iter, void **buf, int max)
+{
+    node_t *node = iter->node;
+    int n = 0;
+
+    while (n < max && node != NULL) {
+	    buf[n++] = node->elem;
+	    node = node->next;
     }
+    iter->node = node;
+    return n;
 }
 
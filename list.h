@@ -3,6 +3,7 @@
 #define LIST_H
 
 #include "common.h"
+#include "pool.h"
 
 /*
  * The type of lists.
@@ -20,6 +21,15 @@ typedef struct list list_t;
  */
 list_t *list_create(cmpfunc_t cmpfunc);
 
+/*
+ * Selects the node pool shared by lists created from now on (see
+ * pool.h), or gives each new list a pool of its own if pool is NULL,
+ * which is the default.  The pool's objects must be large enough for
+ * the nodes of the list implementation.  Implementations without nodes,
+ * such as the unrolled list, ignore it.
+ */
+void list_usepool(pool_t *pool);
+
 /*
  * Destroys the given list.  Subsequently accessing the list
  * will lead to undefined behavior.
@@ -43,6 +53,28 @@ int list_addfirst(list_t *list, void *elem);
  */
 int list_addlast(list_t *list, void *elem);
 
+/*
+ * Creates a new list that uses the given comparison function, holding
+ * the n given elements in order.  Returns NULL if out of memory.
+ */
+list_t *list_from_array(cmpfunc_t cmpfunc, void **elems, int n);
+
+/*
+ * Copies the elements of the given list, in order, to elems, which must
+ * have room for list_size(list) elements.  Returns the number copied.
+ */
+int list_to_array(list_t *list, void **elems);
+
+/*
+ * Moves all the elements of other to the end of list, and leaves other
+ * empty.  The nodes themselves are moved, which takes constant time,
+ * unless the lists use different shared pools (see list_usepool()).
+ * Then the elements are moved one by one, and 0 is returned if that
+ * runs out of memory, with only some of them moved.  Returns 1 on
+ * success.
+ */
+int list_splice(list_t *list, list_t *other);
+
 /*
  * Removes and returns the first element of the given list.
  */
@@ -67,15 +99,48 @@ int list_contains(list_t *list, void *elem);
 void list_sort(list_t *list);
 
 /*
- * The type of list iterators.
+ * Sorts the given list like list_sort, using up to nthreads threads.
+ * The result is the same, with equal elements in the same order.  Lists
+ * that are too short to gain from more threads are sorted with fewer,
+ * or by the calling thread alone, and so is a list for which there is
+ * no memory to sort in parallel.  The comparison function is called
+ * from several threads at once.
+ */
+void list_parallelsort(list_t *list, int nthreads);
+
+/*
+ * Sorts a list of strings into the order of strcmp(), or of strcasecmp()
+ * if nocase is set, with a radix sort (see strsort.h) instead of the
+ * comparison function of the list.  Strings that compare equal keep
+ * their order, so a list created with the same order ends up as with
+ * list_sort.
  */
-typedef struct list_iter list_iter_t;
+void list_sortstrings(list_t *list, int nocase);
+
+/*
+ * The type of list iterators.  The fields are private to the list
+ * implementation; they are only public so that an iterator can be
+ * declared on the stack, or inside another struct, and set up with
+ * list_iter_init().
+ */
+typedef struct list_iter {
+    void *node;
+    void *pos;
+    void *end;
+} list_iter_t;
 
 /*
  * Creates a new list iterator for iterating over the given list.
  */
 list_iter_t *list_createiter(list_t *list);
 
+/*
+ * Sets up the given iterator for iterating over the given list, and
+ * returns it.  This allocates nothing, and the iterator is not passed
+ * to list_destroyiter().
+ */
+list_iter_t *list_iter_init(list_iter_t *iter, list_t *list);
+
 /*
  * Destroys the given list iterator.
  */
@@ -93,4 +158,26 @@ int list_hasnext(list_iter_t *iter);
  */
 void *list_next(list_iter_t *iter);
 
+/*
+ * Copies up to max of the next elements of the given list iterator to
+ * buf, in order, and returns the number copied, which is 0 only at the
+ * end of the list.
+ */
+int list_next_batch(list_iter_t *iter, void **buf, int max);
+
+/*
+ * Runs the statement that follows once for each element of the given
+ * list, in order, with elem set to the element.  The iterator is on the
+ * stack, so nothing is allocated:
+ *
+ *     char *word;
+ *
+ *     LIST_FOREACH(word, words) {
+ *         ...
+ *     }
+ */
+#define LIST_FOREACH(elem, list) \
+    for (list_iter_t foreach_iter_, *foreach_ = list_iter_init(&foreach_iter_, (list)); \
+         list_hasnext(foreach_) && ((elem) = list_next(foreach_), 1); )
+
 #endif
@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "list.h"
+#include "bench.h"
+#include "workload.h"
+
+/*
+ * Benchmark harness for the list operations.
+ *
+ * For each input size n (doubling from the minimum to the maximum size)
+ * and each selected workload, n keys are generated by the workload
+ * generator (see workload.h), and every selected operation is run a
+ * number of warmup rounds followed by a number of measured trials.  One
+ * labeled row with timing statistics is written per operation, workload
+ * and size, in the same formats as the set benchmarks.
+ *
+ * The add operations add all n keys to an empty list, and the pop
+ * operations remove them all again.  fromarray builds the list from the
+ * array of keys in one call, toarray copies it back, and splice joins
+ * two lists of n keys.  nextbatch iterates like iterate,
+ * with list_next_batch().  contains looks up the keys of the
+ * second operand, and sort sorts a list of the n keys in workload order.
+ * parsort sorts the same list with list_parallelsort, using the number
+ * of threads given with -j, or one per online processor.  strsort
+ * sorts it with list_sortstrings, and only runs on string workloads.
+ */
+
+/* The name of the list implementation, set by the Makefile */
+#ifndef LIST_IMPL
+#define LIST_IMPL "linkedlist"
+#endif
+
+/* Maximum number of workloads in one run */
+#define MAX_WORKLOADS 16
+
+/* Number of elements per list_next_batch() call in nextbatch */
+#define BATCH 256
+
+/*
+ * The input of a benchmark round.  The keys are owned by the workload,
+ * so the lists never own their elements.
+ */
+typedef struct input {
+    workload_t *keys;
+    list_t *list;
+    int threads;
+} input_t;
+
+static list_t *build(input_t *in) {
+    list_t *list = list_create(in->keys->cmpfunc);
+    int i;
+
+    if (list == NULL)
+        fatal_error("out of memory");
+    for (i = 0; i < in->keys->na; i++) {
+        if (!list_addlast(list, in->keys->a[i]))
+            fatal_error("out of memory");
+    }
+    return list;
+}
+
+static void bench_addfirst(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_t *list = list_create(in->keys->cmpfunc);
+    int i;
+
+    if (list == NULL)
+        fatal_error("out of memory");
+    bench_start(probe);
+    for (i = 0; i < in->keys->na; i++)
+        list_addfirst(list, in->keys->a[i]);
+    bench_stop(probe);
+    list_destroy(list);
+}
+
+static void bench_addlast(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_t *list = list_create(in->keys->cmpfunc);
+    int i;
+
+    if (list == NULL)
+        fatal_error("out of memory");
+    bench_start(probe);
+    for (i = 0; i < in->keys->na; i++)
+        list_addlast(list, in->keys->a[i]);
+    bench_stop(probe);
+    list_destroy(list);
+}
+
+static void bench_fromarray(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_t *list;
+
+    bench_start(probe);
+    list = list_from_array(in->keys->cmpfunc, in->keys->a, in->keys->na);
+    bench_stop(probe);
+    if (list == NULL)
+        fatal_error("out of memory");
+    list_destroy(list);
+}
+
+static void bench_toarray(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    void **elems = malloc(sizeof(void *) * (in->keys->na + 1));
+
+    if (elems == NULL)
+        fatal_error("out of memory");
+    bench_start(probe);
+    bench_sink = list_to_array(in->list, elems);
+    bench_stop(probe);
+    free(elems);
+}
+
+static void bench_splice(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_t *list = build(in), *other = build(in);
+
+    bench_start(probe);
+    list_splice(list, other);
+    bench_stop(probe);
+    list_destroy(list);
+    list_destroy(other);
+}
+
+static void bench_popfirst(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_t *list = build(in);
+    long sum = 0;
+
+    bench_start(probe);
+    while (list_size(list) > 0)
+        sum += list_popfirst(list) != NULL;
+    bench_stop(probe);
+    list_destroy(list);
+    bench_sink = sum;
+}
+
+static void bench_poplast(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_t *list = build(in);
+    long sum = 0;
+
+    bench_start(probe);
+    while (list_size(list) > 0)
+        sum += list_poplast(list) != NULL;
+    bench_stop(probe);
+    list_destroy(list);
+    bench_sink = sum;
+}
+
+static void bench_iterate(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_iter_t *iter;
+    long sum = 0;
+
+    bench_start(probe);
+    iter = list_createiter(in->list);
+    while (list_hasnext(iter))
+        sum += list_next(iter) != NULL;
+    list_destroyiter(iter);
+    bench_stop(probe);
+    bench_sink = sum;
+}
+
+static void bench_nextbatch(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_iter_t iter;
+    void *batch[BATCH];
+    long sum = 0;
+    int i, n;
+
+    bench_start(probe);
+    list_iter_init(&iter, in->list);
+    while ((n = list_next_batch(&iter, batch, BATCH)) > 0) {
+        for (i = 0; i < n; i++)
+            sum += batch[i] != NULL;
+    }
+    bench_stop(probe);
+    bench_sink = sum;
+}
+
+static void bench_contains(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    long hits = 0;
+    int i;
+
+    bench_start(probe);
+    for (i = 0; i < in->keys->nb; i++)
+        hits += list_contains(in->list, in->keys->b[i]);
+    bench_stop(probe);
+    bench_sink = hits;
+}
+
+static void bench_sort(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_t *list = build(in);
+
+    bench_start(probe);
+    list_sort(list);
+    bench_stop(probe);
+    list_destroy(list);
+}
+
+static void bench_parsort(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_t *list = build(in);
+
+    bench_start(probe);
+    list_parallelsort(list, in->threads);
+    bench_stop(probe);
+    list_destroy(list);
+}
+
+static void bench_strsort(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    list_t *list = build(in);
+
+    bench_start(probe);
+    list_sortstrings(list, 0);
+    bench_stop(probe);
+    list_destroy(list);
+}
+
+/*
+ * strings is set for the operations that need string elements.
+ */
+typedef struct listop {
+    char *name;
+    bench_op_t func;
+    int strings;
+} listop_t;
+
+static listop_t listops[] = {
+    { "addfirst", bench_addfirst, 0 },
+    { "addlast", bench_addlast, 0 },
+    { "fromarray", bench_fromarray, 0 },
+    { "toarray", bench_toarray, 0 },
+    { "splice", bench_splice, 0 },
+    { "popfirst", bench_popfirst, 0 },
+    { "poplast", bench_poplast, 0 },
+    { "iterate", bench_iterate, 0 },
+    { "nextbatch", bench_nextbatch, 0 },
+    { "contains", bench_contains, 0 },
+    { "sort", bench_sort, 0 },
+    { "parsort", bench_parsort, 0 },
+    { "strsort", bench_strsort, 1 },
+};
+
+#define NUM_LISTOPS ((int) (sizeof(listops) / sizeof(listops[0])))
+
+static void usage(char *prog) {
+    fprintf(stderr,
+            "usage: %s [-o ops] [-i workloads] [-n min:max] [-t trials] [-w warmup]\n"
+            "          [-s seed] [-f csv|json] [-j threads] [-p]\n"
+            "  ops:   comma-separated list of addfirst, addlast, fromarray, toarray,\n"
+            "         splice, popfirst, poplast, iterate, nextbatch, contains, sort,\n"
+            "         parsort, strsort, or all (default all)\n"
+            "  workloads: comma-separated list of workloads\n"
+            "         (default random,sorted,reversed,nearly)\n"
+            "  -j:    number of threads for parsort (default one per processor)\n"
+            "  -p:    also report hardware counters per element\n"
+            "  workload specs:\n",
+            prog);
+    workload_list(stderr);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    int selected[NUM_LISTOPS] = { 0 };
+    int minsize = 16, maxsize = 8192;
+    int trials = 10, warmup = 2, format = BENCH_CSV;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    char defaults[] = "random,sorted,reversed,nearly";
+    char *specs[MAX_WORKLOADS];
+    int nspecs = -1;
+    unsigned long long seed = 1;
+    bench_report_t *report;
+    perfcount_t *counters = NULL;
+    int opt, n, i, w, any = 0;
+
+    if (threads < 1)
+        threads = 1;
+    while ((opt = getopt(argc, argv, "o:i:n:t:w:s:f:j:p")) != -1) {
+        switch (opt) {
+        case 'o':
+            if (!bench_selectops(optarg, &listops[0].name, sizeof(listop_t), NUM_LISTOPS,
+                                 selected))
+                usage(argv[0]);
+            any = 1;
+            break;
+        case 'i':
+            if ((nspecs = workload_select(optarg, specs, MAX_WORKLOADS)) < 1)
+                usage(argv[0]);
+            break;
+        case 'n':
+            if (sscanf(optarg, "%d:%d", &minsize, &maxsize) != 2)
+                minsize = maxsize = atoi(optarg);
+            break;
+        case 't':
+            trials = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'f':
+            if ((format = bench_format(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'p':
+            if (counters == NULL && (counters = perfcount_open()) == NULL)
+                fatal_error("out of memory");
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || minsize < 1 || maxsize < minsize || trials < 1 || warmup < 0
+        || threads < 1)
+        usage(argv[0]);
+    if (!any)
+        bench_selectops("all", &listops[0].name, sizeof(listop_t), NUM_LISTOPS, selected);
+    if (nspecs < 0)
+        nspecs = workload_select(defaults, specs, MAX_WORKLOADS);
+
+    if (counters != NULL) {
+        if (perfcount_num(counters) == 0)
+            fprintf(stderr, "%s: hardware counters are not available\n", argv[0]);
+        bench_usecounters(counters);
+    }
+
+    report = bench_report_create(stdout, format);
+    if (report == NULL)
+        fatal_error("out of memory");
+
+    for (n = minsize; n <= maxsize; n *= 2) {
+        for (w = 0; w < nspecs; w++) {
+            input_t in;
+
+            in.keys = workload_create(specs[w], n, seed);
+            if (in.keys == NULL)
+                fatal_error("out of memory");
+            in.list = build(&in);
+            in.threads = threads;
+
+            for (i = 0; i < NUM_LISTOPS; i++) {
+                bench_row_t row;
+
+                if (!selected[i])
+                    continue;
+                if (listops[i].strings && in.keys->cmpfunc != compare_strings)
+                    continue;
+                memset(&row, 0, sizeof(row));
+                row.suite = "list";
+                row.backend = LIST_IMPL;
+                row.op = listops[i].name;
+                row.input = specs[w];
+                row.n = n;
+                bench_measure(listops[i].func, &in, warmup, trials, &row);
+                bench_report_row(report, &row);
+            }
+
+            list_destroy(in.list);
+            workload_destroy(in.keys);
+        }
+
+        if (n > maxsize / 2)
+            break;
+    }
+
+    bench_report_destroy(report);
+    if (counters != NULL)
+        perfcount_close(counters);
+    return 0;
+}
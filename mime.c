@@ -0,0 +1,546 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+
+#include "mime.h"
+#include "list.h"
+
+/* Longest word that is emitted in one piece, as in tokenize_file() */
+#define MAX_WORD 100
+
+/* Maximum nesting of multiparts and attached messages */
+#define MAX_DEPTH 16
+
+/* Content transfer encodings */
+enum { ENC_PLAIN, ENC_QP, ENC_BASE64 };
+
+/* Ways of handling the body of an entity */
+enum { BODY_TEXT, BODY_HTML, BODY_SKIP, BODY_MULTIPART, BODY_MESSAGE };
+
+/*
+ * The headers of a MIME entity that matter to the parser.
+ */
+typedef struct entity {
+    int body;
+    int encoding;
+    char *boundary;
+} entity_t;
+
+typedef struct parser {
+    FILE *file;
+    wordfunc_t func;
+    void *arg;
+    int stopped;
+
+    /* Current input line, and whether it should be read again */
+    char *line;
+    size_t linecap;
+    ssize_t linelen;
+    int pushback;
+
+    /* Boundaries of the enclosing multiparts, innermost last */
+    char *boundaries[MAX_DEPTH];
+    int depth;
+    int nesting;
+
+    /* The word being scanned */
+    char word[MAX_WORD + 1];
+    int wordlen;
+
+    /* HTML markup state */
+    int intag;
+    int inentity;
+
+    /* Base64 decoder state */
+    unsigned int b64bits;
+    int b64count;
+} parser_t;
+
+/*
+ * Reads the next line of input into p->line.
+ * Returns 1 on success, and 0 at the end of the file or when the
+ * word callback has asked to stop.
+ */
+static int readline(parser_t *p)
+{
+    if (p->stopped)
+        return 0;
+    if (p->pushback) {
+        p->pushback = 0;
+        return 1;
+    }
+    p->linelen = getline(&p->line, &p->linecap, p->file);
+    return p->linelen >= 0;
+}
+
+/*
+ * Returns 1 if the given line contains nothing but a line terminator.
+ */
+static int isblankline(char *line)
+{
+    return line[0] == '\n' || (line[0] == '\r' && line[1] == '\n');
+}
+
+/*
+ * Returns 1 if the given line looks like the start of a header field,
+ * ie. a field name of printable characters followed by a colon.
+ */
+static int isheader(char *line)
+{
+    char *s = line;
+
+    while (*s > ' ' && *s < 127 && *s != ':')
+        s++;
+    return s > line && *s == ':';
+}
+
+/*
+ * Returns 1 if c may be part of a word.  This is the same character
+ * class as the one used by tokenize_file().
+ */
+static int iswordchar(int c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '\'' || c == '_';
+}
+
+/*
+ * Passes the word being scanned (if any) to the word callback.
+ */
+static void emitword(parser_t *p)
+{
+    if (p->wordlen == 0 || p->stopped)
+        return;
+    p->word[p->wordlen] = 0;
+    p->wordlen = 0;
+    if (!p->func(p->word, p->arg))
+        p->stopped = 1;
+}
+
+/*
+ * Feeds one character of decoded text to the word scanner.
+ */
+static void feedchar(parser_t *p, int c, int html)
+{
+    if (html) {
+        /* Skip tags and character references */
+        if (p->intag) {
+            if (c == '>')
+                p->intag = 0;
+            return;
+        }
+        if (p->inentity) {
+            if (c == ';') {
+                p->inentity = 0;
+                return;
+            }
+            if (iswordchar(c) || c == '#')
+                return;
+            p->inentity = 0;
+        }
+        if (c == '<' || c == '&') {
+            emitword(p);
+            if (c == '<')
+                p->intag = 1;
+            else
+                p->inentity = 1;
+            return;
+        }
+    }
+    if (iswordchar(c)) {
+        p->word[p->wordlen++] = c;
+        if (p->wordlen == MAX_WORD)
+            emitword(p);
+    }
+    else {
+        emitword(p);
+    }
+}
+
+static int hexvalue(int c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static int base64value(int c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+/*
+ * Feeds a line of unencoded text to the scanner.
+ */
+static void feedplain(parser_t *p, char *line, ssize_t len, int html)
+{
+    ssize_t i;
+
+    for (i = 0; i < len; i++)
+        feedchar(p, (unsigned char) line[i], html);
+}
+
+/*
+ * Decodes a line of quoted-printable text and feeds it to the scanner.
+ */
+static void feedqp(parser_t *p, char *line, ssize_t len, int html)
+{
+    ssize_t i;
+    int hi, lo;
+
+    for (i = 0; i < len; i++) {
+        if (line[i] != '=') {
+            feedchar(p, (unsigned char) line[i], html);
+            continue;
+        }
+        hi = i + 1 < len ? hexvalue(line[i+1]) : -1;
+        lo = i + 2 < len ? hexvalue(line[i+2]) : -1;
+        if (hi >= 0 && lo >= 0) {
+            feedchar(p, hi * 16 + lo, html);
+            i += 2;
+        }
+        else if (strspn(line + i + 1, " \t\r\n") == (size_t) (len - i - 1)) {
+            /* Soft line break; the word continues on the next line */
+            return;
+        }
+        else {
+            feedchar(p, '=', html);
+        }
+    }
+}
+
+/*
+ * Decodes a line of base64 and feeds it to the scanner.  The decoder
+ * state carries over between lines.
+ */
+static void feedbase64(parser_t *p, char *line, ssize_t len, int html)
+{
+    ssize_t i;
+    int v;
+
+    for (i = 0; i < len; i++) {
+        if (line[i] == '=') {
+            /* Padding; flush the bytes of the partial group */
+            if (p->b64count >= 2)
+                feedchar(p, (p->b64bits >> (p->b64count * 6 - 8)) & 0xff, html);
+            if (p->b64count == 3)
+                feedchar(p, (p->b64bits >> 2) & 0xff, html);
+            p->b64bits = 0;
+            p->b64count = 0;
+            continue;
+        }
+        v = base64value((unsigned char) line[i]);
+        if (v < 0)
+            continue;
+        p->b64bits = (p->b64bits << 6) | v;
+        if (++p->b64count == 4) {
+            feedchar(p, (p->b64bits >> 16) & 0xff, html);
+            feedchar(p, (p->b64bits >> 8) & 0xff, html);
+            feedchar(p, p->b64bits & 0xff, html);
+            p->b64bits = 0;
+            p->b64count = 0;
+        }
+    }
+}
+
+/*
+ * Returns the index of the enclosing boundary that the current line
+ * is a delimiter for, or -1 if it is not a delimiter line.  Sets
+ * *closing to 1 if the line is a close delimiter ("--boundary--").
+ */
+static int findboundary(parser_t *p, int *closing)
+{
+    char *rest;
+    size_t n;
+    int i;
+
+    if (p->depth == 0 || p->line[0] != '-' || p->line[1] != '-')
+        return -1;
+    for (i = p->depth - 1; i >= 0; i--) {
+        n = strlen(p->boundaries[i]);
+        if (strncmp(p->line + 2, p->boundaries[i], n) != 0)
+            continue;
+        rest = p->line + 2 + n;
+        *closing = rest[0] == '-' && rest[1] == '-';
+        if (*closing)
+            rest += 2;
+        if (rest[strspn(rest, " \t\r\n")] == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Returns a copy of the value of the given Content-Type parameter,
+ * or NULL if the parameter is not present.
+ */
+static char *findparam(char *value, char *name)
+{
+    size_t n = strlen(name);
+    char *s, *end, *copy;
+
+    for (s = strchr(value, ';'); s != NULL; s = strchr(s, ';')) {
+        s += 1 + strspn(s + 1, " \t\r\n");
+        if (strncasecmp(s, name, n) != 0 || s[n] != '=')
+            continue;
+        s += n + 1;
+        if (*s == '"') {
+            s++;
+            end = strchr(s, '"');
+            if (end == NULL)
+                end = s + strlen(s);
+        }
+        else {
+            end = s + strcspn(s, "; \t\r\n");
+        }
+        copy = strndup(s, end - s);
+        if (copy == NULL)
+            fatal_error("out of memory");
+        return copy;
+    }
+    return NULL;
+}
+
+/*
+ * Interprets the value of a Content-Type header field.
+ */
+static void parsetype(entity_t *e, char *value)
+{
+    value += strspn(value, " \t\r\n");
+    if (strncasecmp(value, "multipart/", 10) == 0) {
+        free(e->boundary);
+        e->boundary = findparam(value, "boundary");
+        /* Without a boundary the parts can't be told apart */
+        e->body = e->boundary != NULL ? BODY_MULTIPART : BODY_TEXT;
+    }
+    else if (strncasecmp(value, "message/rfc822", 14) == 0) {
+        e->body = BODY_MESSAGE;
+    }
+    else if (strncasecmp(value, "text/html", 9) == 0) {
+        e->body = BODY_HTML;
+    }
+    else if (strncasecmp(value, "text/", 5) == 0) {
+        e->body = BODY_TEXT;
+    }
+    else {
+        e->body = BODY_SKIP;
+    }
+}
+
+/*
+ * Interprets the value of a Content-Transfer-Encoding header field.
+ */
+static void parseencoding(entity_t *e, char *value)
+{
+    value += strspn(value, " \t\r\n");
+    if (strncasecmp(value, "quoted-printable", 16) == 0)
+        e->encoding = ENC_QP;
+    else if (strncasecmp(value, "base64", 6) == 0)
+        e->encoding = ENC_BASE64;
+    else
+        e->encoding = ENC_PLAIN;
+}
+
+/*
+ * Handles one complete (unfolded) header field.
+ */
+static void handlefield(parser_t *p, entity_t *e, char *field, size_t len)
+{
+    size_t i;
+
+    if (strncasecmp(field, "Content-Type:", 13) == 0) {
+        parsetype(e, field + 13);
+    }
+    else if (strncasecmp(field, "Content-Transfer-Encoding:", 26) == 0) {
+        parseencoding(e, field + 26);
+    }
+    else if (strncasecmp(field, "Content-", 8) != 0 &&
+             strncasecmp(field, "MIME-Version:", 13) != 0) {
+        /* Other fields (Subject, From, ...) are part of the text */
+        for (i = 0; i < len; i++)
+            feedchar(p, (unsigned char) field[i], 0);
+        emitword(p);
+    }
+}
+
+/*
+ * Parses the header block of an entity.  The headers are optional; if
+ * the first line is not a header field, the whole entity is treated as
+ * a plain text body.
+ */
+static void parseheaders(parser_t *p, entity_t *e)
+{
+    char *field = NULL;
+    size_t fieldlen = 0, fieldcap = 0;
+    int closing;
+
+    while (readline(p)) {
+        if (fieldlen > 0 && (p->line[0] == ' ' || p->line[0] == '\t')) {
+            /* Continuation of a folded field */
+        }
+        else {
+            if (fieldlen > 0) {
+                handlefield(p, e, field, fieldlen);
+                fieldlen = 0;
+            }
+            if (isblankline(p->line))
+                break;
+            if (!isheader(p->line) || findboundary(p, &closing) >= 0) {
+                /* No (more) headers; this line belongs to the body */
+                p->pushback = 1;
+                break;
+            }
+        }
+        if (fieldlen + p->linelen + 1 > fieldcap) {
+            fieldcap = 2 * (fieldlen + p->linelen + 1);
+            field = realloc(field, fieldcap);
+            if (field == NULL)
+                fatal_error("out of memory");
+        }
+        memcpy(field + fieldlen, p->line, p->linelen + 1);
+        fieldlen += p->linelen;
+    }
+    if (fieldlen > 0)
+        handlefield(p, e, field, fieldlen);
+    free(field);
+}
+
+/*
+ * Parses a leaf body up to the next delimiter line of an enclosing
+ * multipart.  Returns the index of the boundary that ended the body,
+ * or -1 at the end of the file.  The delimiter line is left unread.
+ */
+static int parsebody(parser_t *p, entity_t *e)
+{
+    int hit, closing, html = e->body == BODY_HTML;
+
+    p->intag = p->inentity = 0;
+    p->b64bits = p->b64count = 0;
+    hit = -1;
+    while (readline(p)) {
+        hit = findboundary(p, &closing);
+        if (hit >= 0) {
+            p->pushback = 1;
+            break;
+        }
+        if (e->body == BODY_SKIP)
+            continue;
+        if (e->encoding == ENC_QP)
+            feedqp(p, p->line, p->linelen, html);
+        else if (e->encoding == ENC_BASE64)
+            feedbase64(p, p->line, p->linelen, html);
+        else
+            feedplain(p, p->line, p->linelen, html);
+    }
+    emitword(p);
+    return hit;
+}
+
+static int parseentity(parser_t *p);
+
+/*
+ * Parses the parts of a multipart body.  Returns the index of the
+ * enclosing boundary that ended the multipart, or -1 at the end of
+ * the file.
+ */
+static int parsemultipart(parser_t *p, entity_t *e)
+{
+    entity_t skip = { BODY_SKIP, ENC_PLAIN, NULL };
+    int mine, hit, closing;
+
+    if (p->depth == MAX_DEPTH) {
+        e->body = BODY_TEXT;
+        return parsebody(p, e);
+    }
+    mine = p->depth;
+    p->boundaries[p->depth++] = e->boundary;
+
+    /* Skip the preamble, then parse parts up to the close delimiter */
+    hit = parsebody(p, &skip);
+    while (hit == mine) {
+        readline(p);
+        findboundary(p, &closing);
+        if (closing) {
+            /* Skip the epilogue */
+            p->depth = mine;
+            return parsebody(p, &skip);
+        }
+        hit = parseentity(p);
+    }
+    p->depth = mine;
+    return hit;
+}
+
+/*
+ * Parses one entity, ie. a header block followed by a body.  Returns
+ * the index of the enclosing boundary that ended the entity, or -1 at
+ * the end of the file.
+ */
+static int parseentity(parser_t *p)
+{
+    entity_t e = { BODY_TEXT, ENC_PLAIN, NULL };
+    int hit;
+
+    parseheaders(p, &e);
+    if (p->nesting == MAX_DEPTH && e.body >= BODY_MULTIPART)
+        e.body = BODY_TEXT;
+
+    p->nesting++;
+    if (e.body == BODY_MULTIPART)
+        hit = parsemultipart(p, &e);
+    else if (e.body == BODY_MESSAGE)
+        hit = parseentity(p);
+    else
+        hit = parsebody(p, &e);
+    p->nesting--;
+
+    free(e.boundary);
+    return hit;
+}
+
+int scan_mail(FILE *file, wordfunc_t func, void *arg)
+{
+    parser_t p;
+
+    memset(&p, 0, sizeof(p));
+    p.file = file;
+    p.func = func;
+    p.arg = arg;
+    parseentity(&p);
+    emitword(&p);
+    free(p.line);
+    return !p.stopped;
+}
+
+/*
+ * Word callback for tokenize_mail(); adds a copy of the word to the list.
+ */
+static int addword(char *word, void *list)
+{
+    char *copy = strdup(word);
+
+    if (copy == NULL)
+        fatal_error("out of memory");
+    list_addlast(list, copy);
+    return 1;
+}
+
+void tokenize_mail(FILE *file, list_t *list)
+{
+    scan_mail(file, addword, list);
+}
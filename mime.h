@@ -0,0 +1,40 @@
+#ifndef MIME_H
+#define MIME_H
+
+#include "common.h"
+
+/*
+ * Reads the given mail file, and parses it into words (tokens) like
+ * tokenize_file(), but with an understanding of the MIME structure of
+ * the mail.
+ *
+ * Header fields are tokenized as text, except for the MIME structural
+ * fields (Content-* and MIME-Version), which only steer the parsing.
+ * Multipart bodies are split at their boundaries and each part is
+ * handled according to its own headers: text parts are decoded from
+ * quoted-printable or base64 on the fly, HTML markup is skipped, and
+ * non-text parts (images, attachments, ...) are skipped entirely.
+ *
+ * A file without MIME headers is tokenized exactly as tokenize_file()
+ * would tokenize it.
+ */
+void tokenize_mail(FILE *file, struct list *list);
+
+/*
+ * The type of word callbacks used by scan_mail().  The word is only
+ * valid for the duration of the call.  Returns 1 to continue scanning,
+ * or 0 to stop.
+ */
+typedef int (*wordfunc_t)(char *word, void *arg);
+
+/*
+ * Parses the given mail file like tokenize_mail(), but passes each word
+ * to the given callback as soon as it is recognized instead of collecting
+ * the words in a list.  Reading stops as soon as the callback returns 0.
+ *
+ * Returns 1 if the whole mail was scanned, and 0 if the callback stopped
+ * the scan early.
+ */
+int scan_mail(FILE *file, wordfunc_t func, void *arg);
+
+#endif
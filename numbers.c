@@ -1,6 +1,7 @@
 /* Author: Steffen Viken Valvaag <steffenv@cs.uit.no> */
 #include "set.h"
 #include <stdlib.h>
+#include <unistd.h>
 
 static int compare_ints(void *a, void *b)
 {
@@ -23,12 +24,14 @@ static void *newint(int i)
 static void printset(char *prefix, set_t *set)
 {
     set_iter_t *it;
+    void *batch[64];
+    int i, n;
 
     printf("%s", prefix);
     it = set_createiter(set);
-    while (set_hasnext(it)) {
-	    int *p = set_next(it);
-	    printf(" %d", *p);
+    while ((n = set_next_batch(it, batch, 64)) > 0) {
+	    for (i = 0; i < n; i++)
+	        printf(" %d", *(int *) batch[i]);
     }
     printf("\n");
 
@@ -49,6 +52,17 @@ int main(int argc, char **argv)
     set_t *all, *evens, *odds, *nonprimes, *primes;
     int i, j, n = 50;
     int **numbers;
+    const set_ops_t *ops;
+    int opt;
+
+    /* -b <backend> selects the set backend */
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        if (opt != 'b' || (ops = set_findbackend(optarg)) == NULL) {
+            fprintf(stderr, "usage: %s [-b backend]\n", argv[0]);
+            return 1;
+        }
+        set_usebackend(ops);
+    }
 
     /* Allocate numbers from 0 to n */
     numbers = (int **) malloc(sizeof(int*) * (n+1));
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "perfcount.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+struct perfcount {
+    int num;
+    int fds[PERF_MAX_COUNTERS];
+    char *names[PERF_MAX_COUNTERS];
+};
+
+#ifdef __linux__
+
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct {
+    char *name;
+    unsigned int type;
+    unsigned long long config;
+} events[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "l1d_misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { "llc_misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "dtlb_misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+};
+
+#define NUM_EVENTS ((int) (sizeof(events) / sizeof(events[0])))
+
+/*
+ * Opens a disabled counter for the calling thread, or returns -1.
+ */
+static int open_event(int i) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+perfcount_t *perfcount_open(void) {
+    perfcount_t *pc = malloc(sizeof(perfcount_t));
+    int i, fd;
+
+    if (pc == NULL)
+        return NULL;
+
+    pc->num = 0;
+    for (i = 0; i < NUM_EVENTS && pc->num < PERF_MAX_COUNTERS; i++) {
+        fd = open_event(i);
+        if (fd < 0)
+            continue;
+        pc->fds[pc->num] = fd;
+        pc->names[pc->num] = events[i].name;
+        pc->num++;
+    }
+
+    return pc;
+}
+
+void perfcount_close(perfcount_t *pc) {
+    int i;
+
+    for (i = 0; i < pc->num; i++)
+        close(pc->fds[i]);
+    free(pc);
+}
+
+void perfcount_start(perfcount_t *pc) {
+    int i;
+
+    for (i = 0; i < pc->num; i++)
+        ioctl(pc->fds[i], PERF_EVENT_IOC_RESET, 0);
+    for (i = 0; i < pc->num; i++)
+        ioctl(pc->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+void perfcount_stop(perfcount_t *pc, unsigned long long *values) {
+    unsigned long long buf[3];
+    int i;
+
+    for (i = 0; i < pc->num; i++)
+        ioctl(pc->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    /* buf holds the value, the time enabled and the time running */
+    for (i = 0; i < pc->num; i++) {
+        if (read(pc->fds[i], buf, sizeof(buf)) != sizeof(buf))
+            values[i] = 0;
+        else if (buf[2] > 0 && buf[2] < buf[1])
+            values[i] = (unsigned long long) ((double) buf[0] * buf[1] / buf[2]);
+        else
+            values[i] = buf[0];
+    }
+}
+
+#else
+
+/* Hardware counters are only supported on Linux. */
+
+perfcount_t *perfcount_open(void) {
+    perfcount_t *pc = malloc(sizeof(perfcount_t));
+
+    if (pc != NULL)
+        pc->num = 0;
+    return pc;
+}
+
+void perfcount_close(perfcount_t *pc) {
+    free(pc);
+}
+
+void perfcount_start(perfcount_t *pc) {
+}
+
+void perfcount_stop(perfcount_t *pc, unsigned long long *values) {
+}
+
+#endif
+
+int perfcount_num(perfcount_t *pc) {
+    return pc->num;
+}
+
+char *perfcount_name(perfcount_t *pc, int i) {
+    return pc->names[i];
+}
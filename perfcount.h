@@ -0,0 +1,54 @@
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+/*
+ * The maximum number of hardware counters measured at once.
+ */
+#define PERF_MAX_COUNTERS 8
+
+/*
+ * The type of hardware performance counter sets.  A counter set holds
+ * the counters that could be opened on this machine: cycles,
+ * instructions, L1 data cache misses, last-level cache misses, branch
+ * misses and data TLB misses, for the calling thread in user mode.
+ *
+ * Counters are read with perf_event_open() on Linux.  Counters that the
+ * hardware, kernel or permissions don't provide are left out, so a set
+ * may be empty; it can still be started and stopped.
+ */
+struct perfcount;
+typedef struct perfcount perfcount_t;
+
+/*
+ * Opens the available counters.  Returns NULL only if out of memory.
+ */
+perfcount_t *perfcount_open(void);
+
+/*
+ * Closes the given counter set.
+ */
+void perfcount_close(perfcount_t *pc);
+
+/*
+ * Returns the number of available counters in the given set.
+ */
+int perfcount_num(perfcount_t *pc);
+
+/*
+ * Returns the name of the i'th available counter, eg. "cycles".
+ */
+char *perfcount_name(perfcount_t *pc, int i);
+
+/*
+ * Resets and starts all counters of the given set.
+ */
+void perfcount_start(perfcount_t *pc);
+
+/*
+ * Stops all counters of the given set, and stores the counts since
+ * perfcount_start() in values[0] to values[perfcount_num(pc)-1].
+ * Counts are scaled up if the kernel had to multiplex the counters.
+ */
+void perfcount_stop(perfcount_t *pc, unsigned long long *values);
+
+#endif
@@ -1,130 +1,502 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "set.h"
-#include "list.h"
-
-#define MAX_INT 20000
-
-/* Taken from lecture notes for lecture 2. */
-/* TODO: Rewrite */
-unsigned long long gettime()
-{
-    struct timeval tv;
-    if (gettimeofday(&tv, NULL) == -1)
-    {
-        fprintf(stderr, "Could not get time\n");
-        return -1;
-    }
+#include "bench.h"
+#include "workload.h"
+#include "instrument.h"
+#include "hist.h"
+
+/*
+ * Benchmark harness for the set operations.
+ *
+ * For each input size n (doubling from the minimum to the maximum size),
+ * the keys of two operand sets a and b are generated by a workload
+ * generator (see workload.h), and every
+ * selected operation is run a number of warmup rounds followed by a
+ * number of measured trials.  One labeled row with timing statistics is
+ * written per operation and size, as CSV or JSON.
+ *
+ * nextbatch iterates like iterate, with set_next_batch() instead of
+ * set_next().
+ *
+ * With -l, the latency of every add, contains, iteration step and batch,
+ * and of every whole union, intersection, difference and copy, is recorded
+ * in a histogram.  Its percentiles are added to the rows, and the full
+ * histograms are written to a separate CSV file.  Timing every call
+ * adds its own overhead to the elapsed times of those rows.
+ *
+ * With -c, the median times of each operation, and its comparison
+ * counts in instrumented builds, are fitted to a power law in n over
+ * the whole sweep.  The exponents are reported to stderr with their 95%
+ * confidence intervals, and operations that scale worse than expected
+ * of a set are flagged.
+ */
+
+/* Maximum number of backends in one run */
+#define MAX_BACKENDS 64
+
+/* Maximum number of sizes in one sweep */
+#define MAX_SIZES 32
+
+/*
+ * How far a fitted exponent may exceed the expected one before the
+ * operation is flagged.  This covers the log factors, which add about
+ * 0.1 to the exponent over the usual range of sizes.
+ */
+#define SLACK 0.25
 
-    unsigned long long micros = 1000000 * tv.tv_sec + tv.tv_usec;
+/* Number of elements per set_next_batch() call in nextbatch */
+#define BATCH 256
 
-    return micros;
+/*
+ * The operands of a benchmark round.  The keys are owned by the
+ * workload, so the sets never own their elements.
+ */
+typedef struct input {
+    const set_ops_t *ops;
+    workload_t *keys;
+    set_t *a;
+    set_t *b;
+    hist_t *latency;
+} input_t;
+
+static set_t *build(const set_ops_t *ops, cmpfunc_t cmpfunc, void **keys, int n) {
+    set_t *set = set_create_backend(ops, cmpfunc);
+    int i;
+
+    if (set == NULL)
+        fatal_error("out of memory");
+    for (i = 0; i < n; i++)
+        set_add(set, keys[i]);
+    return set;
 }
 
-/* Compares two integers. */
-int compare(void *a, void *b) {
-    return *((int *) (a)) - *((int *) (b));
+/*
+ * Records the latency of one call in nanoseconds, if latencies are
+ * recorded and this is not a warmup round.
+ */
+static void record(input_t *in, bench_probe_t *probe, unsigned long long ns) {
+    if (in->latency != NULL && !probe->warmup)
+        hist_record(in->latency, ns);
 }
 
-/* Generates a list of integers and adds them to a set. */
-set_t *generate(int n, int order) {
-    list_t *list = list_create(compare);
-    if (list == NULL)
-        return NULL;
+/*
+ * Destroys the result of a set operation, unless the backend returned
+ * one of the operands.
+ */
+static void release(input_t *in, set_t *result) {
+    if (result != NULL && result != in->a && result != in->b)
+        set_destroy(result);
+}
 
-    if (order == 1) {
-        for (int i = 0; i < n; i++) {
-            int *a = malloc(sizeof(int *));
-            *a = i;
-            list_addfirst(list, a);
+static void bench_add(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    set_t *set = set_create_backend(in->ops, in->keys->cmpfunc);
+    int i;
+
+    if (set == NULL)
+        fatal_error("out of memory");
+    bench_start(probe);
+    if (in->latency == NULL) {
+        for (i = 0; i < in->keys->na; i++)
+            set_add(set, in->keys->a[i]);
+    } else {
+        for (i = 0; i < in->keys->na; i++) {
+            unsigned long long start = bench_now();
+
+            set_add(set, in->keys->a[i]);
+            record(in, probe, bench_now() - start);
         }
-    } else if (order == 0) {
-        srand(gettime());
-        for (int i = 0; i < n; i++)
-        {
-            int *a = malloc(sizeof(int *));
-            *a = rand() % MAX_INT;
-            list_addfirst(list, a);
+    }
+    bench_stop(probe);
+    set_destroy(set);
+}
+
+static void bench_contains(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    long hits = 0;
+    int i;
+
+    bench_start(probe);
+    if (in->latency == NULL) {
+        for (i = 0; i < in->keys->nb; i++)
+            hits += set_contains(in->a, in->keys->b[i]);
+    } else {
+        for (i = 0; i < in->keys->nb; i++) {
+            unsigned long long start = bench_now();
+
+            hits += set_contains(in->a, in->keys->b[i]);
+            record(in, probe, bench_now() - start);
         }
+    }
+    bench_stop(probe);
+    bench_sink = hits;
+}
+
+static void bench_union(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    set_t *result;
+
+    bench_start(probe);
+    result = set_union(in->a, in->b);
+    bench_stop(probe);
+    record(in, probe, probe->elapsed);
+    release(in, result);
+}
+
+static void bench_intersection(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    set_t *result;
+
+    bench_start(probe);
+    result = set_intersection(in->a, in->b);
+    bench_stop(probe);
+    record(in, probe, probe->elapsed);
+    release(in, result);
+}
+
+static void bench_difference(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    set_t *result;
+
+    bench_start(probe);
+    result = set_difference(in->a, in->b);
+    bench_stop(probe);
+    record(in, probe, probe->elapsed);
+    release(in, result);
+}
+
+static void bench_copy(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    set_t *result;
+
+    bench_start(probe);
+    result = set_copy(in->a);
+    bench_stop(probe);
+    record(in, probe, probe->elapsed);
+    release(in, result);
+}
+
+static void bench_iterate(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    set_iter_t *iter;
+    long sum = 0;
+
+    bench_start(probe);
+    iter = set_createiter(in->a);
+    if (in->latency == NULL) {
+        while (set_hasnext(iter))
+            sum += set_next(iter) != NULL;
     } else {
-        for (int i = n; i > 0; i--) {
-            int *a = malloc(sizeof(int *));
-            *a = i;
-            list_addfirst(list, a);
+        while (set_hasnext(iter)) {
+            unsigned long long start = bench_now();
+
+            sum += set_next(iter) != NULL;
+            record(in, probe, bench_now() - start);
         }
     }
+    set_destroyiter(iter);
+    bench_stop(probe);
+    bench_sink = sum;
+}
 
-    set_t *set = set_create(compare);
+static void bench_nextbatch(void *arg, bench_probe_t *probe) {
+    input_t *in = arg;
+    set_iter_t *iter;
+    void *batch[BATCH];
+    long sum = 0;
+    int i, n;
 
-    list_iter_t *listIter = list_createiter(list);
-    if (listIter == NULL)
-        return NULL;
+    bench_start(probe);
+    iter = set_createiter(in->a);
+    for (;;) {
+        unsigned long long start = in->latency != NULL ? bench_now() : 0;
 
-    unsigned long long t1 = gettime();
-    while(list_hasnext(listIter)) {
-        set_add(set, list_next(listIter));
+        if ((n = set_next_batch(iter, batch, BATCH)) == 0)
+            break;
+        for (i = 0; i < n; i++)
+            sum += batch[i] != NULL;
+        if (in->latency != NULL)
+            record(in, probe, bench_now() - start);
     }
-    unsigned long long t2 = gettime();
-    fprintf(stdout, "%d %lld ", set_size(set), t2 - t1);
+    set_destroyiter(iter);
+    bench_stop(probe);
+    bench_sink = sum;
+}
 
-    list_destroyiter(listIter);
-    list_destroy(list);
+/*
+ * Each operation has the exponent of n expected in the running time of
+ * the whole benchmarked operation.  add builds a set of n elements and
+ * contains makes n lookups, each of which a set should do in O(log n),
+ * and the other operations should take O(n).
+ */
+typedef struct setop {
+    char *name;
+    bench_op_t func;
+    double expected;
+} setop_t;
 
-    return set;
+static setop_t setops[] = {
+    { "add", bench_add, 1 },
+    { "contains", bench_contains, 1 },
+    { "union", bench_union, 1 },
+    { "intersection", bench_intersection, 1 },
+    { "difference", bench_difference, 1 },
+    { "copy", bench_copy, 1 },
+    { "iterate", bench_iterate, 1 },
+    { "nextbatch", bench_nextbatch, 1 },
+};
+
+#define NUM_SETOPS ((int) (sizeof(setops) / sizeof(setops[0])))
+
+/*
+ * The measurements of one operation on one backend over the sweep.
+ */
+typedef struct series {
+    int points;
+    double n[MAX_SIZES];
+    double time[MAX_SIZES];
+    double cmps[MAX_SIZES];
+} series_t;
+
+static series_t series[MAX_BACKENDS][NUM_SETOPS];
+
+/*
+ * Returns the value of the named metric of the given row, or 0 if the
+ * row has no such metric.
+ */
+static double metric(bench_row_t *row, char *name) {
+    int i;
+
+    for (i = 0; i < row->nmetrics; i++) {
+        if (strcmp(row->names[i], name) == 0)
+            return row->values[i];
+    }
+    return 0;
 }
 
-/* Creates the union between two sets. */
-void test_union(set_t *a, set_t *b) {
-    unsigned long long t1 = gettime();
-    set_t *set = set_union(a, b);
-    unsigned long long t2 = gettime();
-    fprintf(stdout, "%lld", t2 - t1);
-    set_destroy(set);
+/*
+ * Prints a fitted exponent and its confidence interval, and returns 1
+ * if the exponent is certainly above the expected one.
+ */
+static int print_fit(char *what, double *n, double *y, int points, double expected) {
+    bench_fit_t fit;
+
+    if (!bench_fit(n, y, points, &fit))
+        return 0;
+    fprintf(stderr, "  %s n^%.2f [%.2f, %.2f]", what, fit.exponent, fit.low, fit.high);
+    return fit.low > expected + SLACK;
 }
 
-/* Intersection between two sets. */
-void test_intersection(set_t *a, set_t *b) {
-    unsigned long long t1 = gettime();
-    set_t *set = set_intersection(a, b);
-    unsigned long long t2 = gettime();
-    fprintf(stdout, " %lld", t2 - t1);
-    set_destroy(set);
+/*
+ * Reports the fitted exponents of every measured operation to stderr.
+ */
+static void report_fits(const set_ops_t **backends, int nbackends) {
+    series_t *s;
+    int i, k, exceeds;
+
+    fprintf(stderr, "complexity, fitted over n (95%% confidence):\n");
+    for (k = 0; k < nbackends; k++) {
+        for (i = 0; i < NUM_SETOPS; i++) {
+            s = &series[k][i];
+            if (s->points == 0)
+                continue;
+            fprintf(stderr, "%-12s %-13s", set_backendname(backends[k]), setops[i].name);
+            exceeds = print_fit("time", s->n, s->time, s->points, setops[i].expected);
+            if (s->cmps[0] > 0)
+                exceeds |= print_fit("cmps", s->n, s->cmps, s->points, setops[i].expected);
+            fprintf(stderr, "  expected n^%g%s\n", setops[i].expected,
+                    exceeds ? "  EXCEEDS" : "");
+        }
+    }
 }
 
-/* Difference between two sets */
-void test_difference(set_t *a, set_t *b) {
-    unsigned long long t1 = gettime();
-    set_t *set = set_difference(a, b);
-    unsigned long long t2 = gettime();
-    fprintf(stdout, " %lld\n", t2 - t1);
-    set_destroy(set);
+static void usage(char *prog) {
+    fprintf(stderr,
+            "usage: %s [-b backends] [-o ops] [-i workload] [-n min:max] [-t trials]\n"
+            "          [-w warmup] [-s seed] [-f csv|json] [-p] [-c]\n"
+            "          [-l latencyfile]\n"
+            "  backends: comma-separated list of set backends, or all (default array)\n"
+            "  ops:   comma-separated list of add, contains, union, intersection,\n"
+            "         difference, copy, iterate, nextbatch, or all (default all)\n"
+            "  -p:    also report hardware counters per element\n"
+            "  -c:    fit the times to a power law in n and report the exponents\n"
+            "  -l:    also report latency percentiles per call, and write the\n"
+            "         latency histograms to latencyfile\n"
+            "  workloads (default random):\n",
+            prog);
+    workload_list(stderr);
+    exit(1);
 }
 
 int main(int argc, char **argv) {
-    set_t *a, *b;
+    int selected[NUM_SETOPS] = { 0 };
+    int minsize = 16, maxsize = 8192;
+    int trials = 10, warmup = 2, format = BENCH_CSV;
+    char *spec = "random";
+    unsigned long long seed = 1;
+    const set_ops_t *backends[MAX_BACKENDS];
+    int nbackends = 0;
+    bench_report_t *report;
+    perfcount_t *counters = NULL;
+    FILE *latencyfile = NULL;
+    hist_t *latency = NULL;
+    char label[256];
+    int opt, n, i, k, any = 0, exported = 0, fit = 0;
+
+    while ((opt = getopt(argc, argv, "b:o:i:n:t:w:s:f:pcl:")) != -1) {
+        switch (opt) {
+        case 'b':
+            if ((nbackends = set_selectbackends(optarg, backends, nbackends, MAX_BACKENDS)) < 0)
+                usage(argv[0]);
+            break;
+        case 'o':
+            if (!bench_selectops(optarg, &setops[0].name, sizeof(setop_t), NUM_SETOPS,
+                                 selected))
+                usage(argv[0]);
+            any = 1;
+            break;
+        case 'i':
+            if (!workload_valid(optarg))
+                usage(argv[0]);
+            spec = optarg;
+            break;
+        case 'n':
+            if (sscanf(optarg, "%d:%d", &minsize, &maxsize) != 2)
+                minsize = maxsize = atoi(optarg);
+            break;
+        case 't':
+            trials = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'f':
+            if ((format = bench_format(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        case 'p':
+            if (counters == NULL && (counters = perfcount_open()) == NULL)
+                fatal_error("out of memory");
+            break;
+        case 'c':
+            fit = 1;
+            break;
+        case 'l':
+            if (latencyfile != NULL)
+                fclose(latencyfile);
+            latencyfile = fopen(optarg, "w");
+            if (latencyfile == NULL) {
+                perror(optarg);
+                exit(1);
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || minsize < 1 || maxsize < minsize || trials < 1 || warmup < 0)
+        usage(argv[0]);
+    if (!any)
+        bench_selectops("all", &setops[0].name, sizeof(setop_t), NUM_SETOPS, selected);
+    if (nbackends == 0)
+        backends[nbackends++] = set_findbackend("array");
+
+    if (counters != NULL) {
+        if (perfcount_num(counters) == 0)
+            fprintf(stderr, "%s: hardware counters are not available\n", argv[0]);
+        bench_usecounters(counters);
+    }
 
-    /* Gets the order of the generated integer list. */
-    int order = atoi(argv[1]);
+    if (latencyfile != NULL && (latency = hist_create()) == NULL)
+        fatal_error("out of memory");
 
-    for (int j = 0; j < 10; j++) {
-        int n = 16;
-        for (int i = 0; i < 10; i++) {
-            a = generate(n, order);
-            b = generate(n, order);
+    report = bench_report_create(stdout, format);
+    if (report == NULL)
+        fatal_error("out of memory");
 
-            test_union(a, b);
-            test_intersection(a, b);
-            test_difference(a, b);
+    for (n = minsize; n <= maxsize; n *= 2) {
+        input_t in;
 
-            n *= 2;
+        in.latency = NULL;
+        in.keys = workload_create(spec, n, seed);
+        if (in.keys == NULL)
+            fatal_error("out of memory");
+
+        /* Every backend runs on the same keys */
+        for (k = 0; k < nbackends; k++) {
+            in.ops = backends[k];
+#ifdef INSTRUMENT
+            instr_reset();
+#endif
+            in.a = build(in.ops, in.keys->cmpfunc, in.keys->a, in.keys->na);
+            in.b = build(in.ops, in.keys->cmpfunc, in.keys->b, in.keys->nb);
+
+            for (i = 0; i < NUM_SETOPS; i++) {
+                bench_row_t row;
+
+                if (!selected[i])
+                    continue;
+                memset(&row, 0, sizeof(row));
+                row.suite = "set";
+                row.backend = set_backendname(in.ops);
+                row.op = setops[i].name;
+                row.input = spec;
+                row.n = n;
+                in.latency = latency;
+                bench_measure(setops[i].func, &in, warmup, trials, &row);
+                in.latency = NULL;
+                if (latency != NULL) {
+                    bench_metric(&row, "lat_p50_ns", hist_percentile(latency, 50));
+                    bench_metric(&row, "lat_p99_ns", hist_percentile(latency, 99));
+                    bench_metric(&row, "lat_p999_ns", hist_percentile(latency, 99.9));
+                    bench_metric(&row, "lat_max_ns", hist_max(latency));
+                    snprintf(label, sizeof(label), "%s/%s/%s/%d",
+                             row.backend, row.op, row.input, n);
+                    hist_export(latency, latencyfile, label, !exported++);
+                    hist_reset(latency);
+                }
+                if (fit) {
+                    series_t *s = &series[k][i];
+
+                    if (s->points == MAX_SIZES)
+                        fatal_error("too many sizes");
+                    s->n[s->points] = n;
+                    s->time[s->points] = row.stats.median;
+                    s->cmps[s->points] = metric(&row, "cmps_per_elem") * n;
+                    s->points++;
+                }
+                bench_report_row(report, &row);
+            }
+
+            set_destroy(in.a);
+            set_destroy(in.b);
+#ifdef INSTRUMENT
+            /* Per-call counts for this backend and size, including setup */
+            fprintf(stderr, "%s, n = %d:\n", set_backendname(in.ops), n);
+            instr_report(stderr);
+#endif
         }
-    }
+        workload_destroy(in.keys);
 
-    /* Cleanup */
-    set_destroy(a);
-    set_destroy(b);
+        if (n > maxsize / 2)
+            break;
+    }
 
+    bench_report_destroy(report);
+    if (fit)
+        report_fits(backends, nbackends);
+    if (latencyfile != NULL) {
+        hist_destroy(latency);
+        fclose(latencyfile);
+    }
+    if (counters != NULL)
+        perfcount_close(counters);
     return 0;
 }
@@ -0,0 +1,131 @@
+#include <stdlib.h>
+
+#include "pool.h"
+#include "instrument.h"
+
+/*
+ * The first slab holds SLAB_MIN objects, and each new slab twice as
+ * many as the last, up to SLAB_MAX, so small pools stay small.
+ */
+#define SLAB_MIN 16
+#define SLAB_MAX 4096
+
+typedef struct slab slab_t;
+
+struct slab {
+    slab_t *next;
+};
+
+struct pool {
+    size_t objsize;
+    int refs;
+    int slabsize;       /* objects in the next slab */
+    slab_t *slabs;      /* newest first */
+    slab_t *oldest;
+    char *bump;         /* the next unused object in the newest slab */
+    char *limit;        /* the end of the newest slab */
+    void *freed;        /* freed objects, linked through their first word */
+};
+
+/* Objects follow the slab header, aligned for any pointer or long */
+#define HEADER_SIZE ((sizeof(slab_t) + sizeof(long) - 1) / sizeof(long) * sizeof(long))
+
+pool_t *pool_create(size_t objsize) {
+    pool_t *pool = malloc(sizeof(pool_t));
+
+    if (pool == NULL)
+        return NULL;
+    if (objsize < sizeof(void *))
+        objsize = sizeof(void *);
+    pool->objsize = (objsize + sizeof(long) - 1) / sizeof(long) * sizeof(long);
+    pool->refs = 1;
+    pool->slabsize = SLAB_MIN;
+    pool->slabs = NULL;
+    pool->oldest = NULL;
+    pool->bump = NULL;
+    pool->limit = NULL;
+    pool->freed = NULL;
+    return pool;
+}
+
+size_t pool_objsize(pool_t *pool) {
+    return pool->objsize;
+}
+
+void pool_retain(pool_t *pool) {
+    pool->refs++;
+}
+
+void pool_release(pool_t *pool) {
+    slab_t *slab, *next;
+
+    if (--pool->refs > 0)
+        return;
+    for (slab = pool->slabs; slab != NULL; slab = next) {
+        next = slab->next;
+        free(slab);
+    }
+    free(pool);
+}
+
+int pool_shared(pool_t *pool) {
+    return pool->refs > 1;
+}
+
+/*
+ * Merging takes constant time: the slab lists are joined, and into
+ * takes over the freed objects or the unused rest of the newest slab of
+ * from only if it has none of its own.
+ */
+int pool_merge(pool_t *into, pool_t *from) {
+    if (from->refs > 1 || from->objsize != into->objsize)
+        return 0;
+
+    if (from->slabs != NULL) {
+        from->oldest->next = into->slabs;
+        if (into->slabs == NULL)
+            into->oldest = from->oldest;
+        into->slabs = from->slabs;
+    }
+    if (into->freed == NULL)
+        into->freed = from->freed;
+    if (into->bump == into->limit) {
+        into->bump = from->bump;
+        into->limit = from->limit;
+    }
+    free(from);
+    return 1;
+}
+
+void *pool_alloc(pool_t *pool) {
+    slab_t *slab;
+    void *obj;
+
+    if (pool->freed != NULL) {
+        obj = pool->freed;
+        pool->freed = *(void **) obj;
+        return obj;
+    }
+
+    if (pool->bump == pool->limit) {
+        slab = malloc(HEADER_SIZE + pool->objsize * pool->slabsize);
+        if (slab == NULL)
+            return NULL;
+        slab->next = pool->slabs;
+        if (pool->slabs == NULL)
+            pool->oldest = slab;
+        pool->slabs = slab;
+        pool->bump = (char *) slab + HEADER_SIZE;
+        pool->limit = pool->bump + pool->objsize * pool->slabsize;
+        if (pool->slabsize < SLAB_MAX)
+            pool->slabsize *= 2;
+    }
+    obj = pool->bump;
+    pool->bump += pool->objsize;
+    return obj;
+}
+
+void pool_free(pool_t *pool, void *obj) {
+    *(void **) obj = pool->freed;
+    pool->freed = obj;
+}
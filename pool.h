@@ -0,0 +1,71 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/*
+ * Pools of fixed-size objects, such as list and set nodes.
+ *
+ * A pool carves objects out of large slabs: allocating is a pointer
+ * bump, or a pop from the list of freed objects, and objects allocated
+ * one after another are adjacent in memory.  Freed objects are only
+ * reused by the pool; its slabs are returned to the system all at once
+ * when the last reference to the pool is released.
+ *
+ * By default every list and set has a pool of its own, and destroying
+ * it releases the whole pool without visiting the nodes.  A pool
+ * selected with list_usepool() or set_usepool() is instead shared by
+ * all lists or sets created afterwards; each of them holds a reference,
+ * and returns its nodes to the pool when destroyed.  Pools are not
+ * thread-safe.
+ */
+struct pool;
+typedef struct pool pool_t;
+
+/*
+ * Creates a pool of objects of the given size, with one reference held
+ * by the caller.  Returns NULL if out of memory.
+ */
+pool_t *pool_create(size_t objsize);
+
+/*
+ * Returns the size of the objects of the given pool.
+ */
+size_t pool_objsize(pool_t *pool);
+
+/*
+ * Adds a reference to the given pool.
+ */
+void pool_retain(pool_t *pool);
+
+/*
+ * Drops a reference to the given pool, and frees the pool with all its
+ * objects when it was the last one.
+ */
+void pool_release(pool_t *pool);
+
+/*
+ * Returns 1 if more than one reference to the given pool is held, so
+ * that objects must be freed one by one, or 0 otherwise.
+ */
+int pool_shared(pool_t *pool);
+
+/*
+ * Moves the slabs of from into into, and frees from, which must hold
+ * the only reference to it.  Objects allocated from from can then be
+ * freed to into, and are released with it.  Returns 0, and leaves both
+ * pools alone, if from is shared or its objects differ in size.
+ */
+int pool_merge(pool_t *into, pool_t *from);
+
+/*
+ * Returns a new object, or NULL if out of memory.
+ */
+void *pool_alloc(pool_t *pool);
+
+/*
+ * Returns the given object to the pool it was allocated from.
+ */
+void pool_free(pool_t *pool, void *obj);
+
+#endif
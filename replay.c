@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "set.h"
+#include "set_record.h"
+#include "bench.h"
+
+/*
+ * Replays a trace of set operations recorded with set_record_start()
+ * (eg. by spamfilter -R) against one or more set backends.
+ *
+ * Each backend first replays the trace once while checking every
+ * recorded size and result, so that a backend that behaves differently
+ * from the recorded one is reported.  Then the trace is replayed a
+ * number of warmup rounds and measured trials without checks, and one
+ * row with timing statistics is written per backend, as CSV or JSON.
+ */
+
+/* Maximum number of backends in one run */
+#define MAX_BACKENDS 64
+
+/* Maximum number of operands of a record */
+#define MAX_ARGS 6
+
+static char *op_names[REC_NUM_OPS] = {
+    "key", "create", "destroy", "size", "add", "contains", "union",
+    "intersection", "difference", "copy", "createiter", "destroyiter",
+    "hasnext", "next"
+};
+
+static int op_args[REC_NUM_OPS] = { 0, 1, 1, 2, 2, 3, 6, 6, 6, 3, 2, 1, 2, 2 };
+
+typedef struct call {
+    int op;
+    unsigned long args[MAX_ARGS];
+} call_t;
+
+/*
+ * A loaded trace, and the backend it is replayed against.
+ */
+typedef struct replay {
+    cmpfunc_t cmpfunc;
+    call_t *calls;
+    long ncalls;
+    char **keys;
+    long nkeys;
+    unsigned long nsets;
+    unsigned long niters;
+    long counts[REC_NUM_OPS];
+    const set_ops_t *ops;
+} replay_t;
+
+static int compare_nocase(void *a, void *b) {
+    return strcasecmp(a, b);
+}
+
+/*
+ * Reads a varint at *pos, and advances *pos past it.
+ */
+static unsigned long getvarint(unsigned char *buf, long size, long *pos) {
+    unsigned long value = 0;
+    int shift = 0;
+
+    do {
+        if (*pos >= size || shift > 56)
+            fatal_error("truncated trace");
+        value |= (unsigned long) (buf[*pos] & 0x7f) << shift;
+        shift += 7;
+    } while (buf[(*pos)++] & 0x80);
+    return value;
+}
+
+/*
+ * Grows the given array, if needed, to hold at least n elements of the
+ * given size, doubling its capacity.
+ */
+static void *reserve(void *array, long n, long *capacity, size_t size) {
+    if (n <= *capacity)
+        return array;
+    *capacity = *capacity > 0 ? 2 * *capacity : 1024;
+    if (*capacity < n)
+        *capacity = n;
+    array = realloc(array, size * *capacity);
+    if (array == NULL)
+        fatal_error("out of memory");
+    return array;
+}
+
+static void load(replay_t *r, char *filename) {
+    FILE *f = fopen(filename, "rb");
+    long size, pos, callcap = 0, keycap = 0, len;
+    char cmpname[64];
+    unsigned char *buf;
+    call_t *call;
+    int i, op;
+
+    if (f == NULL) {
+        perror(filename);
+        fatal_error("fopen() failed");
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    buf = malloc(size > 0 ? size : 1);
+    if (buf == NULL)
+        fatal_error("out of memory");
+    if ((long) fread(buf, 1, size, f) != size)
+        fatal_error("fread() failed");
+    fclose(f);
+
+    /* The header line names the comparison function */
+    for (pos = 0; pos < size && buf[pos] != '\n'; pos++)
+        ;
+    if (pos == size || sscanf((char *) buf, REC_MAGIC " %63s", cmpname) != 1)
+        fatal_error("not a set trace");
+    pos++;
+    if (strcmp(cmpname, "strcmp") == 0)
+        r->cmpfunc = compare_strings;
+    else if (strcmp(cmpname, "strcasecmp") == 0)
+        r->cmpfunc = compare_nocase;
+    else
+        fatal_error("unknown comparison function in trace");
+
+    memset(r->counts, 0, sizeof(r->counts));
+    r->calls = NULL;
+    r->keys = NULL;
+    r->ncalls = r->nkeys = 0;
+    r->nsets = r->niters = 0;
+    while (pos < size) {
+        op = buf[pos++];
+        if (op >= REC_NUM_OPS)
+            fatal_error("bad record in trace");
+        r->counts[op]++;
+
+        if (op == REC_KEY) {
+            len = getvarint(buf, size, &pos);
+            if (len > size - pos)
+                fatal_error("truncated trace");
+            r->keys = reserve(r->keys, r->nkeys + 1, &keycap, sizeof(char *));
+            r->keys[r->nkeys] = malloc(len + 1);
+            if (r->keys[r->nkeys] == NULL)
+                fatal_error("out of memory");
+            memcpy(r->keys[r->nkeys], buf + pos, len);
+            r->keys[r->nkeys++][len] = 0;
+            pos += len;
+            continue;
+        }
+
+        r->calls = reserve(r->calls, r->ncalls + 1, &callcap, sizeof(call_t));
+        call = &r->calls[r->ncalls++];
+        call->op = op;
+        for (i = 0; i < op_args[op]; i++)
+            call->args[i] = getvarint(buf, size, &pos);
+
+        /* Check the references, and size the set and iterator tables */
+        switch (op) {
+        case REC_ADD:
+        case REC_CONTAINS:
+            if (call->args[1] >= (unsigned long) r->nkeys)
+                fatal_error("bad key in trace");
+            break;
+        case REC_NEXT:
+            if (call->args[1] >= (unsigned long) r->nkeys)
+                fatal_error("bad key in trace");
+            break;
+        case REC_CREATE:
+            if (call->args[0] >= r->nsets)
+                r->nsets = call->args[0] + 1;
+            break;
+        case REC_UNION:
+        case REC_INTERSECTION:
+        case REC_DIFFERENCE:
+            if (call->args[4] >= r->nsets)
+                r->nsets = call->args[4] + 1;
+            break;
+        case REC_COPY:
+            if (call->args[1] >= r->nsets)
+                r->nsets = call->args[1] + 1;
+            break;
+        case REC_CREATEITER:
+            if (call->args[1] >= r->niters)
+                r->niters = call->args[1] + 1;
+            break;
+        }
+    }
+    free(buf);
+}
+
+/*
+ * Returns the set with the given number, which must exist.
+ */
+static set_t *getset(set_t **sets, replay_t *r, unsigned long id) {
+    if (id >= r->nsets || sets[id] == NULL)
+        fatal_error("trace uses a set that does not exist");
+    return sets[id];
+}
+
+static set_iter_t *getiter(set_iter_t **iters, replay_t *r, unsigned long id) {
+    if (id >= r->niters || iters[id] == NULL)
+        fatal_error("trace uses an iterator that does not exist");
+    return iters[id];
+}
+
+/*
+ * Replays the trace, and returns the number of calls whose result
+ * differs from the recorded one if check is set.  The time of the calls
+ * is measured with the given probe, unless it is NULL.
+ */
+static long run(replay_t *r, int check, bench_probe_t *probe) {
+    set_t **sets = calloc(r->nsets + 1, sizeof(set_t *));
+    set_iter_t **iters = calloc(r->niters + 1, sizeof(set_iter_t *));
+    unsigned long *a, i, n;
+    long c, mismatches = 0;
+    set_t *result, *old;
+    void *elem;
+    int shared;
+
+    if (sets == NULL || iters == NULL)
+        fatal_error("out of memory");
+
+    if (probe != NULL)
+        bench_start(probe);
+    for (c = 0; c < r->ncalls; c++) {
+        a = r->calls[c].args;
+        result = NULL;
+
+        switch (r->calls[c].op) {
+        case REC_CREATE:
+            sets[a[0]] = set_create_backend(r->ops, r->cmpfunc);
+            if (sets[a[0]] == NULL)
+                fatal_error("out of memory");
+            break;
+        case REC_DESTROY:
+            set_destroy(getset(sets, r, a[0]));
+            sets[a[0]] = NULL;
+            break;
+        case REC_SIZE:
+            n = set_size(getset(sets, r, a[0]));
+            mismatches += check && n != a[1];
+            break;
+        case REC_ADD:
+            set_add(getset(sets, r, a[0]), r->keys[a[1]]);
+            break;
+        case REC_CONTAINS:
+            n = set_contains(getset(sets, r, a[0]), r->keys[a[1]]) != 0;
+            mismatches += check && n != a[2];
+            break;
+        case REC_UNION:
+            result = set_union(getset(sets, r, a[0]), getset(sets, r, a[1]));
+            break;
+        case REC_INTERSECTION:
+            result = set_intersection(getset(sets, r, a[0]), getset(sets, r, a[1]));
+            break;
+        case REC_DIFFERENCE:
+            result = set_difference(getset(sets, r, a[0]), getset(sets, r, a[1]));
+            break;
+        case REC_COPY:
+            result = set_copy(getset(sets, r, a[0]));
+            if (result == NULL)
+                fatal_error("out of memory");
+            sets[a[1]] = result;
+            mismatches += check && (unsigned long) set_size(result) != a[2];
+            result = NULL;
+            break;
+        case REC_CREATEITER:
+            iters[a[1]] = set_createiter(getset(sets, r, a[0]));
+            if (iters[a[1]] == NULL)
+                fatal_error("out of memory");
+            break;
+        case REC_DESTROYITER:
+            set_destroyiter(getiter(iters, r, a[0]));
+            iters[a[0]] = NULL;
+            break;
+        case REC_HASNEXT:
+            n = set_hasnext(getiter(iters, r, a[0])) != 0;
+            mismatches += check && n != a[1];
+            break;
+        case REC_NEXT:
+            elem = set_next(getiter(iters, r, a[0]));
+            mismatches += check && (elem == NULL || r->cmpfunc(elem, r->keys[a[1]]) != 0);
+            break;
+        }
+
+        /*
+         * The result of a binary operation, logged under id a[4].  If
+         * the recording backend returned an operand, a[4] is that
+         * operand's id and still names a live set here.  If this
+         * backend returns an operand instead, the result must be copied
+         * to keep the ids apart.  Neither fix-up is part of the trace,
+         * so neither is measured.
+         */
+        if (result != NULL && result != sets[a[4]]) {
+            old = sets[a[4]];
+            shared = result == sets[a[0]] || result == sets[a[1]];
+            if (probe != NULL && (shared || old != NULL))
+                bench_pause(probe);
+            if (shared) {
+                result = set_copy(result);
+                if (result == NULL)
+                    fatal_error("out of memory");
+            }
+            if (old != NULL && (a[0] == a[4] || old != sets[a[0]]) &&
+                (a[1] == a[4] || old != sets[a[1]]))
+                set_destroy(old);
+            if (probe != NULL && (shared || old != NULL))
+                bench_resume(probe);
+            sets[a[4]] = result;
+        }
+        if (result != NULL)
+            mismatches += check && (unsigned long) set_size(result) != a[5];
+    }
+    if (probe != NULL)
+        bench_stop(probe);
+
+    for (i = 0; i < r->niters; i++) {
+        if (iters[i] != NULL)
+            set_destroyiter(iters[i]);
+    }
+    for (i = 0; i < r->nsets; i++) {
+        if (sets[i] != NULL)
+            set_destroy(sets[i]);
+    }
+    free(sets);
+    free(iters);
+    return mismatches;
+}
+
+static void replay_op(void *arg, bench_probe_t *probe) {
+    run(arg, 0, probe);
+}
+
+static void usage(char *prog) {
+    fprintf(stderr,
+            "usage: %s [-b backends] [-t trials] [-w warmup] [-f csv|json] <trace>\n"
+            "  backends: comma-separated list of set backends, or all (default array)\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const set_ops_t *backends[MAX_BACKENDS];
+    int nbackends = 0, trials = 5, warmup = 1, format = BENCH_CSV;
+    int opt, i, k;
+    bench_report_t *report;
+    long mismatches;
+    replay_t r;
+
+    while ((opt = getopt(argc, argv, "b:t:w:f:")) != -1) {
+        switch (opt) {
+        case 'b':
+            if ((nbackends = set_selectbackends(optarg, backends, nbackends, MAX_BACKENDS)) < 0)
+                usage(argv[0]);
+            break;
+        case 't':
+            trials = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        case 'f':
+            if ((format = bench_format(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || trials < 1 || warmup < 0)
+        usage(argv[0]);
+    if (nbackends == 0)
+        backends[nbackends++] = set_findbackend("array");
+
+    load(&r, argv[optind]);
+    fprintf(stderr, "%s: %ld calls on %lu sets, %ld distinct keys\n",
+            argv[optind], r.ncalls, r.nsets, r.nkeys);
+    for (i = 1; i < REC_NUM_OPS; i++) {
+        if (r.counts[i] > 0)
+            fprintf(stderr, "  %-14s %ld\n", op_names[i], r.counts[i]);
+    }
+
+    report = bench_report_create(stdout, format);
+    if (report == NULL)
+        fatal_error("out of memory");
+
+    for (k = 0; k < nbackends; k++) {
+        bench_row_t row;
+
+        r.ops = backends[k];
+        mismatches = run(&r, 1, NULL);
+        if (mismatches > 0)
+            fprintf(stderr, "%s: %ld result(s) differ from the recording\n",
+                    set_backendname(r.ops), mismatches);
+
+        memset(&row, 0, sizeof(row));
+        row.suite = "replay";
+        row.backend = set_backendname(r.ops);
+        row.op = "trace";
+        row.input = argv[optind];
+        row.n = r.ncalls;
+        bench_measure(replay_op, &r, warmup, trials, &row);
+        bench_metric(&row, "mismatches", mismatches);
+        bench_report_row(report, &row);
+    }
+
+    bench_report_destroy(report);
+    for (i = 0; i < r.nkeys; i++)
+        free(r.keys[i]);
+    free(r.keys);
+    free(r.calls);
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "set_impl.h"
+#include "instrument.h"
+
+/*
+ * Both struct set and set_iter_t start with a pointer to the operations
+ * of their backend.
+ */
+#define OPS(x) (*(const set_ops_t **) (x))
+
+static const set_ops_t *backends[] = {
+    &arrayset_ops,
+    &listset_ops,
+    &simpleset_ops,
+    &pmaset_ops,
+    &skipset_ops,
+    NULL
+};
+
+static const set_ops_t *current = &arrayset_ops;
+static pool_t *nodepool;
+
+const set_ops_t *set_findbackend(char *name) {
+    int i;
+
+    for (i = 0; backends[i] != NULL; i++) {
+        if (strcmp(backends[i]->name, name) == 0)
+            return backends[i];
+    }
+    return NULL;
+}
+
+const set_ops_t *set_getbackend(int i) {
+    if (i < 0 || i >= (int) (sizeof(backends) / sizeof(backends[0])))
+        return NULL;
+    return backends[i];
+}
+
+char *set_backendname(const set_ops_t *ops) {
+    return ops->name;
+}
+
+int set_selectbackends(char *names, const set_ops_t **selected, int num, int max) {
+    char *name = names;
+    int len, all, found, i;
+
+    for (;;) {
+        len = strcspn(name, ",");
+        /* Empty names, as in "a,,b", are skipped */
+        if (len > 0) {
+            all = len == 3 && strncmp(name, "all", 3) == 0;
+            found = 0;
+            for (i = 0; backends[i] != NULL; i++) {
+                if (!all && (strncmp(backends[i]->name, name, len) != 0 ||
+                             backends[i]->name[len] != '\0'))
+                    continue;
+                if (num == max)
+                    return -1;
+                selected[num++] = backends[i];
+                found = 1;
+            }
+            if (!found)
+                return -1;
+        }
+        if (name[len] == '\0')
+            return num;
+        name += len + 1;
+    }
+}
+
+void set_usebackend(const set_ops_t *ops) {
+    current = ops;
+}
+
+const set_ops_t *set_currentbackend(void) {
+    return current;
+}
+
+void set_usepool(pool_t *pool) {
+    nodepool = pool;
+}
+
+pool_t *set_nodepool(void) {
+    return nodepool;
+}
+
+const set_ops_t *set_backend(set_t *set) {
+    return OPS(set);
+}
+
+set_t *set_create_backend(const set_ops_t *ops, cmpfunc_t cmpfunc) {
+    set_t *set;
+
+    INSTR_ENTER(INSTR_SET_CREATE);
+    set = ops->create(INSTR_WRAPCMP(cmpfunc));
+    INSTR_LEAVE(INSTR_SET_CREATE);
+    return set;
+}
+
+/*
+ * Checks that the operands of a binary set operation can be combined.
+ */
+static void check_operands(set_t *a, set_t *b) {
+    if (OPS(a) != OPS(b))
+        fatal_error("set operands use different backends");
+}
+
+set_t *set_create(cmpfunc_t cmpfunc) {
+    return set_create_backend(current, cmpfunc);
+}
+
+void set_destroy(set_t *set) {
+    INSTR_ENTER(INSTR_SET_DESTROY);
+    OPS(set)->destroy(set);
+    INSTR_LEAVE(INSTR_SET_DESTROY);
+}
+
+int set_size(set_t *set) {
+    int size;
+
+    INSTR_ENTER(INSTR_SET_SIZE);
+    size = OPS(set)->size(set);
+    INSTR_LEAVE(INSTR_SET_SIZE);
+    return size;
+}
+
+void set_add(set_t *set, void *elem) {
+    INSTR_ENTER(INSTR_SET_ADD);
+    OPS(set)->add(set, elem);
+    INSTR_LEAVE(INSTR_SET_ADD);
+}
+
+int set_contains(set_t *set, void *elem) {
+    int found;
+
+    INSTR_ENTER(INSTR_SET_CONTAINS);
+    found = OPS(set)->contains(set, elem);
+    INSTR_LEAVE(INSTR_SET_CONTAINS);
+    return found;
+}
+
+set_t *set_union(set_t *a, set_t *b) {
+    set_t *set;
+
+    check_operands(a, b);
+    INSTR_ENTER(INSTR_SET_UNION);
+    set = OPS(a)->setunion(a, b);
+    INSTR_LEAVE(INSTR_SET_UNION);
+    return set;
+}
+
+set_t *set_intersection(set_t *a, set_t *b) {
+    set_t *set;
+
+    check_operands(a, b);
+    INSTR_ENTER(INSTR_SET_INTERSECTION);
+    set = OPS(a)->intersection(a, b);
+    INSTR_LEAVE(INSTR_SET_INTERSECTION);
+    return set;
+}
+
+set_t *set_difference(set_t *a, set_t *b) {
+    set_t *set;
+
+    check_operands(a, b);
+    INSTR_ENTER(INSTR_SET_DIFFERENCE);
+    set = OPS(a)->difference(a, b);
+    INSTR_LEAVE(INSTR_SET_DIFFERENCE);
+    return set;
+}
+
+set_t *set_copy(set_t *set) {
+    set_t *copy;
+
+    INSTR_ENTER(INSTR_SET_COPY);
+    copy = OPS(set)->copy(set);
+    INSTR_LEAVE(INSTR_SET_COPY);
+    return copy;
+}
+
+set_iter_t *set_createiter(set_t *set) {
+    set_iter_t *iter;
+
+    INSTR_ENTER(INSTR_SET_CREATEITER);
+    iter = OPS(set)->createiter(set);
+    INSTR_LEAVE(INSTR_SET_CREATEITER);
+    return iter;
+}
+
+set_iter_t *set_iter_init(set_iter_t *iter, set_t *set) {
+    INSTR_ENTER(INSTR_SET_CREATEITER);
+    OPS(set)->iterinit(iter, set);
+    INSTR_LEAVE(INSTR_SET_CREATEITER);
+    return iter;
+}
+
+void set_destroyiter(set_iter_t *iter) {
+    INSTR_ENTER(INSTR_SET_DESTROYITER);
+    OPS(iter)->destroyiter(iter);
+    INSTR_LEAVE(INSTR_SET_DESTROYITER);
+}
+
+int set_hasnext(set_iter_t *iter) {
+    int hasnext;
+
+    INSTR_ENTER(INSTR_SET_HASNEXT);
+    hasnext = OPS(iter)->hasnext(iter);
+    INSTR_LEAVE(INSTR_SET_HASNEXT);
+    return hasnext;
+}
+
+void *set_next(set_iter_t *iter) {
+    void *elem;
+
+    INSTR_ENTER(INSTR_SET_NEXT);
+    elem = OPS(iter)->next(iter);
+    INSTR_LEAVE(INSTR_SET_NEXT);
+    return elem;
+}
+
+int set_next_batch(set_iter_t *iter, void **buf, int max) {
+    int n;
+
+    INSTR_ENTER(INSTR_SET_NEXTBATCH);
+    n = OPS(iter)->nextbatch(iter, buf, max);
+    INSTR_LEAVE(INSTR_SET_NEXTBATCH);
+    return n;
+}
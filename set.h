@@ -3,6 +3,7 @@
 #define SET_H
 
 #include "common.h"
+#include "pool.h"
 
 /*
  * The type of sets.
@@ -10,9 +11,79 @@
 struct set;
 typedef struct set set_t;
 
+/*
+ * The type of set backends.  Several implementations of sets are
+ * linked into every program; each set is created by one of them, and
+ * operations on the set are dispatched to that backend.  The operands
+ * of set_union(), set_intersection() and set_difference() must use
+ * the same backend.
+ *
+ * Sets are not thread-safe, except those of the "skiplist" backend:
+ * any number of threads may add to, search and iterate over such a set
+ * at once, and an iterator returns every element that was in the set
+ * when it was set up.  Only set_destroy() must run alone.
+ */
+struct set_ops;
+typedef struct set_ops set_ops_t;
+
+/*
+ * Returns the backend with the given name ("array", "list",
+ * "list_simple", "pma" or "skiplist"), or NULL if there is no such
+ * backend.
+ */
+const set_ops_t *set_findbackend(char *name);
+
+/*
+ * Returns the i'th available backend, or NULL if there are no more.
+ */
+const set_ops_t *set_getbackend(int i);
+
+/*
+ * Returns the name of the given backend.
+ */
+char *set_backendname(const set_ops_t *ops);
+
+/*
+ * Appends the backends named in the given comma-separated list, where
+ * "all" names every backend, to selected[num] and on.  Returns the new
+ * number of selected backends, or -1 if a name is unknown or more than
+ * max backends would be selected.
+ */
+int set_selectbackends(char *names, const set_ops_t **selected, int num, int max);
+
+/*
+ * Selects the backend used by subsequent calls to set_create().
+ * The default backend is "array".
+ */
+void set_usebackend(const set_ops_t *ops);
+
+/*
+ * Returns the backend used by set_create().
+ */
+const set_ops_t *set_currentbackend(void);
+
+/*
+ * Selects the node pool shared by sets created from now on by backends
+ * that allocate nodes (see pool.h), or gives each new set a pool of its
+ * own if pool is NULL, which is the default.  The pool's objects must
+ * be large enough for the nodes of every such backend.
+ */
+void set_usepool(pool_t *pool);
+
+/*
+ * Returns the backend of the given set.
+ */
+const set_ops_t *set_backend(set_t *set);
+
+/*
+ * Creates a new set using the given backend and the given comparison
+ * function to compare elements of the set.
+ */
+set_t *set_create_backend(const set_ops_t *ops, cmpfunc_t cmpfunc);
+
 /*
  * Creates a new set using the given comparison function
- * to compare elements of the set.
+ * to compare elements of the set, and the selected backend.
  */
 set_t *set_create(cmpfunc_t cmpfunc);
 
@@ -65,16 +136,28 @@ set_t *set_difference(set_t *a, set_t *b);
 set_t *set_copy(set_t *set);
 
 /*
- * The type of set iterators.
+ * The type of set iterators.  ops is the backend of the iterated set,
+ * which keeps its iteration state in state.  The struct is only public
+ * so that an iterator can be declared on the stack, or inside another
+ * struct, and set up with set_iter_init().
  */
-struct set_iter;
-typedef struct set_iter set_iter_t;
+typedef struct set_iter {
+    const set_ops_t *ops;
+    void *state[4];
+} set_iter_t;
 
 /*
  * Creates a new set iterator for iterating over the given set.
  */
 set_iter_t *set_createiter(set_t *set);
 
+/*
+ * Sets up the given iterator for iterating over the given set, and
+ * returns it.  This allocates nothing, and the iterator is not passed
+ * to set_destroyiter().
+ */
+set_iter_t *set_iter_init(set_iter_t *iter, set_t *set);
+
 /*
  * Destroys the given set iterator.
  */
@@ -92,4 +175,20 @@ int set_hasnext(set_iter_t *iter);
  */
 void *set_next(set_iter_t *iter);
 
+/*
+ * Copies up to max of the next elements of the given set iterator to
+ * buf, in order, and returns the number copied, which is 0 only at the
+ * end of the set.  Bulk consumers save a call per element, and get the
+ * elements in an array their loops can work on.
+ */
+int set_next_batch(set_iter_t *iter, void **buf, int max);
+
+/*
+ * Runs the statement that follows once for each element of the given
+ * set, with elem set to the element, like LIST_FOREACH in list.h.
+ */
+#define SET_FOREACH(elem, set) \
+    for (set_iter_t foreach_iter_, *foreach_ = set_iter_init(&foreach_iter_, (set)); \
+         set_hasnext(foreach_) && ((elem) = set_next(foreach_), 1); )
+
 #endif
@@ -1,27 +1,42 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
-#include "set.h"
+#include "set_impl.h"
+#include "instrument.h"
 
 #define MAX_ITEMS 16
 
 struct set {
+    const set_ops_t *ops;
     cmpfunc_t cmpfunc;
     void **items;
     int size;
     int max_size;
 };
 
+/* The iteration state: the position of the next element in items */
+typedef struct arrayiter {
+    set_t *set;
+    int index;
+} arrayiter_t;
+
+ITER_STATE_CHECK(arrayiter_t);
+
+#define STATE(iter) ITER_STATE(arrayiter_t, iter)
+
 /*
  * Creates a new set using the given comparison function
  * to compare elements of the set.
  */
-set_t *set_create(cmpfunc_t cmpfunc) {
+static set_t *arrayset_create(cmpfunc_t cmpfunc) {
     set_t *set = malloc(sizeof(set_t));
 
     if (set == NULL)
         return NULL;
 
+    set->ops = &arrayset_ops;
+
     set->items = calloc(MAX_ITEMS, sizeof(void *) * MAX_ITEMS);
     if (set->items == NULL) {
         free(set);
@@ -39,7 +54,7 @@ set_t *set_create(cmpfunc_t cmpfunc) {
  * Destroys the given set. Subsequently accessing the set
  * will lead to undefined behavior.
  */
-void set_destroy(set_t *set) {
+static void arrayset_destroy(set_t *set) {
     free(set->items);
     free(set);
 }
@@ -47,11 +62,11 @@ void set_destroy(set_t *set) {
 /*
  * Returns the size (cardinality) of the given set.
  */
-int set_size(set_t *set) {
+static int arrayset_size(set_t *set) {
     return set->size;
 }
 
-void set_resize(set_t *set) {
+static void arrayset_resize(set_t *set) {
     void **items_copy;
     int new_size;
 
@@ -68,10 +83,10 @@ void set_resize(set_t *set) {
 /*
  * Adds the given element to the given set.
  */
-void set_add(set_t *set, void *elem) {
+static void arrayset_add(set_t *set, void *elem) {
     // If necessary, double maximum set size.
     if (set->size >= set->max_size)
-        set_resize(set);
+        arrayset_resize(set);
 
     // Add item if set is empty.
     if (set->size == 0) {
@@ -101,7 +116,7 @@ void set_add(set_t *set, void *elem) {
  * Returns 1 if the given element is contained in
  * the given set, 0 otherwise.
  */
-int set_contains(set_t *set, void *elem) {
+static int arrayset_contains(set_t *set, void *elem) {
     for (int i = 0; i < set->size; i++) {
         if (set->cmpfunc(set->items[i], elem) == 0)
             return 1;
@@ -114,16 +129,11 @@ int set_contains(set_t *set, void *elem) {
  * set contains all elements that are contained in either
  * a or b.
  */
-set_t *set_union(set_t *a, set_t *b) {
-    set_t *set = set_create(a->cmpfunc);
+static set_t *arrayset_union(set_t *a, set_t *b) {
+    set_t *set = arrayset_create(a->cmpfunc);
     if (set == NULL)
         return NULL;
 
-    if (a->size == 0)
-        return b;
-    if (b->size == 0)
-        return a;
-
     int pos = 0;
     int a_pos = 0;
     int b_pos = 0;
@@ -131,7 +141,7 @@ set_t *set_union(set_t *a, set_t *b) {
     /* Add elements until one set is empty. */
     while (a_pos < a->size && b_pos < b->size) {
         if (set->size >= set->max_size)
-            set_resize(set);
+            arrayset_resize(set);
 
         if (set->cmpfunc(a->items[a_pos], b->items[b_pos]) > 0) {
             set->items[pos] = b->items[b_pos];
@@ -155,7 +165,7 @@ set_t *set_union(set_t *a, set_t *b) {
     /* Add remaining elements from non-empty set. */
     while (a_pos < a->size) {
         if (set->size >= set->max_size){
-            set_resize(set);
+            arrayset_resize(set);
         }
         set->items[pos] = a->items[a_pos];
         a_pos++;
@@ -164,7 +174,7 @@ set_t *set_union(set_t *a, set_t *b) {
     }
     while (b_pos < b->size) {
         if (set->size >= set->max_size) {
-            set_resize(set);
+            arrayset_resize(set);
         }
         set->items[pos] = b->items[b_pos];
         b_pos++;
@@ -180,17 +190,11 @@ set_t *set_union(set_t *a, set_t *b) {
  * returned set contains all elements that are contained
  * in both a and b.
  */
-set_t *set_intersection(set_t *a, set_t *b) {
-    set_t *set = set_create(a->cmpfunc);
+static set_t *arrayset_intersection(set_t *a, set_t *b) {
+    set_t *set = arrayset_create(a->cmpfunc);
     if (set == NULL)
         return NULL;
 
-    // If either set is empty, return the empty set.
-    if (a->size == 0)
-        return a;
-    if (b->size == 0)
-        return b;
-
     int pos, a_pos, b_pos;
     pos = 0;
     a_pos = 0;
@@ -202,7 +206,7 @@ set_t *set_intersection(set_t *a, set_t *b) {
             b_pos++;
         } else if (set->cmpfunc(a->items[a_pos], b->items[b_pos]) == 0) {
             if (set->size >= set->max_size)
-                set_resize(set);
+                arrayset_resize(set);
 
             set->items[pos] = a->items[a_pos];
             set->size++;
@@ -222,18 +226,12 @@ set_t *set_intersection(set_t *a, set_t *b) {
  * returned set contains all elements that are contained
  * in a and not in b.
  */
-set_t *set_difference(set_t *a, set_t *b) {
-    set_t *set = set_create(a->cmpfunc);
+static set_t *arrayset_difference(set_t *a, set_t *b) {
+    set_t *set = arrayset_create(a->cmpfunc);
 
     if (set == NULL)
         return NULL;
 
-    /* If a is empty, return an empty set. If b is empty, return a. */
-    if (a->size == 0)
-        return set;
-    if (b->size == 0)
-        return a;
-
     int pos, a_pos, b_pos;
     pos = 0;
     a_pos = 0;
@@ -248,7 +246,7 @@ set_t *set_difference(set_t *a, set_t *b) {
             b_pos++;
         } else {
             if (set->size >= set->max_size)
-                set_resize(set);
+                arrayset_resize(set);
 
             set->items[pos] = a->items[a_pos];
             set->size++;
@@ -260,7 +258,7 @@ set_t *set_difference(set_t *a, set_t *b) {
     /* Add remaining elements */
     while (a_pos < a->size) {
         if (set->size >= set->max_size){
-            set_resize(set);
+            arrayset_resize(set);
         }
         set->items[pos] = a->items[a_pos];
         a_pos++;
@@ -274,8 +272,8 @@ set_t *set_difference(set_t *a, set_t *b) {
 /*
  * Returns a copy of the given set.
  */
-set_t *set_copy(set_t *set) {
-    set_t *copy = set_create(set->cmpfunc);
+static set_t *arrayset_copy(set_t *set) {
+    set_t *copy = arrayset_create(set->cmpfunc);
 
     if (copy == NULL)
         return NULL;
@@ -283,8 +281,8 @@ set_t *set_copy(set_t *set) {
     int pos = 0;
 
     for (int i = 0; i < set->size; i++) {
-        if (set->size >= set->max_size)
-            set_resize(set);
+        if (copy->size >= copy->max_size)
+            arrayset_resize(copy);
 
         copy->items[pos] = set->items[i];
         copy->size++;
@@ -295,24 +293,24 @@ set_t *set_copy(set_t *set) {
 }
 
 /*
- * The type of set iterators.
+ * Sets up the given iterator for iterating over the given set.
  */
-struct set_iter {
-    set_t *set;
-    int index;
-};
+static void arrayset_iterinit(set_iter_t *iter, set_t *set) {
+    iter->ops = &arrayset_ops;
+    STATE(iter)->set = set;
+    STATE(iter)->index = 0;
+}
 
 /*
  * Creates a new set iterator for iterating over the given set.
  */
-set_iter_t *set_createiter(set_t *set) {
+static set_iter_t *arrayset_createiter(set_t *set) {
     set_iter_t *iter = malloc(sizeof(set_iter_t));
     if (iter == NULL) {
         return NULL;
     }
 
-    iter->set = set;
-    iter->index = 0;
+    arrayset_iterinit(iter, set);
 
     return iter;
 }
@@ -320,7 +318,7 @@ set_iter_t *set_createiter(set_t *set) {
 /*
  * Destroys the given set iterator.
  */
-void set_destroyiter(set_iter_t *iter) {
+static void arrayset_destroyiter(set_iter_t *iter) {
     free(iter);
 }
 
@@ -328,8 +326,8 @@ void set_destroyiter(set_iter_t *iter) {
  * Returns 0 if the given set iterator has reached the end of the
  * set, or 1 otherwise.
  */
-int set_hasnext(set_iter_t *iter) {
-    if (iter->index == iter->set->size) {
+static int arrayset_hasnext(set_iter_t *iter) {
+    if (STATE(iter)->index == STATE(iter)->set->size) {
         return 0;
     }
     return 1;
@@ -339,11 +337,47 @@ int set_hasnext(set_iter_t *iter) {
  * Returns the next element in the sequence represented by the given
  * set iterator.
  */
-void *set_next(set_iter_t *iter) {
-    if (iter->index >= iter->set->size)
+static void *arrayset_next(set_iter_t *iter) {
+    if (STATE(iter)->index >= STATE(iter)->set->size)
         return NULL;
 
-    void *elem = iter->set->items[iter->index];
-    iter->index++;
+    void *elem = STATE(iter)->set->items[STATE(iter)->index];
+    STATE(iter)->index++;
     return elem;
 }
+
+/*
+ * Copies up to max of the next elements of the given iterator to buf,
+ * straight from the items array.
+ */
+static int arrayset_nextbatch(set_iter_t *iter, void **buf, int max) {
+    int n = STATE(iter)->set->size - STATE(iter)->index;
+
+    if (n > max)
+        n = max;
+    if (n <= 0)
+        return 0;
+
+    memcpy(buf, STATE(iter)->set->items + STATE(iter)->index, n * sizeof(void *));
+    STATE(iter)->index += n;
+    return n;
+}
+
+const set_ops_t arrayset_ops = {
+    "array",
+    arrayset_create,
+    arrayset_destroy,
+    arrayset_size,
+    arrayset_add,
+    arrayset_contains,
+    arrayset_union,
+    arrayset_intersection,
+    arrayset_difference,
+    arrayset_copy,
+    arrayset_createiter,
+    arrayset_iterinit,
+    arrayset_destroyiter,
+    arrayset_hasnext,
+    arrayset_next,
+    arrayset_nextbatch,
+};
@@ -0,0 +1,66 @@
+#ifndef SET_IMPL_H
+#define SET_IMPL_H
+
+#include "set.h"
+
+/*
+ * The interface between set.c and the set backends.
+ *
+ * Each backend defines its own struct set, private to its source file,
+ * and provides a table of its operations.  The first member of struct
+ * set must be a pointer to that table, which is how set.c dispatches
+ * calls on a set to the right backend.  Iterators are dispatched the
+ * same way through their ops field, and a backend keeps its iteration
+ * state in a struct of its own, stored in the state field of set_iter_t
+ * and accessed with ITER_STATE().  iterinit sets up an iterator in
+ * place, and createiter may return a larger struct that starts with a
+ * set_iter_t.
+ */
+struct set_ops {
+    char *name;
+    set_t *(*create)(cmpfunc_t cmpfunc);
+    void (*destroy)(set_t *set);
+    int (*size)(set_t *set);
+    void (*add)(set_t *set, void *elem);
+    int (*contains)(set_t *set, void *elem);
+    set_t *(*setunion)(set_t *a, set_t *b);
+    set_t *(*intersection)(set_t *a, set_t *b);
+    set_t *(*difference)(set_t *a, set_t *b);
+    set_t *(*copy)(set_t *set);
+    set_iter_t *(*createiter)(set_t *set);
+    void (*iterinit)(set_iter_t *iter, set_t *set);
+    void (*destroyiter)(set_iter_t *iter);
+    int (*hasnext)(set_iter_t *iter);
+    void *(*next)(set_iter_t *iter);
+    int (*nextbatch)(set_iter_t *iter, void **buf, int max);
+};
+
+/*
+ * Checks at compile time that the given iteration state type fits in
+ * the state field of set_iter_t.
+ */
+#define ITER_STATE_CHECK(type) \
+    _Static_assert(sizeof(type) <= sizeof(((set_iter_t *) 0)->state), \
+                   #type " does not fit in set_iter_t")
+
+/*
+ * Returns the iteration state of the given iterator, as a pointer to
+ * the given type.
+ */
+#define ITER_STATE(type, iter) ((type *) (iter)->state)
+
+/*
+ * Returns the pool selected with set_usepool(), or NULL.
+ */
+pool_t *set_nodepool(void);
+
+/*
+ * The available backends.
+ */
+extern const set_ops_t arrayset_ops;        /* set_array.c */
+extern const set_ops_t listset_ops;         /* set_list.c */
+extern const set_ops_t simpleset_ops;       /* set_list_simple.c */
+extern const set_ops_t pmaset_ops;          /* set_pma.c */
+extern const set_ops_t skipset_ops;         /* set_skiplist.c */
+
+#endif
@@ -1,7 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-#include "set.h"
+#include "set_impl.h"
+#include "instrument.h"
 
 typedef struct node node_t;
 
@@ -11,21 +12,44 @@ struct node {
 };
 
 struct set {
+    const set_ops_t *ops;
     cmpfunc_t cmpfunc;
     node_t *head;
     int size;
+    pool_t *pool;
 };
 
+/* The iteration state: the node of the next element */
+typedef struct listiter {
+    node_t *node;
+} listiter_t;
+
+ITER_STATE_CHECK(listiter_t);
+
+#define STATE(iter) ITER_STATE(listiter_t, iter)
+
 /*
  * Creates a new set using the given comparison function
  * to compare elements of the set.
  */
-set_t *set_create(cmpfunc_t cmpfunc) {
+static set_t *listset_create(cmpfunc_t cmpfunc) {
     set_t *set = malloc(sizeof(set_t));
 
     if (set == NULL)
         return NULL;
 
+    set->ops = &listset_ops;
+
+    set->pool = set_nodepool();
+    if (set->pool != NULL) {
+        if (pool_objsize(set->pool) < sizeof(node_t))
+            fatal_error("pool objects are too small for set nodes");
+        pool_retain(set->pool);
+    } else if ((set->pool = pool_create(sizeof(node_t))) == NULL) {
+        free(set);
+        return NULL;
+    }
+
     set->cmpfunc = cmpfunc;
     set->head = NULL;
     set->size = 0;
@@ -37,33 +61,37 @@ set_t *set_create(cmpfunc_t cmpfunc) {
  * Destroys the given set.  Subsequently accessing the set
  * will lead to undefined behavior.
  */
-void set_destroy(set_t *set) {
+static void listset_destroy(set_t *set) {
     node_t *tmp;
     node_t *cur;
 
-    cur = set->head;
+    /* A private pool goes with all its nodes at once */
+    if (pool_shared(set->pool)) {
+        cur = set->head;
 
-    while(cur != NULL) {
-        tmp = cur;
-        cur = cur->next;
-        free(tmp);
+        while(cur != NULL) {
+            tmp = cur;
+            cur = cur->next;
+            pool_free(set->pool, tmp);
+        }
     }
 
+    pool_release(set->pool);
     free(set);
 }
 
 /*
  * Returns the size (cardinality) of the given set.
  */
-int set_size(set_t *set) {
+static int listset_size(set_t *set) {
     return set->size;
 }
 
 /*
  * Adds the given element to the given set.
  */
-void set_add(set_t *set, void *elem) {
-    node_t *new = malloc(sizeof(node_t));
+static void listset_add(set_t *set, void *elem) {
+    node_t *new = pool_alloc(set->pool);
 
     if (new == NULL) {
         return;
@@ -94,6 +122,7 @@ void set_add(set_t *set, void *elem) {
             return;
         }
         else {
+            pool_free(set->pool, new);
             return;
         }
     }
@@ -104,6 +133,7 @@ void set_add(set_t *set, void *elem) {
 
     // This can probably be simplified.
     if (set->cmpfunc(set->head->item, elem) == 0) {
+        pool_free(set->pool, new);
         return;
     }
     else if (set->cmpfunc(set->head->item, elem) > 0) {
@@ -114,8 +144,10 @@ void set_add(set_t *set, void *elem) {
     }
 
     while (tmp != NULL) {
-        if (set->cmpfunc(tmp->item, elem) == 0)
+        if (set->cmpfunc(tmp->item, elem) == 0) {
+            pool_free(set->pool, new);
             return;
+        }
         if (set->cmpfunc(tmp->item, elem) > 0) {
             prev->next = new;
             new->next = tmp;
@@ -135,7 +167,7 @@ void set_add(set_t *set, void *elem) {
  * Returns 1 if the given element is contained in
  * the given set, 0 otherwise.
  */
-int set_contains(set_t *set, void *elem) {
+static int listset_contains(set_t *set, void *elem) {
     node_t *tmp = set->head;
 
     while (tmp != NULL) {
@@ -148,146 +180,96 @@ int set_contains(set_t *set, void *elem) {
 }
 
 /*
- * Returns the union of the two given sets; the returned
- * set contains all elements that are contained in either
- * a or b.
+ * Appends a node holding the given item to the given set, after tail,
+ * which is NULL if the set is empty.  Returns the new node, or NULL if
+ * out of memory.
  */
-set_t *set_union(set_t *a, set_t *b) {
-    set_t *set = set_create(a->cmpfunc);
-
-    if (set == NULL)
-        return NULL;
+static node_t *append(set_t *set, node_t *tail, void *item) {
+    node_t *node = pool_alloc(set->pool);
 
-    set_t *aa = set_copy(a);
-    set_t *bb = set_copy(b);
-    if (aa == NULL || bb == NULL)
+    if (node == NULL)
         return NULL;
+    node->item = item;
+    node->next = NULL;
+    if (tail == NULL)
+        set->head = node;
+    else
+        tail->next = node;
+    set->size++;
+    return node;
+}
 
-    node_t *tmp_a, *tmp_b;
+/*
+ * The operations that merge two sets.
+ */
+enum { UNION, INTERSECTION, DIFFERENCE };
 
-    tmp_a = aa->head;
-    tmp_b = bb->head;
+/*
+ * Returns a new set with the union, intersection or difference of a
+ * and b, built by walking both sorted lists once.  Elements that are in
+ * both sets are taken from a.
+ */
+static set_t *merge(int op, set_t *a, set_t *b) {
+    set_t *set = listset_create(a->cmpfunc);
+    node_t *tmp_a, *tmp_b, *from, *tail = NULL;
+    int cmp;
 
-    /* If one set is empty, return the other. */
-    if (tmp_a == NULL) {
-        return bb;
-    }
-    if (tmp_b == NULL) {
-        return aa;
-    }
+    if (set == NULL)
+        return NULL;
 
-    /* Find head node for union set. */
-    if (set->cmpfunc(tmp_a->item, tmp_b->item) > 0) {
-        set->head = tmp_b;
-        set->size++;
-        tmp_b = tmp_b->next;
-    } else if (set->cmpfunc(a->head->item, b->head->item) == 0) {
-        set->head = tmp_b;
-        set->size++;
-        tmp_b = tmp_b->next;
-        tmp_a = tmp_a->next;
-    } else {
-        set->head = tmp_a;
-        set->size++;
-        tmp_a = tmp_a->next;
-    }
+    tmp_a = a->head;
+    tmp_b = b->head;
 
-    node_t *tmp_u = set->head;
+    while (tmp_a != NULL || tmp_b != NULL) {
+        if (tmp_a == NULL)
+            cmp = 1;
+        else if (tmp_b == NULL)
+            cmp = -1;
+        else
+            cmp = set->cmpfunc(tmp_a->item, tmp_b->item);
 
-    /* Insert elements in ascending order. */
-    while (tmp_a != NULL && tmp_b != NULL) {
-        if (set->cmpfunc(tmp_a->item, tmp_b->item) > 0) {
-            tmp_u->next = tmp_b;
-            tmp_b = tmp_b->next;
-            set->size++;
-        } else if (set->cmpfunc(tmp_a->item, tmp_b->item) == 0) {
-            tmp_u->next = tmp_b;
-            tmp_b = tmp_b->next;
+        /* Only in a, only in b, or in both */
+        if (cmp < 0) {
+            from = op != INTERSECTION ? tmp_a : NULL;
             tmp_a = tmp_a->next;
-            set->size++;
+        } else if (cmp > 0) {
+            from = op == UNION ? tmp_b : NULL;
+            tmp_b = tmp_b->next;
         } else {
-            tmp_u->next = tmp_a;
+            from = op != DIFFERENCE ? tmp_a : NULL;
             tmp_a = tmp_a->next;
-            set->size++;
+            tmp_b = tmp_b->next;
         }
-        tmp_u = tmp_u->next;
-    }
 
-    /* Add remaining elements to union set. */
-    if (tmp_a != NULL) {
-        while (tmp_a != NULL) {
-            tmp_u->next = tmp_a;
-            tmp_a = tmp_a->next;
-            set->size++;
-            tmp_u = tmp_u->next;
-        }
-    }
-    if (tmp_b != NULL) {
-        while (tmp_b != NULL) {
-            tmp_u->next = tmp_b;
-            tmp_b = tmp_b->next;
-            set->size++;
-            tmp_u = tmp_u->next;
+        if (from != NULL && (tail = append(set, tail, from->item)) == NULL) {
+            listset_destroy(set);
+            return NULL;
         }
+
+        /* Nothing more can be added once a runs out */
+        if (tmp_a == NULL && op != UNION)
+            break;
     }
 
     return set;
 }
 
+/*
+ * Returns the union of the two given sets; the returned
+ * set contains all elements that are contained in either
+ * a or b.
+ */
+static set_t *listset_union(set_t *a, set_t *b) {
+    return merge(UNION, a, b);
+}
+
 /*
  * Returns the intersection of the two given sets; the
  * returned set contains all elements that are contained
  * in both a and b.
  */
-set_t *set_intersection(set_t *a, set_t *b) {
-    set_t *set = set_create(a->cmpfunc);
-    if (set == NULL)
-        return NULL;
-
-    set_t *aa = set_copy(a);
-    set_t *bb = set_copy(b);
-    if (aa == NULL || bb == NULL)
-        return NULL;
-
-    node_t *tmp_a, *tmp_b, *tmp_i;
-
-    tmp_a = aa->head;
-    tmp_b = bb->head;
-    tmp_i = NULL;
-
-    /* If one of the sets is empty, return an empty set (no intersection.) */
-    if (tmp_a == NULL)
-        return aa;
-    if (tmp_b == NULL)
-        return bb;
-
-    /* Add all elements with equal value. */
-    while (tmp_a != NULL && tmp_b != NULL) {
-        if (set->cmpfunc(tmp_a->item, tmp_b->item) > 0) {
-            tmp_b = tmp_b->next;
-        } else if (set->cmpfunc(tmp_a->item, tmp_b->item) == 0) {
-            if (tmp_i != NULL) {
-                tmp_i->next = tmp_b;
-                tmp_b = tmp_b->next;
-                tmp_a = tmp_a->next;
-                set->size++;
-                tmp_i = tmp_i->next;
-            } else {
-                set->head = tmp_b;
-                tmp_b = tmp_b->next;
-                tmp_a = tmp_a->next;
-                set->size++;
-                tmp_i = set->head;
-            }
-        } else {
-            tmp_a = tmp_a->next;
-        }
-    }
-
-    if (tmp_i != NULL)
-        tmp_i->next = NULL;
-
-    return set;
+static set_t *listset_intersection(set_t *a, set_t *b) {
+    return merge(INTERSECTION, a, b);
 }
 
 /*
@@ -295,132 +277,48 @@ set_t *set_intersection(set_t *a, set_t *b) {
  * returned set contains all elements that are contained
  * in a and not in b.
  */
-set_t *set_difference(set_t *a, set_t *b) {
-    set_t *set = set_create(a->cmpfunc);
-
-    if (set == NULL)
-        return NULL;
-
-    set_t *aa = set_copy(a);
-    set_t *bb = set_copy(b);
-    if (aa == NULL || bb == NULL)
-        return NULL;
-
-    node_t *tmp_a, *tmp_b, *tmp_d;
-    tmp_a = aa->head;
-    tmp_b = bb->head;
-    tmp_d = NULL;
-
-    /* If a is empty, return an empty set. If b is empty, return a. */
-    if (tmp_a == NULL)
-        return set;
-    if (tmp_b == NULL)
-        return aa;
-
-    /* Insert elements from A that are not contained in B. */
-    while (tmp_a != NULL && tmp_b != NULL) {
-        if (set->cmpfunc(tmp_a->item, tmp_b->item) > 0) {
-            tmp_b = tmp_b->next;
-        } else if (set->cmpfunc(tmp_a->item, tmp_b->item) == 0) {
-            tmp_b = tmp_b->next;
-            tmp_a = tmp_a->next;
-        } else {
-            if (tmp_d != NULL) {
-                tmp_d->next = tmp_a;
-                set->size++;
-                tmp_a = tmp_a->next;
-                tmp_d = tmp_d->next;
-            } else {
-                set->head = tmp_a;
-                tmp_a = tmp_a->next;
-                set->size++;
-                tmp_d = set->head;
-            }
-        }
-    }
-
-    /* Add remaining elements. */
-    if (tmp_a != NULL) {
-        while (tmp_a != NULL) {
-            tmp_d->next = tmp_a;
-            tmp_a = tmp_a->next;
-            set->size++;
-            tmp_d = tmp_d->next;
-        }
-    } else {
-        if (tmp_d != NULL)
-            tmp_d->next = NULL;
-    }
-
-    return set;
+static set_t *listset_difference(set_t *a, set_t *b) {
+    return merge(DIFFERENCE, a, b);
 }
 
 /*
  * Returns a copy of the given set.
  */
-set_t *set_copy(set_t *set) {
-    set_t *copy = set_create(set->cmpfunc);
+static set_t *listset_copy(set_t *set) {
+    set_t *copy = listset_create(set->cmpfunc);
+    node_t *tmp, *tail = NULL;
 
     if (copy == NULL)
         return NULL;
 
-    if (set->head == NULL)
-        return copy;
-
-    node_t *tmp = set->head;
-
-    node_t *node = malloc(sizeof(node_t));
-
-    if (node == NULL) {
-        set_destroy(copy);
-        return NULL;
-    }
-
-    node->item = tmp->item;
-    node->next = NULL;
-    copy->head = node;
-    copy->size++;
-    tmp = tmp->next;
-
-    node_t *tmp_c = copy->head;
-
-    while (tmp != NULL && tmp_c != NULL) {
-        node_t *new = malloc(sizeof(node_t));
-        if (node == NULL) {
-            set_destroy(copy);
+    for (tmp = set->head; tmp != NULL; tmp = tmp->next) {
+        if ((tail = append(copy, tail, tmp->item)) == NULL) {
+            listset_destroy(copy);
             return NULL;
         }
-
-        new->item = tmp->item;
-        new->next = NULL;
-        copy->size++;
-        tmp_c->next = new;
-
-
-        tmp_c = tmp_c->next;
-        tmp = tmp->next;
     }
 
     return copy;
 }
 
 /*
- * The type of set iterators.
+ * Sets up the given iterator for iterating over the given set.
  */
-struct set_iter {
-    node_t *node;
-};
+static void listset_iterinit(set_iter_t *iter, set_t *set) {
+    iter->ops = &listset_ops;
+    STATE(iter)->node = set->head;
+}
 
 /*
  * Creates a new set iterator for iterating over the given set.
  */
-set_iter_t *set_createiter(set_t *set) {
+static set_iter_t *listset_createiter(set_t *set) {
     set_iter_t *iter = malloc(sizeof(set_iter_t));
     if (iter == NULL) {
         return NULL;
     }
 
-    iter->node = set->head;
+    listset_iterinit(iter, set);
 
     return iter;
 }
@@ -428,7 +326,7 @@ set_iter_t *set_createiter(set_t *set) {
 /*
  * Destroys the given set iterator.
  */
-void set_destroyiter(set_iter_t *iter) {
+static void listset_destroyiter(set_iter_t *iter) {
     free(iter);
 }
 
@@ -436,8 +334,8 @@ void set_destroyiter(set_iter_t *iter) {
  * Returns 0 if the given set iterator has reached the end of the
  * set, or 1 otherwise.
  */
-int set_hasnext(set_iter_t *iter) {
-    if (iter->node == NULL) {
+static int listset_hasnext(set_iter_t *iter) {
+    if (STATE(iter)->node == NULL) {
         return 0;
     }
 
@@ -448,11 +346,45 @@ int set_hasnext(set_iter_t *iter) {
  * Returns the next element in the sequence represented by the given
  * set iterator.
  */
-void *set_next(set_iter_t *iter) {
-    if (iter->node == NULL) {
+static void *listset_next(set_iter_t *iter) {
+    if (STATE(iter)->node == NULL) {
         return NULL;
     }
-    void *elem = iter->node->item;
-    iter->node = iter->node->next;
-    return elem;
+    node_t *node = STATE(iter)->node;
+    STATE(iter)->node = node->next;
+    return node->item;
+}
+
+/*
+ * Copies up to max of the next elements of the given iterator to buf.
+ */
+static int listset_nextbatch(set_iter_t *iter, void **buf, int max) {
+    node_t *node = STATE(iter)->node;
+    int n = 0;
+
+    while (n < max && node != NULL) {
+        buf[n++] = node->item;
+        node = node->next;
+    }
+    STATE(iter)->node = node;
+    return n;
 }
+
+const set_ops_t listset_ops = {
+    "list",
+    listset_create,
+    listset_destroy,
+    listset_size,
+    listset_add,
+    listset_contains,
+    listset_union,
+    listset_intersection,
+    listset_difference,
+    listset_copy,
+    listset_createiter,
+    listset_iterinit,
+    listset_destroyiter,
+    listset_hasnext,
+    listset_next,
+    listset_nextbatch,
+};
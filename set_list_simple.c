@@ -1,25 +1,33 @@
 #include <stdlib.h>
-#include <stdio.h>
 
-#include "set.h"
+#include "set_impl.h"
+#include "instrument.h"
 #include "list.h"
 
 struct set {
+    const set_ops_t *ops;
     list_t *list;
     cmpfunc_t cmpfunc;
 };
 
+/* The iteration state is an iterator over the list */
+ITER_STATE_CHECK(list_iter_t);
+
+#define STATE(iter) ITER_STATE(list_iter_t, iter)
+
 /*
  * Creates a new set using the given comparison function
  * to compare elements of the set.
  */
-set_t *set_create(cmpfunc_t cmpfunc) {
+static set_t *simpleset_create(cmpfunc_t cmpfunc) {
     set_t *set = malloc(sizeof(set_t));
 
     if (set == NULL) {
         return NULL;
     }
 
+    set->ops = &simpleset_ops;
+
     list_t *list = list_create(cmpfunc);
     if (list == NULL) {
         return NULL;
@@ -35,7 +43,7 @@ set_t *set_create(cmpfunc_t cmpfunc) {
  * Destroys the given set. Subsequently accessing the set
  * will lead to undefined behavior.
  */
-void set_destroy(set_t *set) {
+static void simpleset_destroy(set_t *set) {
     list_destroy(set->list);
     free(set);
 }
@@ -43,51 +51,37 @@ void set_destroy(set_t *set) {
 /*
  * Returns the size (cardinality) of the given set.
  */
-int set_size(set_t *set) {
+static int simpleset_size(set_t *set) {
     return list_size(set->list);
 }
 
 /*
  * Adds the given element to the given set.
  */
-void set_add(set_t *set, void *elem) {
-    list_iter_t *iter = list_createiter(set->list);
+static void simpleset_add(set_t *set, void *elem) {
+    void *item;
 
-    if (iter == NULL) {
-        printf("Error\n");
-        return;
-    }
-
-    while (list_hasnext(iter)) {
-        if (set->cmpfunc(elem, list_next(iter)) == 0)
+    LIST_FOREACH(item, set->list) {
+        if (set->cmpfunc(elem, item) == 0)
             return;
     }
 
     list_addfirst(set->list, elem);
     list_sort(set->list);
-    list_destroyiter(iter);
 }
 
 /*
  * Returns 1 if the given element is contained in
  * the given set, 0 otherwise.
  */
-int set_contains(set_t *set, void *elem) {
-    list_iter_t *iter = list_createiter(set->list);
-
-    if (iter == NULL) {
-        printf("Error\n");
-        return -1;
-    }
+static int simpleset_contains(set_t *set, void *elem) {
+    void *item;
 
-    while (list_hasnext(iter)) {
-        if (set->cmpfunc(elem, list_next(iter)) == 0) {
-            list_destroyiter(iter);
+    LIST_FOREACH(item, set->list) {
+        if (set->cmpfunc(elem, item) == 0)
             return 1;
-        }
     }
 
-    list_destroyiter(iter);
     return 0;
 }
 
@@ -96,29 +90,21 @@ int set_contains(set_t *set, void *elem) {
  * set contains all elements that are contained in either
  * a or b.
  */
-set_t *set_union(set_t *a, set_t *b) {
-    set_t *set_union = set_create(a->cmpfunc);
+static set_t *simpleset_union(set_t *a, set_t *b) {
+    set_t *set_union = simpleset_create(a->cmpfunc);
+    void *elem;
 
     if (set_union == NULL) {
         return NULL;
     }
 
-    list_iter_t *iter_a = list_createiter(a->list);
-    list_iter_t *iter_b = list_createiter(b->list);
-    if (iter_a == NULL || iter_b == NULL) {
-        return NULL;
-    }
-
-    while (list_hasnext(iter_a)) {
-        set_add(set_union, list_next(iter_a));
+    LIST_FOREACH(elem, a->list) {
+        simpleset_add(set_union, elem);
     }
-    while (list_hasnext(iter_b)) {
-        set_add(set_union, list_next(iter_b));
+    LIST_FOREACH(elem, b->list) {
+        simpleset_add(set_union, elem);
     }
 
-    list_destroyiter(iter_a);
-    list_destroyiter(iter_b);
-
     return set_union;
 }
 
@@ -127,38 +113,22 @@ set_t *set_union(set_t *a, set_t *b) {
  * returned set contains all elements that are contained
  * in both a and b.
  */
-set_t *set_intersection(set_t *a, set_t *b) {
-    set_t *set_intersection = set_create(a->cmpfunc);
+static set_t *simpleset_intersection(set_t *a, set_t *b) {
+    set_t *set_intersection = simpleset_create(a->cmpfunc);
+    void *elem_a, *elem_b;
 
     if (set_intersection == NULL) {
         return NULL;
     }
 
-    list_iter_t *iter_a = list_createiter(a->list);
-    if (iter_a == NULL) {
-        return NULL;
-    }
-
-    while (list_hasnext(iter_a)) {
-        list_iter_t *iter_b = list_createiter(b->list);
-        if (iter_b == NULL) {
-            return NULL;
-        }
-
-        void *elem_a = list_next(iter_a);
-
-        while (list_hasnext(iter_b)) {
-            void *elem_b = list_next(iter_b);
-
+    LIST_FOREACH(elem_a, a->list) {
+        LIST_FOREACH(elem_b, b->list) {
             if (set_intersection->cmpfunc(elem_a, elem_b) == 0) {
-                set_add(set_intersection, elem_b);
+                simpleset_add(set_intersection, elem_b);
             }
         }
-
-        list_destroyiter(iter_b);
     }
 
-    list_destroyiter(iter_a);
     return set_intersection;
 }
 
@@ -167,89 +137,72 @@ set_t *set_intersection(set_t *a, set_t *b) {
  * returned set contains all elements that are contained
  * in a and not in b.
  */
-set_t *set_difference(set_t *a, set_t *b) {
-    set_t *set_difference = set_create(a->cmpfunc);
+static set_t *simpleset_difference(set_t *a, set_t *b) {
+    set_t *set_difference = simpleset_create(a->cmpfunc);
+    void *elem_a;
 
     if (set_difference == NULL) {
         return NULL;
     }
 
-    list_iter_t *iter_a = list_createiter(a->list);
-    if (iter_a == NULL) {
-        return NULL;
+    LIST_FOREACH(elem_a, a->list) {
+        if (!simpleset_contains(b, elem_a))
+            simpleset_add(set_difference, elem_a);
     }
 
-    while (list_hasnext(iter_a)) {
-        list_iter_t *iter_b = list_createiter(b->list);
-        if (iter_b == NULL) {
-            return NULL;
-        }
-
-        void *elem_a = list_next(iter_a);
-
-        int add = 1;
-        while (list_hasnext(iter_b)) {
-            void *elem_b = list_next(iter_b);
-
-            if (set_difference->cmpfunc(elem_a, elem_b) == 0) {
-                add = 0;
-                break;
-            }
-        }
-        if (add == 1)
-            set_add(set_difference, elem_a);
-
-        list_destroyiter(iter_b);
-    }
-
-    list_destroyiter(iter_a);
     return set_difference;
 }
 
 /*
  * Returns a copy of the given set.
  */
-set_t *set_copy(set_t *set) {
-    set_t *set_copy = set_create(set->cmpfunc);
+static set_t *simpleset_copy(set_t *set) {
+    set_t *set_copy = simpleset_create(set->cmpfunc);
+    int n = list_size(set->list);
+    list_t *list;
+    void **elems;
 
     if (set_copy == NULL) {
         return NULL;
     }
 
-    list_iter_t *iter = list_createiter(set->list);
-
-    if (iter == NULL) {
+    /* The elements are sorted and unique, so the list is copied as is */
+    elems = malloc(sizeof(void *) * (n > 0 ? n : 1));
+    if (elems == NULL) {
+        simpleset_destroy(set_copy);
         return NULL;
     }
-
-    while (list_hasnext(iter)) {
-        set_add(set_copy, list_next(iter));
+    list_to_array(set->list, elems);
+    list = list_from_array(set->cmpfunc, elems, n);
+    free(elems);
+    if (list == NULL) {
+        simpleset_destroy(set_copy);
+        return NULL;
     }
 
-    list_destroyiter(iter);
+    list_destroy(set_copy->list);
+    set_copy->list = list;
 
     return set_copy;
 }
 
 /*
- * The type of set iterators.
+ * Sets up the given iterator for iterating over the given set.
  */
-struct set_iter {
-    list_iter_t *list_iter;
-};
+static void simpleset_iterinit(set_iter_t *iter, set_t *set) {
+    iter->ops = &simpleset_ops;
+    list_iter_init(STATE(iter), set->list);
+}
 
 /*
  * Creates a new set iterator for iterating over the given set.
  */
-set_iter_t *set_createiter(set_t *set) {
+static set_iter_t *simpleset_createiter(set_t *set) {
     set_iter_t *set_iter = malloc(sizeof(set_iter_t));
     if (set_iter == NULL)
         return NULL;
 
-    set_iter->list_iter = list_createiter(set->list);
-    if (set_iter->list_iter == NULL) {
-        return NULL;
-    }
+    simpleset_iterinit(set_iter, set);
 
     return set_iter;
 }
@@ -257,8 +210,7 @@ set_iter_t *set_createiter(set_t *set) {
 /*
  * Destroys the given set iterator.
  */
-void set_destroyiter(set_iter_t *iter) {
-    list_destroyiter(iter->list_iter);
+static void simpleset_destroyiter(set_iter_t *iter) {
     free(iter);
 }
 
@@ -266,8 +218,8 @@ void set_destroyiter(set_iter_t *iter) {
  * Returns 0 if the given set iterator has reached the end of the
  * set, or 1 otherwise.
  */
-int set_hasnext(set_iter_t *iter) {
-    if (list_hasnext(iter->list_iter)) {
+static int simpleset_hasnext(set_iter_t *iter) {
+    if (list_hasnext(STATE(iter))) {
         return 1;
     }
 
@@ -278,6 +230,32 @@ int set_hasnext(set_iter_t *iter) {
  * Returns the next element in the sequence represented by the given
  * set iterator.
  */
-void *set_next(set_iter_t *iter) {
-    return list_next(iter->list_iter);
+static void *simpleset_next(set_iter_t *iter) {
+    return list_next(STATE(iter));
 }
+
+/*
+ * Copies up to max of the next elements of the given iterator to buf.
+ */
+static int simpleset_nextbatch(set_iter_t *iter, void **buf, int max) {
+    return list_next_batch(STATE(iter), buf, max);
+}
+
+const set_ops_t simpleset_ops = {
+    "list_simple",
+    simpleset_create,
+    simpleset_destroy,
+    simpleset_size,
+    simpleset_add,
+    simpleset_contains,
+    simpleset_union,
+    simpleset_intersection,
+    simpleset_difference,
+    simpleset_copy,
+    simpleset_createiter,
+    simpleset_iterinit,
+    simpleset_destroyiter,
+    simpleset_hasnext,
+    simpleset_next,
+    simpleset_nextbatch,
+};
@@ -0,0 +1,514 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "set_impl.h"
+#include "instrument.h"
+
+/*
+ * A packed-memory array: a sorted array with gaps.  The slots are
+ * split into segments of about log2(capacity) slots, and each segment
+ * keeps its elements packed at its start, so an insert shifts at most
+ * one segment.  When a segment is full, the smallest enclosing window
+ * of 2, 4, 8, ... segments that is below its density threshold gets
+ * its elements spread evenly over its segments.  The thresholds go
+ * from LEAF_DENSITY for a single segment down to ROOT_DENSITY for the
+ * whole array, which doubles when it gets denser than that.  This
+ * moves O(log^2 n) elements per insert, amortized.
+ *
+ * Spreading never leaves a segment empty in a non-empty set, so the
+ * first slot of every segment can be used to find the right segment
+ * by binary search.
+ */
+#define MIN_CAPACITY 8
+#define MIN_SEGMENT 8
+#define LEAF_DENSITY 1.0
+#define ROOT_DENSITY 0.75
+
+struct set {
+    const set_ops_t *ops;
+    cmpfunc_t cmpfunc;
+    void **slots;
+    int *counts;
+    int size;
+    int capacity;
+    int segsize;
+    int nsegs;
+    int height;
+};
+
+/* The iteration state: the slot of the next element, or the capacity */
+typedef struct pmaiter {
+    set_t *set;
+    int index;
+} pmaiter_t;
+
+ITER_STATE_CHECK(pmaiter_t);
+
+#define STATE(iter) ITER_STATE(pmaiter_t, iter)
+
+/*
+ * Returns the smallest capacity that holds n elements within the root
+ * density threshold.
+ */
+static int capacityfor(int n) {
+    int capacity = MIN_CAPACITY;
+
+    while (n > ROOT_DENSITY * capacity)
+        capacity *= 2;
+    return capacity;
+}
+
+/*
+ * Gives the given set empty slots and segments for the given capacity,
+ * and frees the old ones.  Returns 0 if out of memory, and leaves the
+ * set as it was.
+ */
+static int layout(set_t *set, int capacity) {
+    int segsize = MIN_SEGMENT, lg = 0, height = 0;
+    void **slots;
+    int *counts;
+
+    while ((1 << lg) < capacity)
+        lg++;
+    while (segsize < lg)
+        segsize *= 2;
+    if (segsize > capacity)
+        segsize = capacity;
+    while ((segsize << height) < capacity)
+        height++;
+
+    slots = malloc(capacity * sizeof(void *));
+    counts = calloc(capacity / segsize, sizeof(int));
+    if (slots == NULL || counts == NULL) {
+        free(slots);
+        free(counts);
+        return 0;
+    }
+
+    free(set->slots);
+    free(set->counts);
+    set->slots = slots;
+    set->counts = counts;
+    set->capacity = capacity;
+    set->segsize = segsize;
+    set->nsegs = capacity / segsize;
+    set->height = height;
+    return 1;
+}
+
+/*
+ * Spreads the n sorted elements evenly over the w segments starting
+ * at segment first.
+ */
+static void spread(set_t *set, int first, int w, void **elems, int n) {
+    int i, count;
+
+    for (i = 0; i < w; i++) {
+        count = n / w + (i < n % w);
+        memcpy(set->slots + (first + i) * set->segsize, elems, count * sizeof(void *));
+        set->counts[first + i] = count;
+        elems += count;
+    }
+}
+
+/*
+ * Copies the elements of the w segments starting at segment first to
+ * buf, with elem inserted at position pos of segment seg, and returns
+ * the number copied.
+ */
+static int gather(set_t *set, int first, int w, void **buf, int seg, int pos, void *elem) {
+    void **slots;
+    int i, count, n = 0;
+
+    for (i = first; i < first + w; i++) {
+        slots = set->slots + i * set->segsize;
+        count = set->counts[i];
+        if (i == seg) {
+            memcpy(buf + n, slots, pos * sizeof(void *));
+            buf[n + pos] = elem;
+            memcpy(buf + n + pos + 1, slots + pos, (count - pos) * sizeof(void *));
+            n += count + 1;
+        } else {
+            memcpy(buf + n, slots, count * sizeof(void *));
+            n += count;
+        }
+    }
+    return n;
+}
+
+/*
+ * Returns the density threshold of windows of 2^level segments.
+ */
+static double threshold(set_t *set, int level) {
+    if (level >= set->height)
+        return ROOT_DENSITY;
+    return LEAF_DENSITY - (LEAF_DENSITY - ROOT_DENSITY) * level / set->height;
+}
+
+/*
+ * Looks for the given element in the given set.  Stores the segment it
+ * is in, or belongs in, in *seg and its position in that segment in
+ * *pos.  Returns 1 if the element is in the set, or 0 otherwise.
+ */
+static int find(set_t *set, void *elem, int *seg, int *pos) {
+    void **slots;
+    int lo = 0, hi = set->nsegs - 1, mid, cmp;
+
+    *seg = *pos = 0;
+    if (set->size == 0)
+        return 0;
+
+    /* The last segment that starts at or before elem */
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (set->cmpfunc(set->slots[mid * set->segsize], elem) <= 0)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    *seg = lo;
+
+    slots = set->slots + lo * set->segsize;
+    lo = 0;
+    hi = set->counts[*seg];
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        cmp = set->cmpfunc(slots[mid], elem);
+        if (cmp == 0) {
+            *pos = mid;
+            return 1;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return 0;
+}
+
+/*
+ * Creates a new set using the given comparison function
+ * to compare elements of the set.
+ */
+static set_t *pmaset_create(cmpfunc_t cmpfunc) {
+    set_t *set = malloc(sizeof(set_t));
+
+    if (set == NULL)
+        return NULL;
+
+    set->ops = &pmaset_ops;
+    set->cmpfunc = cmpfunc;
+    set->slots = NULL;
+    set->counts = NULL;
+    set->size = 0;
+    if (!layout(set, MIN_CAPACITY)) {
+        free(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+/*
+ * Destroys the given set.  Subsequently accessing the set
+ * will lead to undefined behavior.
+ */
+static void pmaset_destroy(set_t *set) {
+    free(set->slots);
+    free(set->counts);
+    free(set);
+}
+
+/*
+ * Returns the size (cardinality) of the given set.
+ */
+static int pmaset_size(set_t *set) {
+    return set->size;
+}
+
+/*
+ * Adds the given element to the given set.
+ */
+static void pmaset_add(set_t *set, void *elem) {
+    int seg, pos, level, first, w, n, i;
+    void **slots, **buf;
+
+    if (find(set, elem, &seg, &pos))
+        return;
+
+    /* Room in the segment: shift the rest of it */
+    if (set->counts[seg] < LEAF_DENSITY * set->segsize) {
+        slots = set->slots + seg * set->segsize;
+        memmove(slots + pos + 1, slots + pos, (set->counts[seg] - pos) * sizeof(void *));
+        slots[pos] = elem;
+        set->counts[seg]++;
+        set->size++;
+        return;
+    }
+
+    /* Spread the smallest window that has room */
+    for (level = 1; level <= set->height; level++) {
+        w = 1 << level;
+        first = seg & ~(w - 1);
+        n = 1;
+        for (i = first; i < first + w; i++)
+            n += set->counts[i];
+        if (n <= threshold(set, level) * w * set->segsize) {
+            if ((buf = malloc(n * sizeof(void *))) == NULL)
+                return;
+            gather(set, first, w, buf, seg, pos, elem);
+            spread(set, first, w, buf, n);
+            set->size++;
+            free(buf);
+            return;
+        }
+    }
+
+    /* Too dense all the way up: grow the array */
+    if ((buf = malloc((set->size + 1) * sizeof(void *))) == NULL)
+        return;
+    n = gather(set, 0, set->nsegs, buf, seg, pos, elem);
+    if (layout(set, capacityfor(n))) {
+        spread(set, 0, set->nsegs, buf, n);
+        set->size++;
+    }
+    free(buf);
+}
+
+/*
+ * Returns 1 if the given element is contained in
+ * the given set, 0 otherwise.
+ */
+static int pmaset_contains(set_t *set, void *elem) {
+    int seg, pos;
+
+    return find(set, elem, &seg, &pos);
+}
+
+/*
+ * Creates a set holding the n sorted, distinct elements, spread evenly
+ * over an array of the capacity the size calls for.
+ */
+static set_t *build(cmpfunc_t cmpfunc, void **elems, int n) {
+    set_t *set = pmaset_create(cmpfunc);
+
+    if (set == NULL)
+        return NULL;
+    if (!layout(set, capacityfor(n))) {
+        pmaset_destroy(set);
+        return NULL;
+    }
+    spread(set, 0, set->nsegs, elems, n);
+    set->size = n;
+    return set;
+}
+
+static void pmaset_iterinit(set_iter_t *iter, set_t *set);
+static int pmaset_hasnext(set_iter_t *iter);
+static void *pmaset_next(set_iter_t *iter);
+
+/*
+ * The operations that merge two sets.
+ */
+enum { UNION, INTERSECTION, DIFFERENCE };
+
+/*
+ * Returns a new set with the union, intersection or difference of a
+ * and b, built by walking both sets once.  Elements that are in both
+ * sets are taken from a.
+ */
+static set_t *merge(int op, set_t *a, set_t *b) {
+    set_iter_t iter_a, iter_b;
+    void *elem_a = NULL, *elem_b = NULL, **buf;
+    int has_a, has_b, cmp, n = 0;
+    set_t *set;
+
+    buf = malloc((a->size + b->size + 1) * sizeof(void *));
+    if (buf == NULL)
+        return NULL;
+
+    pmaset_iterinit(&iter_a, a);
+    pmaset_iterinit(&iter_b, b);
+    if ((has_a = pmaset_hasnext(&iter_a)))
+        elem_a = pmaset_next(&iter_a);
+    if ((has_b = pmaset_hasnext(&iter_b)))
+        elem_b = pmaset_next(&iter_b);
+
+    while (has_a || (has_b && op == UNION)) {
+        if (!has_a)
+            cmp = 1;
+        else if (!has_b)
+            cmp = -1;
+        else
+            cmp = a->cmpfunc(elem_a, elem_b);
+
+        /* Only in a, only in b, or in both */
+        if (cmp < 0 && op != INTERSECTION)
+            buf[n++] = elem_a;
+        else if (cmp > 0 && op == UNION)
+            buf[n++] = elem_b;
+        else if (cmp == 0 && op != DIFFERENCE)
+            buf[n++] = elem_a;
+
+        if (cmp <= 0 && (has_a = pmaset_hasnext(&iter_a)))
+            elem_a = pmaset_next(&iter_a);
+        if (cmp >= 0 && (has_b = pmaset_hasnext(&iter_b)))
+            elem_b = pmaset_next(&iter_b);
+    }
+
+    set = build(a->cmpfunc, buf, n);
+    free(buf);
+    return set;
+}
+
+/*
+ * Returns the union of the two given sets; the returned
+ * set contains all elements that are contained in either
+ * a or b.
+ */
+static set_t *pmaset_union(set_t *a, set_t *b) {
+    return merge(UNION, a, b);
+}
+
+/*
+ * Returns the intersection of the two given sets; the
+ * returned set contains all elements that are contained
+ * in both a and b.
+ */
+static set_t *pmaset_intersection(set_t *a, set_t *b) {
+    return merge(INTERSECTION, a, b);
+}
+
+/*
+ * Returns the set difference of the two given sets; the
+ * returned set contains all elements that are contained
+ * in a and not in b.
+ */
+static set_t *pmaset_difference(set_t *a, set_t *b) {
+    return merge(DIFFERENCE, a, b);
+}
+
+/*
+ * Returns a copy of the given set, with the same gaps.
+ */
+static set_t *pmaset_copy(set_t *set) {
+    set_t *copy = pmaset_create(set->cmpfunc);
+
+    if (copy == NULL)
+        return NULL;
+    if (!layout(copy, set->capacity)) {
+        pmaset_destroy(copy);
+        return NULL;
+    }
+
+    memcpy(copy->slots, set->slots, set->capacity * sizeof(void *));
+    memcpy(copy->counts, set->counts, set->nsegs * sizeof(int));
+    copy->size = set->size;
+    return copy;
+}
+
+/*
+ * Moves the given iterator past the gap it is in, if any, to the next
+ * element or the end of the array.
+ */
+static void skipgap(set_iter_t *iter) {
+    set_t *set = STATE(iter)->set;
+
+    while (STATE(iter)->index < set->capacity &&
+           STATE(iter)->index % set->segsize >= set->counts[STATE(iter)->index / set->segsize])
+        STATE(iter)->index += set->segsize - STATE(iter)->index % set->segsize;
+}
+
+/*
+ * Sets up the given iterator for iterating over the given set.
+ */
+static void pmaset_iterinit(set_iter_t *iter, set_t *set) {
+    iter->ops = &pmaset_ops;
+    STATE(iter)->set = set;
+    STATE(iter)->index = 0;
+    skipgap(iter);
+}
+
+/*
+ * Creates a new set iterator for iterating over the given set.
+ */
+static set_iter_t *pmaset_createiter(set_t *set) {
+    set_iter_t *iter = malloc(sizeof(set_iter_t));
+
+    if (iter == NULL)
+        return NULL;
+
+    pmaset_iterinit(iter, set);
+
+    return iter;
+}
+
+/*
+ * Destroys the given set iterator.
+ */
+static void pmaset_destroyiter(set_iter_t *iter) {
+    free(iter);
+}
+
+/*
+ * Returns 0 if the given set iterator has reached the end of the
+ * set, or 1 otherwise.
+ */
+static int pmaset_hasnext(set_iter_t *iter) {
+    return STATE(iter)->index < STATE(iter)->set->capacity;
+}
+
+/*
+ * Returns the next element in the sequence represented by the given
+ * set iterator.
+ */
+static void *pmaset_next(set_iter_t *iter) {
+    void *elem;
+
+    if (STATE(iter)->index >= STATE(iter)->set->capacity)
+        return NULL;
+
+    elem = STATE(iter)->set->slots[STATE(iter)->index++];
+    skipgap(iter);
+    return elem;
+}
+
+/*
+ * Copies up to max of the next elements of the given iterator to buf,
+ * a segment at a time.
+ */
+static int pmaset_nextbatch(set_iter_t *iter, void **buf, int max) {
+    set_t *set = STATE(iter)->set;
+    int count, n = 0;
+
+    while (n < max && STATE(iter)->index < set->capacity) {
+        count = set->counts[STATE(iter)->index / set->segsize] - STATE(iter)->index % set->segsize;
+        if (count > max - n)
+            count = max - n;
+        memcpy(buf + n, set->slots + STATE(iter)->index, count * sizeof(void *));
+        STATE(iter)->index += count;
+        n += count;
+        skipgap(iter);
+    }
+    return n;
+}
+
+const set_ops_t pmaset_ops = {
+    "pma",
+    pmaset_create,
+    pmaset_destroy,
+    pmaset_size,
+    pmaset_add,
+    pmaset_contains,
+    pmaset_union,
+    pmaset_intersection,
+    pmaset_difference,
+    pmaset_copy,
+    pmaset_createiter,
+    pmaset_iterinit,
+    pmaset_destroyiter,
+    pmaset_hasnext,
+    pmaset_next,
+    pmaset_nextbatch,
+};
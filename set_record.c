@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "set_impl.h"
+#include "set_record.h"
+
+/*
+ * The "record" backend.  Each set and iterator wraps one of the
+ * recorded backend, and every call is passed on to it through set.h
+ * and logged to the trace.  Iterators set up with set_iter_init() have
+ * no room for the wrapping, and no destroy call to record, so they are
+ * handed to the recorded backend and not traced.
+ */
+struct set {
+    const set_ops_t *ops;
+    set_t *inner;
+    unsigned long id;
+};
+
+typedef struct recorditer {
+    set_iter_t iter;
+    set_iter_t inner;
+    unsigned long id;
+} recorditer_t;
+
+#define RECORDITER(iter) ((recorditer_t *) (iter))
+
+static const set_ops_t recordset_ops;
+
+/* The trace, and the backend that was selected when recording started */
+static FILE *trace;
+static const set_ops_t *recorded;
+static unsigned long nsets, niters;
+
+/*
+ * Keys are numbered by their contents, so that equal strings at
+ * different addresses are written once.  The numbers are kept in an
+ * open-addressing hash table.
+ */
+static char **keys;
+static unsigned long nkeys, keyslots;
+static long *slots;
+
+static void putvarint(unsigned long value) {
+    while (value >= 0x80) {
+        putc((value & 0x7f) | 0x80, trace);
+        value >>= 7;
+    }
+    putc(value, trace);
+}
+
+/* FNV-1a */
+static unsigned long hash(char *s) {
+    unsigned long h = 2166136261UL;
+
+    for (; *s != 0; s++)
+        h = (h ^ (unsigned char) *s) * 16777619UL;
+    return h;
+}
+
+/*
+ * Doubles the hash table.
+ */
+static void growkeys(void) {
+    unsigned long i, j, size = keyslots > 0 ? 2 * keyslots : 1024;
+    long *newslots = malloc(sizeof(long) * size);
+    char **newkeys = realloc(keys, sizeof(char *) * size / 2);
+
+    if (newslots == NULL || newkeys == NULL)
+        fatal_error("out of memory");
+    keys = newkeys;
+    for (i = 0; i < size; i++)
+        newslots[i] = -1;
+    for (i = 0; i < nkeys; i++) {
+        for (j = hash(keys[i]) & (size - 1); newslots[j] >= 0; j = (j + 1) & (size - 1))
+            ;
+        newslots[j] = i;
+    }
+    free(slots);
+    slots = newslots;
+    keyslots = size;
+}
+
+/*
+ * Returns the number of the given key, and defines it in the trace if
+ * it is new.
+ */
+static unsigned long keyid(char *key) {
+    unsigned long i, len;
+
+    if (2 * (nkeys + 1) > keyslots)
+        growkeys();
+    for (i = hash(key) & (keyslots - 1); slots[i] >= 0; i = (i + 1) & (keyslots - 1)) {
+        if (strcmp(keys[slots[i]], key) == 0)
+            return slots[i];
+    }
+
+    keys[nkeys] = strdup(key);
+    if (keys[nkeys] == NULL)
+        fatal_error("out of memory");
+    slots[i] = nkeys;
+
+    len = strlen(key);
+    putc(REC_KEY, trace);
+    putvarint(len);
+    fwrite(key, 1, len, trace);
+    return nkeys++;
+}
+
+/*
+ * Wraps the given set, unless it is the inner set of one of the given
+ * operands, in which case that operand is returned.
+ */
+static set_t *wrap(set_t *inner, set_t *a, set_t *b) {
+    set_t *set;
+
+    if (inner == NULL)
+        return NULL;
+    if (inner == a->inner)
+        return a;
+    if (b != NULL && inner == b->inner)
+        return b;
+
+    set = malloc(sizeof(set_t));
+    if (set == NULL)
+        fatal_error("out of memory");
+    set->ops = &recordset_ops;
+    set->inner = inner;
+    set->id = nsets++;
+    return set;
+}
+
+static set_t *recordset_create(cmpfunc_t cmpfunc) {
+    set_t *set = malloc(sizeof(set_t));
+
+    if (set == NULL)
+        return NULL;
+    set->ops = &recordset_ops;
+    set->inner = set_create_backend(recorded, cmpfunc);
+    if (set->inner == NULL) {
+        free(set);
+        return NULL;
+    }
+    set->id = nsets++;
+    if (trace != NULL) {
+        putc(REC_CREATE, trace);
+        putvarint(set->id);
+    }
+    return set;
+}
+
+static void recordset_destroy(set_t *set) {
+    if (trace != NULL) {
+        putc(REC_DESTROY, trace);
+        putvarint(set->id);
+    }
+    set_destroy(set->inner);
+    free(set);
+}
+
+static int recordset_size(set_t *set) {
+    int size = set_size(set->inner);
+
+    if (trace != NULL) {
+        putc(REC_SIZE, trace);
+        putvarint(set->id);
+        putvarint(size);
+    }
+    return size;
+}
+
+static void recordset_add(set_t *set, void *elem) {
+    if (trace != NULL) {
+        unsigned long key = keyid(elem);
+
+        putc(REC_ADD, trace);
+        putvarint(set->id);
+        putvarint(key);
+    }
+    set_add(set->inner, elem);
+}
+
+static int recordset_contains(set_t *set, void *elem) {
+    int found = set_contains(set->inner, elem);
+
+    if (trace != NULL) {
+        unsigned long key = keyid(elem);
+
+        putc(REC_CONTAINS, trace);
+        putvarint(set->id);
+        putvarint(key);
+        putvarint(found != 0);
+    }
+    return found;
+}
+
+/*
+ * Runs and logs a binary set operation.
+ */
+static set_t *binary(int op, set_t *(*func)(set_t *, set_t *), set_t *a, set_t *b) {
+    int asize = set_size(a->inner), bsize = set_size(b->inner);
+    set_t *set = wrap(func(a->inner, b->inner), a, b);
+
+    if (trace != NULL && set != NULL) {
+        putc(op, trace);
+        putvarint(a->id);
+        putvarint(b->id);
+        putvarint(asize);
+        putvarint(bsize);
+        putvarint(set->id);
+        putvarint(set_size(set->inner));
+    }
+    return set;
+}
+
+static set_t *recordset_union(set_t *a, set_t *b) {
+    return binary(REC_UNION, set_union, a, b);
+}
+
+static set_t *recordset_intersection(set_t *a, set_t *b) {
+    return binary(REC_INTERSECTION, set_intersection, a, b);
+}
+
+static set_t *recordset_difference(set_t *a, set_t *b) {
+    return binary(REC_DIFFERENCE, set_difference, a, b);
+}
+
+static set_t *recordset_copy(set_t *set) {
+    set_t *copy = wrap(set_copy(set->inner), set, NULL);
+
+    if (trace != NULL && copy != NULL) {
+        putc(REC_COPY, trace);
+        putvarint(set->id);
+        putvarint(copy->id);
+        putvarint(set_size(copy->inner));
+    }
+    return copy;
+}
+
+static set_iter_t *recordset_createiter(set_t *set) {
+    recorditer_t *iter = malloc(sizeof(recorditer_t));
+
+    if (iter == NULL)
+        return NULL;
+    iter->iter.ops = &recordset_ops;
+    set_iter_init(&iter->inner, set->inner);
+    iter->id = niters++;
+    if (trace != NULL) {
+        putc(REC_CREATEITER, trace);
+        putvarint(set->id);
+        putvarint(iter->id);
+    }
+    return &iter->iter;
+}
+
+static void recordset_iterinit(set_iter_t *iter, set_t *set) {
+    set_iter_init(iter, set->inner);
+}
+
+static void recordset_destroyiter(set_iter_t *iter) {
+    if (trace != NULL) {
+        putc(REC_DESTROYITER, trace);
+        putvarint(RECORDITER(iter)->id);
+    }
+    free(RECORDITER(iter));
+}
+
+static int recordset_hasnext(set_iter_t *iter) {
+    int hasnext = set_hasnext(&RECORDITER(iter)->inner);
+
+    if (trace != NULL) {
+        putc(REC_HASNEXT, trace);
+        putvarint(RECORDITER(iter)->id);
+        putvarint(hasnext != 0);
+    }
+    return hasnext;
+}
+
+static void *recordset_next(set_iter_t *iter) {
+    void *elem = set_next(&RECORDITER(iter)->inner);
+
+    if (trace != NULL && elem != NULL) {
+        unsigned long key = keyid(elem);
+
+        putc(REC_NEXT, trace);
+        putvarint(RECORDITER(iter)->id);
+        putvarint(key);
+    }
+    return elem;
+}
+
+/*
+ * A batch is recorded as the set_next() calls it stands for.
+ */
+static int recordset_nextbatch(set_iter_t *iter, void **buf, int max) {
+    int n = set_next_batch(&RECORDITER(iter)->inner, buf, max), i;
+
+    if (trace != NULL) {
+        for (i = 0; i < n; i++) {
+            unsigned long key = keyid(buf[i]);
+
+            putc(REC_NEXT, trace);
+            putvarint(RECORDITER(iter)->id);
+            putvarint(key);
+        }
+    }
+    return n;
+}
+
+static const set_ops_t recordset_ops = {
+    "record",
+    recordset_create,
+    recordset_destroy,
+    recordset_size,
+    recordset_add,
+    recordset_contains,
+    recordset_union,
+    recordset_intersection,
+    recordset_difference,
+    recordset_copy,
+    recordset_createiter,
+    recordset_iterinit,
+    recordset_destroyiter,
+    recordset_hasnext,
+    recordset_next,
+    recordset_nextbatch,
+};
+
+int set_record_start(char *filename, char *cmpname) {
+    if (trace != NULL)
+        set_record_stop();
+
+    trace = fopen(filename, "wb");
+    if (trace == NULL)
+        return 0;
+    fprintf(trace, "%s %s\n", REC_MAGIC, cmpname);
+
+    nsets = niters = 0;
+    recorded = set_currentbackend();
+    set_usebackend(&recordset_ops);
+    return 1;
+}
+
+int set_record_stop(void) {
+    unsigned long i;
+    int ok;
+
+    if (trace == NULL)
+        return 1;
+    ok = fclose(trace) == 0;
+    trace = NULL;
+    set_usebackend(recorded);
+
+    for (i = 0; i < nkeys; i++)
+        free(keys[i]);
+    free(keys);
+    free(slots);
+    keys = NULL;
+    slots = NULL;
+    nkeys = keyslots = 0;
+    return ok;
+}
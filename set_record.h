@@ -0,0 +1,59 @@
+#ifndef SET_RECORD_H
+#define SET_RECORD_H
+
+#include "set.h"
+
+/*
+ * Recording of set operations.
+ *
+ * While recording, set_create() returns sets of the "record" backend,
+ * which wrap sets of the previously selected backend and log every call
+ * made on them to a binary trace file.  The replay tool (replay.c)
+ * re-executes a trace against any backend.  The elements of recorded
+ * sets must be strings.
+ *
+ * A trace starts with the line "SETTRACE 1 <cmpname>\n", naming the
+ * comparison function of the recorded sets.  Then follows one record
+ * per call: an opcode byte and the operands listed below, each stored
+ * as an unsigned LEB128 varint.  Sets, iterators and keys are numbered
+ * from 0 in order of appearance; a key is defined by a REC_KEY record
+ * the first time it is used, and later referred to by its number.  The
+ * recorded sizes and results let a replay check that a backend behaves
+ * the same as the recorded one.
+ */
+
+#define REC_MAGIC "SETTRACE 1"
+
+enum {
+    REC_KEY,            /* length, then the bytes of the key */
+    REC_CREATE,         /* set */
+    REC_DESTROY,        /* set */
+    REC_SIZE,           /* set, size */
+    REC_ADD,            /* set, key */
+    REC_CONTAINS,       /* set, key, result */
+    REC_UNION,          /* a, b, size of a, size of b, result set, result size */
+    REC_INTERSECTION,   /* a, b, size of a, size of b, result set, result size */
+    REC_DIFFERENCE,     /* a, b, size of a, size of b, result set, result size */
+    REC_COPY,           /* set, result set, size */
+    REC_CREATEITER,     /* set, iter */
+    REC_DESTROYITER,    /* iter */
+    REC_HASNEXT,        /* iter, result */
+    REC_NEXT,           /* iter, key */
+    REC_NUM_OPS
+};
+
+/*
+ * Starts recording the calls on sets created from now on to the given
+ * file.  cmpname names the comparison function the sets are created
+ * with, eg. "strcasecmp".  Returns 0 if the file could not be created.
+ */
+int set_record_start(char *filename, char *cmpname);
+
+/*
+ * Stops recording and closes the trace file.  Sets created while
+ * recording remain usable, but are no longer logged.  Does nothing if
+ * not recording.  Returns 0 if the trace could not be written.
+ */
+int set_record_stop(void);
+
+#endif
@@ -0,0 +1,447 @@
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "set_impl.h"
+#include "instrument.h"
+
+/*
+ * A skip list that many threads can add to and search at once.
+ *
+ * An element is added by linking a new node into the bottom level with
+ * a compare-and-swap, which makes it part of the set, and then into
+ * each level above it the same way.  A failed swap means another thread
+ * changed the list there, and the search for the node's neighbours is
+ * redone.  Lookups and iteration only follow pointers, so they never
+ * wait for or retry because of other threads.  Iterators return the
+ * elements in order, including every element that was in the set when
+ * the iterator was set up, and perhaps some that were added since.
+ *
+ * Sets never lose elements, so a node is never unlinked while the set
+ * is in use, and nothing can be freed under a concurrent reader.  The
+ * only node freed early is one that lost the race to add an equal
+ * element, and no other thread has seen it.  The nodes go with the set
+ * in skipset_destroy(), which must not run concurrently with anything.
+ *
+ * The other operations are safe to run on operands that other threads
+ * are adding to, and build their results without synchronization.
+ */
+#define MAX_LEVEL 32
+
+typedef struct node node_t;
+
+struct node {
+    void *elem;
+    int height;
+    _Atomic(node_t *) next[];
+};
+
+struct set {
+    const set_ops_t *ops;
+    cmpfunc_t cmpfunc;
+    node_t *head;
+    atomic_int height;
+    atomic_int size;
+};
+
+/* The iteration state: the node of the next element */
+typedef struct skipiter {
+    node_t *node;
+} skipiter_t;
+
+ITER_STATE_CHECK(skipiter_t);
+
+#define STATE(iter) ITER_STATE(skipiter_t, iter)
+
+/* Gives each thread its own sequence of random node heights */
+static atomic_ullong seeds;
+static _Thread_local unsigned long long seed;
+
+/*
+ * Returns a random node height, i with probability 2^-i.
+ */
+static int randomheight(void) {
+    int height = 1;
+
+    if (seed == 0)
+        seed = (atomic_fetch_add(&seeds, 1) + 1) * 0x9e3779b97f4a7c15ULL;
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    while (height < MAX_LEVEL && (seed >> (height - 1) & 1))
+        height++;
+    return height;
+}
+
+/*
+ * Allocates an unlinked node of the given height.
+ */
+static node_t *newnode(void *elem, int height) {
+    node_t *node = malloc(sizeof(node_t) + height * sizeof(_Atomic(node_t *)));
+    int i;
+
+    if (node == NULL)
+        return NULL;
+    node->elem = elem;
+    node->height = height;
+    for (i = 0; i < height; i++)
+        atomic_init(&node->next[i], NULL);
+    return node;
+}
+
+static node_t *load(node_t *node, int level) {
+    return atomic_load_explicit(&node->next[level], memory_order_acquire);
+}
+
+/*
+ * Looks for the given element in the given set.  Stores the last node
+ * before elem and the first node at or after it on every level in
+ * preds and succs, and returns the node holding elem, or NULL.
+ */
+static node_t *find(set_t *set, void *elem, node_t **preds, node_t **succs) {
+    node_t *pred = set->head, *cur = NULL;
+    int level, top = atomic_load_explicit(&set->height, memory_order_acquire);
+
+    for (level = MAX_LEVEL - 1; level >= top; level--) {
+        preds[level] = pred;
+        succs[level] = NULL;
+    }
+    for (; level >= 0; level--) {
+        cur = load(pred, level);
+        while (cur != NULL && set->cmpfunc(cur->elem, elem) < 0) {
+            pred = cur;
+            cur = load(cur, level);
+        }
+        preds[level] = pred;
+        succs[level] = cur;
+    }
+
+    if (cur != NULL && set->cmpfunc(cur->elem, elem) == 0)
+        return cur;
+    return NULL;
+}
+
+/*
+ * Links the given node after pred on the given level, if succ still
+ * follows pred there.  Returns 1 on success, or 0 if not.
+ */
+static int linknode(node_t *pred, node_t *succ, node_t *node, int level) {
+    atomic_store_explicit(&node->next[level], succ, memory_order_relaxed);
+    return atomic_compare_exchange_strong_explicit(&pred->next[level], &succ, node,
+                                                   memory_order_release,
+                                                   memory_order_relaxed);
+}
+
+/*
+ * Creates a new set using the given comparison function
+ * to compare elements of the set.
+ */
+static set_t *skipset_create(cmpfunc_t cmpfunc) {
+    set_t *set = malloc(sizeof(set_t));
+
+    if (set == NULL)
+        return NULL;
+
+    set->head = newnode(NULL, MAX_LEVEL);
+    if (set->head == NULL) {
+        free(set);
+        return NULL;
+    }
+    set->ops = &skipset_ops;
+    set->cmpfunc = cmpfunc;
+    atomic_init(&set->height, 1);
+    atomic_init(&set->size, 0);
+
+    return set;
+}
+
+/*
+ * Destroys the given set.  Subsequently accessing the set
+ * will lead to undefined behavior.
+ */
+static void skipset_destroy(set_t *set) {
+    node_t *node = set->head, *next;
+
+    while (node != NULL) {
+        next = atomic_load_explicit(&node->next[0], memory_order_relaxed);
+        free(node);
+        node = next;
+    }
+    free(set);
+}
+
+/*
+ * Returns the size (cardinality) of the given set.
+ */
+static int skipset_size(set_t *set) {
+    return atomic_load_explicit(&set->size, memory_order_relaxed);
+}
+
+/*
+ * Adds the given element to the given set.
+ */
+static void skipset_add(set_t *set, void *elem) {
+    node_t *preds[MAX_LEVEL], *succs[MAX_LEVEL], *node = NULL;
+    int level, top, height = randomheight();
+
+    /* Linking the bottom level adds the element */
+    for (;;) {
+        if (find(set, elem, preds, succs) != NULL) {
+            free(node);
+            return;
+        }
+        if (node == NULL && (node = newnode(elem, height)) == NULL)
+            return;
+        if (linknode(preds[0], succs[0], node, 0))
+            break;
+    }
+    atomic_fetch_add_explicit(&set->size, 1, memory_order_relaxed);
+
+    top = atomic_load_explicit(&set->height, memory_order_relaxed);
+    while (top < height && !atomic_compare_exchange_weak(&set->height, &top, height))
+        ;
+
+    /* The levels above only speed up searches */
+    for (level = 1; level < height; level++) {
+        while (!linknode(preds[level], succs[level], node, level))
+            find(set, elem, preds, succs);
+    }
+}
+
+/*
+ * Returns 1 if the given element is contained in
+ * the given set, 0 otherwise.
+ */
+static int skipset_contains(set_t *set, void *elem) {
+    node_t *pred = set->head, *cur;
+    int level = atomic_load_explicit(&set->height, memory_order_acquire), cmp;
+
+    while (--level >= 0) {
+        for (cur = load(pred, level); cur != NULL; cur = load(cur, level)) {
+            cmp = set->cmpfunc(cur->elem, elem);
+            if (cmp == 0)
+                return 1;
+            if (cmp > 0)
+                break;
+            pred = cur;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Appends a node holding the given element to the given set, which no
+ * other thread can see yet.  tails holds the last node on each level.
+ * Returns 0 if out of memory.
+ */
+static int append(set_t *set, node_t **tails, void *elem) {
+    node_t *node = newnode(elem, randomheight());
+    int level;
+
+    if (node == NULL)
+        return 0;
+    for (level = 0; level < node->height; level++) {
+        atomic_store_explicit(&tails[level]->next[level], node, memory_order_relaxed);
+        tails[level] = node;
+    }
+    if (node->height > atomic_load_explicit(&set->height, memory_order_relaxed))
+        atomic_store_explicit(&set->height, node->height, memory_order_relaxed);
+    atomic_fetch_add_explicit(&set->size, 1, memory_order_relaxed);
+    return 1;
+}
+
+/*
+ * Returns an empty set with the given set's comparison function, and
+ * points every entry of tails at its head.
+ */
+static set_t *emptycopy(set_t *set, node_t **tails) {
+    set_t *copy = skipset_create(set->cmpfunc);
+    int level;
+
+    if (copy != NULL) {
+        for (level = 0; level < MAX_LEVEL; level++)
+            tails[level] = copy->head;
+    }
+    return copy;
+}
+
+/*
+ * The operations that merge two sets.
+ */
+enum { UNION, INTERSECTION, DIFFERENCE };
+
+/*
+ * Returns a new set with the union, intersection or difference of a
+ * and b, built by walking the bottom levels of both once.  Elements
+ * that are in both sets are taken from a.
+ */
+static set_t *merge(int op, set_t *a, set_t *b) {
+    node_t *tails[MAX_LEVEL], *tmp_a, *tmp_b, *from;
+    set_t *set = emptycopy(a, tails);
+    int cmp;
+
+    if (set == NULL)
+        return NULL;
+
+    tmp_a = load(a->head, 0);
+    tmp_b = load(b->head, 0);
+
+    while (tmp_a != NULL || (tmp_b != NULL && op == UNION)) {
+        if (tmp_a == NULL)
+            cmp = 1;
+        else if (tmp_b == NULL)
+            cmp = -1;
+        else
+            cmp = set->cmpfunc(tmp_a->elem, tmp_b->elem);
+
+        /* Only in a, only in b, or in both */
+        if (cmp < 0) {
+            from = op != INTERSECTION ? tmp_a : NULL;
+            tmp_a = load(tmp_a, 0);
+        } else if (cmp > 0) {
+            from = op == UNION ? tmp_b : NULL;
+            tmp_b = load(tmp_b, 0);
+        } else {
+            from = op != DIFFERENCE ? tmp_a : NULL;
+            tmp_a = load(tmp_a, 0);
+            tmp_b = load(tmp_b, 0);
+        }
+
+        if (from != NULL && !append(set, tails, from->elem)) {
+            skipset_destroy(set);
+            return NULL;
+        }
+    }
+
+    return set;
+}
+
+/*
+ * Returns the union of the two given sets; the returned
+ * set contains all elements that are contained in either
+ * a or b.
+ */
+static set_t *skipset_union(set_t *a, set_t *b) {
+    return merge(UNION, a, b);
+}
+
+/*
+ * Returns the intersection of the two given sets; the
+ * returned set contains all elements that are contained
+ * in both a and b.
+ */
+static set_t *skipset_intersection(set_t *a, set_t *b) {
+    return merge(INTERSECTION, a, b);
+}
+
+/*
+ * Returns the set difference of the two given sets; the
+ * returned set contains all elements that are contained
+ * in a and not in b.
+ */
+static set_t *skipset_difference(set_t *a, set_t *b) {
+    return merge(DIFFERENCE, a, b);
+}
+
+/*
+ * Returns a copy of the given set.
+ */
+static set_t *skipset_copy(set_t *set) {
+    node_t *tails[MAX_LEVEL], *tmp;
+    set_t *copy = emptycopy(set, tails);
+
+    if (copy == NULL)
+        return NULL;
+
+    for (tmp = load(set->head, 0); tmp != NULL; tmp = load(tmp, 0)) {
+        if (!append(copy, tails, tmp->elem)) {
+            skipset_destroy(copy);
+            return NULL;
+        }
+    }
+
+    return copy;
+}
+
+/*
+ * Sets up the given iterator for iterating over the given set.
+ */
+static void skipset_iterinit(set_iter_t *iter, set_t *set) {
+    iter->ops = &skipset_ops;
+    STATE(iter)->node = load(set->head, 0);
+}
+
+/*
+ * Creates a new set iterator for iterating over the given set.
+ */
+static set_iter_t *skipset_createiter(set_t *set) {
+    set_iter_t *iter = malloc(sizeof(set_iter_t));
+
+    if (iter == NULL)
+        return NULL;
+
+    skipset_iterinit(iter, set);
+
+    return iter;
+}
+
+/*
+ * Destroys the given set iterator.
+ */
+static void skipset_destroyiter(set_iter_t *iter) {
+    free(iter);
+}
+
+/*
+ * Returns 0 if the given set iterator has reached the end of the
+ * set, or 1 otherwise.
+ */
+static int skipset_hasnext(set_iter_t *iter) {
+    return STATE(iter)->node != NULL;
+}
+
+/*
+ * Returns the next element in the sequence represented by the given
+ * set iterator.
+ */
+static void *skipset_next(set_iter_t *iter) {
+    node_t *node = STATE(iter)->node;
+
+    if (node == NULL)
+        return NULL;
+    STATE(iter)->node = load(node, 0);
+    return node->elem;
+}
+
+/*
+ * Copies up to max of the next elements of the given iterator to buf.
+ */
+static int skipset_nextbatch(set_iter_t *iter, void **buf, int max) {
+    node_t *node = STATE(iter)->node;
+    int n = 0;
+
+    while (n < max && node != NULL) {
+        buf[n++] = node->elem;
+        node = load(node, 0);
+    }
+    STATE(iter)->node = node;
+    return n;
+}
+
+const set_ops_t skipset_ops = {
+    "skiplist",
+    skipset_create,
+    skipset_destroy,
+    skipset_size,
+    skipset_add,
+    skipset_contains,
+    skipset_union,
+    skipset_intersection,
+    skipset_difference,
+    skipset_copy,
+    skipset_createiter,
+    skipset_iterinit,
+    skipset_destroyiter,
+    skipset_hasnext,
+    skipset_next,
+    skipset_nextbatch,
+};
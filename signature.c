@@ -0,0 +1,140 @@
+#include <stdlib.h>
+
+#include "signature.h"
+
+/*
+ * The vocabulary is kept as a sorted array of words, with a parallel
+ * array of model masks.  The index of a word is its id.
+ */
+struct signature {
+    cmpfunc_t cmpfunc;
+    void **words;
+    unsigned long long *masks;
+    int size;
+    int nmodels;
+};
+
+signature_t *signature_create(cmpfunc_t cmpfunc) {
+    signature_t *sig = malloc(sizeof(signature_t));
+
+    if (sig == NULL)
+        return NULL;
+
+    sig->cmpfunc = cmpfunc;
+    sig->words = NULL;
+    sig->masks = NULL;
+    sig->size = 0;
+    sig->nmodels = 0;
+
+    return sig;
+}
+
+void signature_destroy(signature_t *sig) {
+    free(sig->words);
+    free(sig->masks);
+    free(sig);
+}
+
+int signature_addmodel(signature_t *sig, set_t *words) {
+    unsigned long long bit;
+    unsigned long long *masks;
+    void **merged, **elems;
+    set_iter_t *iter;
+    int pos, i, j, n, nelems, got;
+
+    if (sig->nmodels == MAX_MODELS)
+        return -1;
+
+    nelems = set_size(words);
+    n = sig->size + nelems;
+    merged = malloc(sizeof(void *) * (n > 0 ? n : 1));
+    masks = malloc(sizeof(unsigned long long) * (n > 0 ? n : 1));
+    elems = malloc(sizeof(void *) * (nelems > 0 ? nelems : 1));
+    iter = set_createiter(words);
+    if (merged == NULL || masks == NULL || elems == NULL || iter == NULL) {
+        free(merged);
+        free(masks);
+        free(elems);
+        if (iter != NULL)
+            set_destroyiter(iter);
+        return -1;
+    }
+
+    /* Copy out the sorted set, in as few batches as it takes. */
+    for (j = 0; j < nelems; j += got) {
+        if ((got = set_next_batch(iter, elems + j, nelems - j)) == 0)
+            break;
+    }
+    nelems = j;
+    set_destroyiter(iter);
+
+    /* Merge the sorted vocabulary with the sorted set. */
+    bit = 1ULL << sig->nmodels;
+    pos = 0;
+    i = 0;
+    j = 0;
+    while (i < sig->size || j < nelems) {
+        int cmp;
+
+        if (j == nelems)
+            cmp = -1;
+        else if (i == sig->size)
+            cmp = 1;
+        else
+            cmp = sig->cmpfunc(sig->words[i], elems[j]);
+
+        if (cmp < 0) {
+            merged[pos] = sig->words[i];
+            masks[pos] = sig->masks[i];
+            i++;
+        } else if (cmp == 0) {
+            merged[pos] = sig->words[i];
+            masks[pos] = sig->masks[i] | bit;
+            i++;
+            j++;
+        } else {
+            merged[pos] = elems[j];
+            masks[pos] = bit;
+            j++;
+        }
+        pos++;
+    }
+    free(elems);
+
+    free(sig->words);
+    free(sig->masks);
+    sig->words = merged;
+    sig->masks = masks;
+    sig->size = pos;
+
+    return sig->nmodels++;
+}
+
+int signature_nmodels(signature_t *sig) {
+    return sig->nmodels;
+}
+
+int signature_nwords(signature_t *sig) {
+    return sig->size;
+}
+
+int signature_lookup(signature_t *sig, void *word, unsigned long long *mask) {
+    int lo = 0, hi = sig->size - 1;
+
+    /* Binary search in the sorted vocabulary. */
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = sig->cmpfunc(word, sig->words[mid]);
+
+        if (cmp == 0) {
+            *mask = sig->masks[mid];
+            return mid;
+        } else if (cmp < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,61 @@
+#ifndef SIGNATURE_H
+#define SIGNATURE_H
+
+#include "common.h"
+#include "set.h"
+
+/*
+ * The maximum number of models in a signature.
+ */
+#define MAX_MODELS 64
+
+/*
+ * The type of multi-model signatures.  A signature combines the word
+ * sets of several spam models into one vocabulary, so that a word can
+ * be checked against all models with a single lookup.  Every word in
+ * the vocabulary has an interned id, and a bitmask with bit i set if
+ * the word is in the signature of model i.
+ */
+struct signature;
+typedef struct signature signature_t;
+
+/*
+ * Creates a new, empty signature using the given comparison function
+ * to compare words.
+ */
+signature_t *signature_create(cmpfunc_t cmpfunc);
+
+/*
+ * Destroys the given signature.  The words themselves are not freed.
+ */
+void signature_destroy(signature_t *sig);
+
+/*
+ * Adds the given set of words as the signature of a new model.  The
+ * set must use the same ordering as the signature, and its elements
+ * must outlive the signature.
+ *
+ * Returns the index of the new model, or -1 if the operation failed.
+ * Word ids assigned before the call are not preserved.
+ */
+int signature_addmodel(signature_t *sig, set_t *words);
+
+/*
+ * Returns the number of models in the given signature.
+ */
+int signature_nmodels(signature_t *sig);
+
+/*
+ * Returns the number of distinct words in the given signature.  Word
+ * ids are in the range 0 to signature_nwords(sig)-1.
+ */
+int signature_nwords(signature_t *sig);
+
+/*
+ * Looks up the given word.  Returns its id and stores the bitmask of
+ * the models that contain it in *mask, or returns -1 if no model
+ * contains the word.
+ */
+int signature_lookup(signature_t *sig, void *word, unsigned long long *mask);
+
+#endif
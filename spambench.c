@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "list.h"
+#include "set.h"
+#include "bench.h"
+
+/*
+ * End-to-end benchmark driver for the spam filter.
+ *
+ * Runs spamfilter on a corpus (see gencorpus.c) a number of times for
+ * each selected set backend, and reports the wall-clock time of the
+ * runs along with the classification throughput in MB/s and mails/s,
+ * the peak resident set size, and the time of each phase as reported
+ * by spamfilter -T.
+ */
+
+/* Phases reported by spamfilter -T */
+#define NUM_PHASES 3
+
+static char *phases[NUM_PHASES] = { "find", "train", "classify" };
+
+static char *phase_metrics[NUM_PHASES] = { "find_ms", "train_ms", "classify_ms" };
+
+/* Maximum number of backends in one run */
+#define MAX_BACKENDS 64
+
+/*
+ * Measurements of one run of spamfilter.
+ */
+typedef struct run {
+    unsigned long long elapsed;
+    unsigned long long phases[NUM_PHASES];
+    long maxrss;
+} run_t;
+
+/*
+ * Returns the total size in bytes of the files under the given
+ * directory, and stores their number in *nfiles.
+ */
+static double dirsize(char *dir, int *nfiles) {
+    list_t *files = find_files(dir);
+    list_iter_t *it = list_createiter(files);
+    struct stat st;
+    double bytes = 0;
+    char *path;
+
+    *nfiles = 0;
+    while (list_hasnext(it)) {
+        path = list_next(it);
+        if (stat(path, &st) == 0) {
+            bytes += st.st_size;
+            (*nfiles)++;
+        }
+        free(path);
+    }
+    list_destroyiter(it);
+    list_destroy(files);
+    return bytes;
+}
+
+/*
+ * Reads the phase times that spamfilter writes to the given file, and
+ * passes any other output on to stderr.
+ */
+static void readphases(FILE *f, run_t *run) {
+    char line[256], name[64];
+    double seconds;
+    int i;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "phase %63s %lf", name, &seconds) != 2) {
+            fputs(line, stderr);
+            continue;
+        }
+        for (i = 0; i < NUM_PHASES; i++) {
+            if (strcmp(name, phases[i]) == 0)
+                run->phases[i] = (unsigned long long) (seconds * 1e9);
+        }
+    }
+}
+
+/*
+ * Runs the given spamfilter command once with stdout discarded.
+ */
+static void runonce(char **args, run_t *run) {
+    struct rusage usage;
+    int fds[2], status, devnull;
+    unsigned long long start;
+    pid_t pid;
+    FILE *f;
+
+    memset(run, 0, sizeof(run_t));
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        fatal_error("pipe() failed");
+    }
+
+    start = bench_now();
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        fatal_error("fork() failed");
+    }
+    if (pid == 0) {
+        devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0)
+            dup2(devnull, STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(args[0], args);
+        perror(args[0]);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    f = fdopen(fds[0], "r");
+    if (f == NULL)
+        fatal_error("fdopen() failed");
+    readphases(f, run);
+    fclose(f);
+
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        fatal_error("wait4() failed");
+    }
+    run->elapsed = bench_now() - start;
+    run->maxrss = usage.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fatal_error("spamfilter failed");
+}
+
+static void usage(char *prog) {
+    fprintf(stderr,
+            "usage: %s [-x spamfilter] [-b backends] [-r runs] [-t threshold]\n"
+            "          [-f csv|json] <corpusdir>\n"
+            "  -x: the spamfilter program to run (default ./spamfilter)\n"
+            "  -b: comma-separated list of set backends, or all (default array)\n"
+            "  -r: number of runs per backend (default 3)\n"
+            "  -t: run spamfilter in verdict-only mode with this threshold\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    char *program = "./spamfilter", *threshold = NULL, *root, *dirs[3];
+    const set_ops_t *backends[MAX_BACKENDS];
+    char *args[16];
+    int runs = 3, format = BENCH_CSV, nbackends = 0, nmails, nfiles;
+    int opt, i, k, p, nargs;
+    double mailbytes, totalbytes;
+    unsigned long long *samples;
+    bench_report_t *report;
+    bench_stats_t stats;
+    run_t *results;
+    long maxrss;
+
+    while ((opt = getopt(argc, argv, "x:b:r:t:f:")) != -1) {
+        switch (opt) {
+        case 'x':
+            program = optarg;
+            break;
+        case 'b':
+            if ((nbackends = set_selectbackends(optarg, backends, nbackends, MAX_BACKENDS)) < 0)
+                usage(argv[0]);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 't':
+            threshold = optarg;
+            break;
+        case 'f':
+            if ((format = bench_format(optarg)) < 0)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || runs < 1)
+        usage(argv[0]);
+    if (nbackends == 0)
+        backends[nbackends++] = set_findbackend("array");
+    root = argv[optind];
+
+    /* The corpus directories, in the order spamfilter takes them */
+    for (i = 0; i < 3; i++) {
+        dirs[i] = malloc(strlen(root) + 16);
+        if (dirs[i] == NULL)
+            fatal_error("out of memory");
+        sprintf(dirs[i], "%s/%s", root, i == 0 ? "spam" : i == 1 ? "nonspam" : "mail");
+    }
+    totalbytes = dirsize(dirs[0], &nfiles) + dirsize(dirs[1], &nfiles);
+    mailbytes = dirsize(dirs[2], &nmails);
+    totalbytes += mailbytes;
+    if (nmails == 0)
+        fatal_error("no mails to classify");
+
+    results = malloc(sizeof(run_t) * runs);
+    samples = malloc(sizeof(unsigned long long) * runs);
+    report = bench_report_create(stdout, format);
+    if (results == NULL || samples == NULL || report == NULL)
+        fatal_error("out of memory");
+
+    for (k = 0; k < nbackends; k++) {
+        bench_row_t row;
+
+        nargs = 0;
+        args[nargs++] = program;
+        args[nargs++] = "-T";
+        args[nargs++] = "-b";
+        args[nargs++] = set_backendname(backends[k]);
+        if (threshold != NULL) {
+            args[nargs++] = "-t";
+            args[nargs++] = threshold;
+        }
+        for (i = 0; i < 3; i++)
+            args[nargs++] = dirs[i];
+        args[nargs] = NULL;
+
+        for (i = 0; i < runs; i++)
+            runonce(args, &results[i]);
+
+        memset(&row, 0, sizeof(row));
+        row.suite = "spamfilter";
+        row.backend = set_backendname(backends[k]);
+        row.op = threshold != NULL ? "verdict" : "classify";
+        row.input = root;
+        row.n = nmails;
+
+        maxrss = 0;
+        for (i = 0; i < runs; i++) {
+            samples[i] = results[i].elapsed;
+            if (results[i].maxrss > maxrss)
+                maxrss = results[i].maxrss;
+        }
+        bench_summarize(samples, runs, &row.stats);
+
+        /* Throughput is taken over the median time of the classify phase */
+        for (p = 0; p < NUM_PHASES; p++) {
+            for (i = 0; i < runs; i++)
+                samples[i] = results[i].phases[p];
+            bench_summarize(samples, runs, &stats);
+            bench_metric(&row, phase_metrics[p], stats.median / 1e6);
+        }
+        bench_metric(&row, "mb_per_s",
+                     stats.median > 0 ? mailbytes / 1e6 / (stats.median / 1e9) : 0);
+        bench_metric(&row, "mails_per_s",
+                     stats.median > 0 ? nmails / (stats.median / 1e9) : 0);
+        bench_metric(&row, "total_mb_per_s",
+                     totalbytes / 1e6 / (row.stats.median / 1e9));
+        bench_metric(&row, "peak_rss_kb", maxrss);
+        bench_report_row(report, &row);
+    }
+
+    bench_report_destroy(report);
+    for (i = 0; i < 3; i++)
+        free(dirs[i]);
+    free(results);
+    free(samples);
+    return 0;
+}
@@ -2,8 +2,15 @@
 #include "list.h"
 #include "set.h"
 #include "common.h"
+#include "mime.h"
+#include "signature.h"
+#include "trace.h"
+#include "set_record.h"
+#include "hist.h"
 
-#include <sys/time.h>
+#include <time.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 /*
  * Case-insensitive comparison function for strings.
@@ -13,6 +20,27 @@ static int compare_words(void *a, void *b)
     return strcasecmp(a, b);
 }
 
+/*
+ * Returns the time of the monotonic clock in seconds.
+ */
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Records the time since start, in nanoseconds, as the latency of one
+ * mail, if latencies are recorded.
+ */
+static void lap(hist_t *latency, double start)
+{
+	if (latency != NULL)
+		hist_record(latency, (unsigned long long) ((now() - start) * 1e9));
+}
+
 /*
  * Returns the set of (unique) words found in the given file.
  */
@@ -20,25 +48,90 @@ static set_t *tokenize(char *filename)
 {
 	set_t *wordset = set_create(compare_words);
 	list_t *wordlist = list_create(compare_words);
-	list_iter_t *it;
+	char *word;
 	FILE *f;
+	TRACE_BEGIN(t);
 	
 	f = fopen(filename, "r");
 	if (f == NULL) {
 		perror("fopen");
 		fatal_error("fopen() failed");
 	}
-	tokenize_file(f, wordlist);
+	tokenize_mail(f, wordlist);
+	fclose(f);
+	TRACE_END(t, "tokenize", filename);
 	
-	it = list_createiter(wordlist);
-	while (list_hasnext(it)) {
-		set_add(wordset, list_next(it));		
+	TRACE_BEGIN(a);
+	LIST_FOREACH(word, wordlist) {
+		set_add(wordset, word);
 	}
-	list_destroyiter(it);
 	list_destroy(wordlist);
+	TRACE_END(a, "set_add", filename);
 	return wordset;
 }
 
+/*
+ * State of an early-exit classification of one mail.
+ */
+typedef struct verdict {
+	set_t *signature;
+	set_t *hits;
+	int threshold;
+} verdict_t;
+
+/*
+ * Word callback for classify().  Records the distinct signature words
+ * seen so far, and stops the scan once the threshold has been reached.
+ */
+static int checkword(char *word, void *arg)
+{
+	verdict_t *v = arg;
+	char *copy;
+
+	if (set_contains(v->signature, word) && !set_contains(v->hits, word)) {
+		copy = strdup(word);
+		if (copy == NULL)
+			fatal_error("out of memory");
+		set_add(v->hits, copy);
+	}
+	return set_size(v->hits) < v->threshold;
+}
+
+/*
+ * Counts the distinct signature words in the given mail file, but stops
+ * reading as soon as threshold of them have been seen.  The returned
+ * count is therefore only exact if it is below the threshold.
+ */
+static int classify(char *filename, set_t *signature, int threshold)
+{
+	verdict_t v;
+	set_iter_t *it;
+	FILE *f;
+	int count;
+
+	f = fopen(filename, "r");
+	if (f == NULL) {
+		perror("fopen");
+		fatal_error("fopen() failed");
+	}
+	v.signature = signature;
+	v.hits = set_create(compare_words);
+	v.threshold = threshold;
+	TRACE_BEGIN(t);
+	scan_mail(f, checkword, &v);
+	TRACE_END(t, "scan", filename);
+	fclose(f);
+
+	count = set_size(v.hits);
+	it = set_createiter(v.hits);
+	while (set_hasnext(it)) {
+		free(set_next(it));
+	}
+	set_destroyiter(it);
+	set_destroy(v.hits);
+	return count;
+}
+
 /*
  * Prints a set of words.
  */
@@ -56,43 +149,38 @@ static void printwords(char *prefix, set_t *words)
 }
 
 /*
- * Main entry point.
+ * Builds the signature of a spam model: the words that occur in every
+ * spam mail under spamdir, but in none of the mails under nonspamdir.
  */
-int main(int argc, char **argv)
+static set_t *train(char *spamdir, char *nonspamdir)
 {
-	char *spamdir, *nonspamdir, *maildir;
-	
-	if (argc != 4) {
-		fprintf(stderr, "usage: %s <spamdir> <nonspamdir> <maildir>\n",
-				argv[0]);
-		return 1;
-	}
-	spamdir = argv[1];
-	nonspamdir = argv[2];
-	maildir = argv[3];
-
-	set_t *spam_set = set_create(compare_words);
+	set_t *spam_set;
 	set_t *non_spam_set = set_create(compare_words);
-	set_t *mail_set = set_create(compare_words);
 
-	if (spam_set == NULL || non_spam_set == NULL || mail_set == NULL)
-	    return -1;
+	if (non_spam_set == NULL)
+	    fatal_error("out of memory");
 
+	TRACE_BEGIN(f);
 	list_t *spam_files = find_files(spamdir);
 	list_t *non_spam_files = find_files(nonspamdir);
-	list_t *mail_files = find_files(maildir);
-	list_sort(mail_files);
+	TRACE_END(f, "find", spamdir);
+
+	if (list_size(spam_files) == 0)
+	    fatal_error("no spam mails to train on");
 
 	list_iter_t *spam_iter = list_createiter(spam_files);
 	list_iter_t *non_spam_iter = list_createiter(non_spam_files);
-	list_iter_t *mail_iter = list_createiter(mail_files);
 
 	set_t *spam_prev = tokenize(list_next(spam_iter));
+	spam_set = spam_prev;
 
     // add all spam words to a set
 	while (list_hasnext(spam_iter)) {
-	    set_t *spam = tokenize(list_next(spam_iter));
+	    char *filename = list_next(spam_iter);
+	    set_t *spam = tokenize(filename);
+	    TRACE_BEGIN(t);
 	    spam_set = set_intersection(spam_prev, spam);
+	    TRACE_END(t, "set_intersection", filename);
 	    spam_prev = spam_set;
 	}
 	list_destroyiter(spam_iter);
@@ -100,37 +188,332 @@ int main(int argc, char **argv)
 
     // add all non spam words to a set
     while (list_hasnext(non_spam_iter)) {
-	    non_spam_set = set_union(non_spam_set, tokenize(list_next(non_spam_iter)));
+	    char *filename = list_next(non_spam_iter);
+	    set_t *non_spam = tokenize(filename);
+	    TRACE_BEGIN(t);
+	    non_spam_set = set_union(non_spam_set, non_spam);
+	    TRACE_END(t, "set_union", filename);
 	}
     list_destroyiter(non_spam_iter);
     list_destroy(non_spam_files);
 
+    // the signature is the set of spam words that never occur in non spam
+    TRACE_BEGIN(t);
+    set_t *signature = set_difference(spam_set, non_spam_set);
+    TRACE_END(t, "set_difference", NULL);
+    return signature;
+}
+
+/*
+ * State of the classification of one mail against several models.
+ */
+typedef struct match {
+	signature_t *signature;
+	int *seen;
+	int mailno;
+	int counts[MAX_MODELS];
+	int threshold;
+	int undecided;
+	int early;
+} match_t;
+
+/*
+ * Word callback for classify_models().  Each word is looked up once in
+ * the shared signature, and counted for every model whose signature
+ * contains it.  seen[] holds, per word id, the number of the last mail
+ * the word was counted for, so repeated words are only counted once.
+ */
+static int matchword(char *word, void *arg)
+{
+	match_t *m = arg;
+	unsigned long long mask;
+	int id, i;
+
+	id = signature_lookup(m->signature, word, &mask);
+	if (id < 0 || m->seen[id] == m->mailno)
+		return 1;
+	m->seen[id] = m->mailno;
+	for (i = 0; mask != 0; i++, mask >>= 1) {
+		if ((mask & 1) && ++m->counts[i] == m->threshold)
+			m->undecided--;
+	}
+	return !m->early || m->undecided > 0;
+}
+
+/*
+ * Classifies each of the given mails against all models of the given
+ * signature, reading every mail only once.  With early set, a mail is
+ * only read until every model has reached the threshold.  The time
+ * taken per mail is recorded in latency, unless it is NULL.
+ */
+static void classify_models(list_t *mail_files, signature_t *signature,
+							int threshold, int early, hist_t *latency)
+{
+	match_t m;
+	list_iter_t *it;
+	FILE *f;
+	int i, nmodels = signature_nmodels(signature);
+
+	m.signature = signature;
+	m.seen = calloc(signature_nwords(signature) + 1, sizeof(int));
+	if (m.seen == NULL)
+		fatal_error("out of memory");
+	m.mailno = 0;
+	m.threshold = threshold;
+	m.early = early;
+
+	it = list_createiter(mail_files);
+	while (list_hasnext(it)) {
+		char *filename = list_next(it);
+		double start = now();
+
+		f = fopen(filename, "r");
+		if (f == NULL) {
+			perror("fopen");
+			fatal_error("fopen() failed");
+		}
+		m.mailno++;
+		m.undecided = nmodels;
+		memset(m.counts, 0, sizeof(m.counts));
+		TRACE_BEGIN(t);
+		scan_mail(f, matchword, &m);
+		TRACE_END(t, "scan", filename);
+		fclose(f);
+		lap(latency, start);
+
+		for (i = 0; i < nmodels; i++) {
+			char *message = m.counts[i] >= threshold ? "SPAM" : "Not spam";
+			if (early)
+				printf("%s: model %d -> %s\n", filename, i + 1, message);
+			else
+				printf("%s: model %d: %d spam word(s) -> %s\n",
+					   filename, i + 1, m.counts[i], message);
+		}
+	}
+	list_destroyiter(it);
+	free(m.seen);
+}
+
+/*
+ * Prints the time spent in a phase to stderr if timing is enabled, and
+ * returns the start time of the next phase.
+ */
+static double phase(int timing, char *name, double start)
+{
+	double end = now();
+
+	if (timing)
+		fprintf(stderr, "phase %s %.6f\n", name, end - start);
+	return end;
+}
+
+/*
+ * Prints a summary of the per-mail latencies to stderr and writes the
+ * full histogram to the given file, if latencies were recorded.
+ */
+static void report(hist_t *latency, char *latencyfile)
+{
+	FILE *f;
+
+	if (latency == NULL)
+		return;
+	fprintf(stderr, "latency ");
+	hist_summary(latency, stderr);
+	f = fopen(latencyfile, "w");
+	if (f == NULL) {
+		perror(latencyfile);
+		fatal_error("fopen() failed");
+	}
+	hist_export(latency, f, "classify", 1);
+	fclose(f);
+	hist_destroy(latency);
+}
+
+/*
+ * Finishes the set recording, if any, and writes the recorded trace
+ * spans to the given file, if one was given.
+ */
+static void finish(char *tracefile)
+{
+	if (!set_record_stop())
+		fatal_error("set_record_stop() failed");
+	if (tracefile == NULL)
+		return;
+#ifdef TRACE
+	if (!trace_write(tracefile)) {
+		perror(tracefile);
+		fatal_error("trace_write() failed");
+	}
+#else
+	fprintf(stderr, "warning: tracing is not compiled in; build spamfilter-trace\n");
+#endif
+}
+
+/*
+ * Main entry point.
+ */
+int main(int argc, char **argv)
+{
+	char *maildir, *tracefile = NULL, *recordfile = NULL, *latencyfile = NULL;
+	int threshold = 1, verdict_only = 0, full_count = 0, timing = 0;
+	int opt, i, nmodels;
+	double start, mailstart;
+	const set_ops_t *ops;
+	hist_t *latency = NULL;
+
+	/*
+	 * -t <n>  Verdict-only mode: a mail is spam if it contains at least n
+	 *         signature words, and is only read until that many are seen.
+	 * -c      Compute and print the full count of signature words even
+	 *         in verdict-only mode.
+	 * -b <b>  Use the set backend named b.
+	 * -T      Print the time spent finding, training and classifying
+	 *         to stderr, as "phase <name> <seconds>" lines.
+	 * -o <f>  Write the trace spans to f as Chrome trace-event JSON
+	 *         (in builds with -DTRACE).
+	 * -R <f>  Record every set operation to f, for replay (see replay.c).
+	 * -l <f>  Record the time taken to classify each mail, print its
+	 *         percentiles to stderr and write the histogram to f as CSV.
+	 *
+	 * Several models may be given as additional <spamdir> <nonspamdir>
+	 * pairs.  Each mail is then tokenized once and classified against
+	 * all of them.
+	 */
+	while ((opt = getopt(argc, argv, "t:cb:To:R:l:")) != -1) {
+		switch (opt) {
+		case 't':
+			threshold = atoi(optarg);
+			verdict_only = 1;
+			break;
+		case 'c':
+			full_count = 1;
+			break;
+		case 'b':
+			ops = set_findbackend(optarg);
+			if (ops == NULL)
+				threshold = 0;
+			else
+				set_usebackend(ops);
+			break;
+		case 'T':
+			timing = 1;
+			break;
+		case 'o':
+			tracefile = optarg;
+			break;
+		case 'R':
+			recordfile = optarg;
+			break;
+		case 'l':
+			latencyfile = optarg;
+			break;
+		default:
+			threshold = 0;
+			break;
+		}
+	}
+	nmodels = (argc - optind - 1) / 2;
+	if ((argc - optind) % 2 != 1 || nmodels < 1 || nmodels > MAX_MODELS ||
+		threshold < 1) {
+		fprintf(stderr, "usage: %s [-b backend] [-t threshold [-c]] [-T] [-o tracefile] [-R recordfile] [-l latencyfile] <spamdir> <nonspamdir> "
+				"[<spamdir> <nonspamdir> ...] <maildir>\n", argv[0]);
+		return 1;
+	}
+	if (full_count)
+		verdict_only = 0;
+	maildir = argv[argc-1];
+	if (recordfile != NULL && !set_record_start(recordfile, "strcasecmp")) {
+		perror(recordfile);
+		fatal_error("set_record_start() failed");
+	}
+	if (latencyfile != NULL) {
+		latency = hist_create();
+		if (latency == NULL)
+			fatal_error("out of memory");
+	}
+
+	start = now();
+	TRACE_BEGIN(find);
+	list_t *mail_files = find_files(maildir);
+	list_sortstrings(mail_files, 0);
+	TRACE_END(find, "find", maildir);
+	start = phase(timing, "find", start);
+
+	if (nmodels > 1) {
+	    signature_t *models = signature_create(compare_words);
+	    if (models == NULL)
+	        fatal_error("out of memory");
+	    for (i = 0; i < nmodels; i++) {
+	        TRACE_BEGIN(t);
+	        set_t *signature = train(argv[optind+2*i], argv[optind+2*i+1]);
+	        if (signature_addmodel(models, signature) < 0)
+	            fatal_error("signature_addmodel() failed");
+	        TRACE_END(t, "train", argv[optind+2*i]);
+	    }
+	    start = phase(timing, "train", start);
+	    TRACE_BEGIN(c);
+	    classify_models(mail_files, models, threshold, verdict_only, latency);
+	    TRACE_END(c, "classify", maildir);
+	    phase(timing, "classify", start);
+	    signature_destroy(models);
+	    list_destroy(mail_files);
+	    report(latency, latencyfile);
+	    finish(tracefile);
+	    return 0;
+	}
+
+	TRACE_BEGIN(t);
+	set_t *signature = train(argv[optind], argv[optind+1]);
+	set_t *mail_set;
+	TRACE_END(t, "train", argv[optind]);
+	start = phase(timing, "train", start);
+	TRACE_BEGIN(c);
+	list_iter_t *mail_iter = list_createiter(mail_files);
+
 	// create one set per email
-    // compare email set with spam and non spam set
+    // compare email set with the signature
     while (list_hasnext(mail_iter)) {
 	    char *filename = list_next(mail_iter);
 	    char *spam = "SPAM";
 	    char *not_spam = "Not spam";
 	    char *message;
+	    int count;
+
+	    mailstart = now();
+	    if (verdict_only) {
+	        count = classify(filename, signature, threshold);
+	        lap(latency, mailstart);
+	        printf("%s: -> %s\n", filename, count >= threshold ? spam : not_spam);
+	        continue;
+	    }
 
 	    mail_set = tokenize(filename);
 
-	    set_t *filter = set_intersection(mail_set, set_difference(spam_set, non_spam_set));
+	    TRACE_BEGIN(x);
+	    set_t *filter = set_intersection(mail_set, signature);
+	    count = set_size(filter);
+	    TRACE_END(x, "set_intersection", filename);
+	    lap(latency, mailstart);
 
-	    if (set_size(filter) == 0) {
+	    if (count < threshold) {
 	        message = not_spam;
 	    }
 	    else {
 	        message = spam;
 	    }
 
-	    printf("%s: %d spam word(s) -> %s\n", filename, set_size(filter), message);
+	    printf("%s: %d spam word(s) -> %s\n", filename, count, message);
 	    set_destroy(filter);
 	}
 
+    TRACE_END(c, "classify", maildir);
+    phase(timing, "classify", start);
+
     // cleanup
     list_destroyiter(mail_iter);
     list_destroy(mail_files);
+    report(latency, latencyfile);
+    finish(tracefile);
 
     return 0;
 }
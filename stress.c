@@ -0,0 +1,699 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "set.h"
+#include "workload.h"
+
+/*
+ * Randomized differential stress test of the set backends.
+ *
+ * A program is a random sequence of operations on NUM_SLOTS sets: add,
+ * contains, fill (add many keys), union, intersection, difference,
+ * copy, iterate and clear.  Each backend runs the program alongside a
+ * reference model, sorted arrays of keys, and every result and size is
+ * checked against the model.  Iteration must yield the keys in
+ * ascending order, as assert_set.c expects.  Since no operation depends
+ * on the state of the sets, any subsequence of a program is a valid
+ * program, which is what makes shrinking possible: when a backend
+ * fails, ops are removed from its program, and fills are made smaller,
+ * for as long as it still fails.  The minimal program is written to
+ * stdout, in a format that -r reads back.
+ *
+ * Every program runs in a child process, so that crashes are caught and
+ * shrunk like wrong answers.
+ */
+
+/* Maximum number of backends in one run */
+#define MAX_BACKENDS 64
+
+/* The number of sets a program works on */
+#define NUM_SLOTS 4
+
+/* Keys below HOT are drawn often, so that small sets overlap */
+#define HOT 64
+
+/*
+ * Keys are stored in the sets as pointer values, offset by one so that
+ * no element is NULL.  The sets never dereference them.
+ */
+#define ELEM(key) ((void *) ((long) (key) + 1))
+#define KEY(elem) ((int) ((long) (elem) - 1))
+
+enum {
+    OP_ADD,
+    OP_CONTAINS,
+    OP_FILL,
+    OP_UNION,
+    OP_INTERSECTION,
+    OP_DIFFERENCE,
+    OP_COPY,
+    OP_ITERATE,
+    OP_CLEAR,
+    NUM_OPS
+};
+
+static char *opnames[] = {
+    "add", "contains", "fill", "union", "intersection", "difference",
+    "copy", "iterate", "clear",
+};
+
+/* The relative frequencies of the operations in random programs */
+static int weights[] = { 25, 20, 4, 8, 8, 8, 5, 8, 3 };
+
+/*
+ * One operation.  add and contains use key; fill adds up to count keys
+ * drawn from [key, key + 2 * count) by a generator seeded with seed.
+ * The binary operations store the result of a and b in dst, copy
+ * stores a copy of a in dst, and the others work on dst.
+ */
+typedef struct op {
+    int kind;
+    int dst, a, b;
+    int key;
+    int count;
+    unsigned long long seed;
+} op_t;
+
+/*
+ * The reference model of a set: its keys in ascending order.
+ */
+typedef struct model {
+    int *keys;
+    int size;
+    int capacity;
+} model_t;
+
+/* Shared with the child, which stores the number of the op it is at */
+static volatile long *progress;
+
+static int compare_keys(void *a, void *b) {
+    long x = (long) a, y = (long) b;
+
+    return (x > y) - (x < y);
+}
+
+static void reserve(model_t *m, int capacity) {
+    if (capacity <= m->capacity)
+        return;
+    if (capacity < 2 * m->capacity)
+        capacity = 2 * m->capacity;
+    m->keys = realloc(m->keys, sizeof(int) * capacity);
+    if (m->keys == NULL)
+        fatal_error("out of memory");
+    m->capacity = capacity;
+}
+
+/*
+ * Returns the position of key in the given model, or the position it
+ * would be inserted at, and stores whether it was found in *found.
+ */
+static int search(model_t *m, int key, int *found) {
+    int low = 0, high = m->size, mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (m->keys[mid] < key)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    *found = low < m->size && m->keys[low] == key;
+    return low;
+}
+
+static void model_add(model_t *m, int key) {
+    int found, i = search(m, key, &found);
+
+    if (found)
+        return;
+    reserve(m, m->size + 1);
+    memmove(m->keys + i + 1, m->keys + i, sizeof(int) * (m->size - i));
+    m->keys[i] = key;
+    m->size++;
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int *) a, y = *(const int *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Sorts the keys of the given model and removes duplicates, which makes
+ * it a valid model.
+ */
+static void model_normalize(model_t *m) {
+    int i, n = 0;
+
+    qsort(m->keys, m->size, sizeof(int), compare_ints);
+    for (i = 0; i < m->size; i++) {
+        if (n == 0 || m->keys[i] != m->keys[n - 1])
+            m->keys[n++] = m->keys[i];
+    }
+    m->size = n;
+}
+
+/*
+ * Stores the union, intersection or difference of a and b in result,
+ * which must be a different model.
+ */
+static void model_merge(int kind, model_t *a, model_t *b, model_t *result) {
+    int i = 0, j = 0, n = 0;
+
+    reserve(result, a->size + b->size);
+    while (i < a->size && j < b->size) {
+        if (a->keys[i] < b->keys[j]) {
+            if (kind != OP_INTERSECTION)
+                result->keys[n++] = a->keys[i];
+            i++;
+        } else if (a->keys[i] > b->keys[j]) {
+            if (kind == OP_UNION)
+                result->keys[n++] = b->keys[j];
+            j++;
+        } else {
+            if (kind != OP_DIFFERENCE)
+                result->keys[n++] = a->keys[i];
+            i++;
+            j++;
+        }
+    }
+    for (; kind != OP_INTERSECTION && i < a->size; i++)
+        result->keys[n++] = a->keys[i];
+    for (; kind == OP_UNION && j < b->size; j++)
+        result->keys[n++] = b->keys[j];
+    result->size = n;
+}
+
+/*
+ * Generates a random program of n ops, with fills of up to maxsize
+ * keys.
+ */
+static op_t *generate(int n, int maxsize, unsigned long long seed) {
+    op_t *prog = malloc(sizeof(op_t) * (n > 0 ? n : 1));
+    workload_rng_t rng;
+    int i, w, total = 0, universe = 2 * maxsize, bits = 0;
+
+    if (prog == NULL)
+        fatal_error("out of memory");
+    for (w = 0; w < NUM_OPS; w++)
+        total += weights[w];
+    while ((1 << (bits + 1)) <= maxsize)
+        bits++;
+    workload_seed(&rng, seed);
+
+    for (i = 0; i < n; i++) {
+        op_t *op = &prog[i];
+        int r = workload_below(&rng, total);
+
+        for (w = 0; r >= weights[w]; w++)
+            r -= weights[w];
+        memset(op, 0, sizeof(op_t));
+        op->kind = w;
+        op->dst = workload_below(&rng, NUM_SLOTS);
+        op->a = workload_below(&rng, NUM_SLOTS);
+        op->b = workload_below(&rng, NUM_SLOTS);
+        if (w == OP_FILL) {
+            op->count = workload_below(&rng, 1 << workload_below(&rng, bits + 1)) + 1;
+            if (op->count > maxsize)
+                op->count = maxsize;
+            if (workload_below(&rng, 4) > 0)
+                op->key = workload_below(&rng, universe - 2 * op->count + 1);
+            op->seed = workload_rand(&rng);
+        } else {
+            op->key = workload_below(&rng, workload_below(&rng, 2) ? HOT : universe);
+        }
+    }
+    return prog;
+}
+
+static void print_op(FILE *out, op_t *op) {
+    fprintf(out, "%s", opnames[op->kind]);
+    switch (op->kind) {
+    case OP_ADD:
+    case OP_CONTAINS:
+        fprintf(out, " %d %d\n", op->dst, op->key);
+        break;
+    case OP_FILL:
+        fprintf(out, " %d %d %d %llu\n", op->dst, op->key, op->count, op->seed);
+        break;
+    case OP_UNION:
+    case OP_INTERSECTION:
+    case OP_DIFFERENCE:
+        fprintf(out, " %d %d %d\n", op->dst, op->a, op->b);
+        break;
+    case OP_COPY:
+        fprintf(out, " %d %d\n", op->dst, op->a);
+        break;
+    default:
+        fprintf(out, " %d\n", op->dst);
+        break;
+    }
+}
+
+/*
+ * Reads a program written by print_op().  Returns NULL if the file
+ * could not be read or parsed.
+ */
+static op_t *load(char *filename, int *n) {
+    FILE *f = fopen(filename, "r");
+    char line[256], name[32];
+    op_t *prog = NULL, op;
+    int kind, fields, size = 0, capacity = 0;
+
+    if (f == NULL)
+        return NULL;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        memset(&op, 0, sizeof(op));
+        fields = sscanf(line, "%31s", name);
+        if (fields != 1 || name[0] == '#')
+            continue;
+        for (kind = 0; kind < NUM_OPS && strcmp(name, opnames[kind]) != 0; kind++)
+            ;
+        op.kind = kind;
+        switch (kind) {
+        case OP_ADD:
+        case OP_CONTAINS:
+            fields = sscanf(line, "%*s %d %d", &op.dst, &op.key) == 2;
+            break;
+        case OP_FILL:
+            fields = sscanf(line, "%*s %d %d %d %llu", &op.dst, &op.key, &op.count, &op.seed) == 4;
+            break;
+        case OP_UNION:
+        case OP_INTERSECTION:
+        case OP_DIFFERENCE:
+            fields = sscanf(line, "%*s %d %d %d", &op.dst, &op.a, &op.b) == 3;
+            break;
+        case OP_COPY:
+            fields = sscanf(line, "%*s %d %d", &op.dst, &op.a) == 2;
+            break;
+        case OP_ITERATE:
+        case OP_CLEAR:
+            fields = sscanf(line, "%*s %d", &op.dst) == 1;
+            break;
+        default:
+            fields = 0;
+        }
+        if (!fields || op.dst < 0 || op.dst >= NUM_SLOTS || op.a < 0 || op.a >= NUM_SLOTS ||
+            op.b < 0 || op.b >= NUM_SLOTS || op.key < 0 || op.count < 0) {
+            free(prog);
+            fclose(f);
+            return NULL;
+        }
+        if (size == capacity) {
+            capacity = capacity > 0 ? 2 * capacity : 256;
+            prog = realloc(prog, sizeof(op_t) * capacity);
+            if (prog == NULL)
+                fatal_error("out of memory");
+        }
+        prog[size++] = op;
+    }
+    fclose(f);
+    *n = size;
+    return prog != NULL ? prog : malloc(sizeof(op_t));
+}
+
+/*
+ * Checks that set_next_batch() yields the keys of the given model, in
+ * batches of a size that does not divide the chunks of any backend.
+ */
+static int checkbatch(set_t *set, model_t *m, char *msg, int len) {
+    set_iter_t iter;
+    void *batch[7];
+    int i = 0, k, n;
+
+    set_iter_init(&iter, set);
+    while ((n = set_next_batch(&iter, batch, 7)) > 0) {
+        for (k = 0; k < n; k++, i++) {
+            if (i >= m->size || KEY(batch[k]) != m->keys[i]) {
+                snprintf(msg, len, "set_next_batch() element %d is wrong", i);
+                return 0;
+            }
+        }
+    }
+    if (i != m->size) {
+        snprintf(msg, len, "set_next_batch() yields %d elements, expected %d", i, m->size);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Checks that the given set holds exactly the keys of the given model,
+ * in ascending order.  Returns 0 and describes the difference in msg if
+ * not.
+ */
+static int check(set_t *set, model_t *m, char *msg, int len) {
+    set_iter_t *iter;
+    int i = 0, key;
+
+    if (set_size(set) != m->size) {
+        snprintf(msg, len, "size is %d, expected %d", set_size(set), m->size);
+        return 0;
+    }
+    iter = set_createiter(set);
+    if (iter == NULL) {
+        snprintf(msg, len, "set_createiter() returned NULL");
+        return 0;
+    }
+    for (i = 0; set_hasnext(iter); i++) {
+        key = KEY(set_next(iter));
+        if (i >= m->size) {
+            snprintf(msg, len, "iteration yields more than %d elements", m->size);
+            set_destroyiter(iter);
+            return 0;
+        }
+        if (key != m->keys[i]) {
+            snprintf(msg, len, "element %d is %d, expected %d", i, key, m->keys[i]);
+            set_destroyiter(iter);
+            return 0;
+        }
+    }
+    set_destroyiter(iter);
+    if (i != m->size) {
+        snprintf(msg, len, "iteration yields %d elements, expected %d", i, m->size);
+        return 0;
+    }
+    return checkbatch(set, m, msg, len);
+}
+
+/*
+ * Runs the given program on the given backend.  Returns the number of
+ * the first op whose result differs from the model, and describes the
+ * difference in msg, or returns -1 if all ops succeed.
+ */
+static int run(const set_ops_t *ops, op_t *prog, int n, char *msg, int len) {
+    set_t *sets[NUM_SLOTS], *result;
+    model_t models[NUM_SLOTS + 2];
+    model_t *tmp = &models[NUM_SLOTS], *fill = &models[NUM_SLOTS + 1], swap;
+    workload_rng_t rng;
+    int i, k, found;
+
+    memset(models, 0, sizeof(models));
+    for (k = 0; k < NUM_SLOTS; k++) {
+        sets[k] = set_create_backend(ops, compare_keys);
+        if (sets[k] == NULL)
+            fatal_error("out of memory");
+    }
+
+    for (i = 0; i < n; i++) {
+        op_t *op = &prog[i];
+        model_t *m = &models[op->dst];
+
+        *progress = i;
+        switch (op->kind) {
+        case OP_ADD:
+            set_add(sets[op->dst], ELEM(op->key));
+            model_add(m, op->key);
+            break;
+        case OP_CONTAINS:
+            search(m, op->key, &found);
+            if ((set_contains(sets[op->dst], ELEM(op->key)) != 0) != found) {
+                snprintf(msg, len, "contains is %d, expected %d", !found, found);
+                return i;
+            }
+            break;
+        case OP_FILL:
+            /* Merged into the model at once, as adding each key is quadratic */
+            workload_seed(&rng, op->seed);
+            reserve(fill, op->count);
+            for (k = 0; k < op->count; k++) {
+                int key = op->key + workload_below(&rng, 2 * (unsigned long long) op->count);
+
+                set_add(sets[op->dst], ELEM(key));
+                fill->keys[k] = key;
+            }
+            fill->size = op->count;
+            model_normalize(fill);
+            model_merge(OP_UNION, m, fill, tmp);
+            swap = *m;
+            *m = *tmp;
+            *tmp = swap;
+            break;
+        case OP_UNION:
+        case OP_INTERSECTION:
+        case OP_DIFFERENCE:
+            if (op->kind == OP_UNION)
+                result = set_union(sets[op->a], sets[op->b]);
+            else if (op->kind == OP_INTERSECTION)
+                result = set_intersection(sets[op->a], sets[op->b]);
+            else
+                result = set_difference(sets[op->a], sets[op->b]);
+            if (result == NULL || result == sets[op->a] || result == sets[op->b]) {
+                snprintf(msg, len, "%s returned %s", opnames[op->kind],
+                         result == NULL ? "NULL" : "its operand");
+                return i;
+            }
+            set_destroy(sets[op->dst]);
+            sets[op->dst] = result;
+            model_merge(op->kind, &models[op->a], &models[op->b], tmp);
+            swap = *m;
+            *m = *tmp;
+            *tmp = swap;
+            break;
+        case OP_COPY:
+            result = set_copy(sets[op->a]);
+            if (result == NULL || result == sets[op->a]) {
+                snprintf(msg, len, "copy returned %s", result == NULL ? "NULL" : "its operand");
+                return i;
+            }
+            set_destroy(sets[op->dst]);
+            sets[op->dst] = result;
+            reserve(m, models[op->a].size);
+            memmove(m->keys, models[op->a].keys, sizeof(int) * models[op->a].size);
+            m->size = models[op->a].size;
+            break;
+        case OP_ITERATE:
+            if (!check(sets[op->dst], m, msg, len))
+                return i;
+            break;
+        case OP_CLEAR:
+            set_destroy(sets[op->dst]);
+            sets[op->dst] = set_create_backend(ops, compare_keys);
+            if (sets[op->dst] == NULL)
+                fatal_error("out of memory");
+            m->size = 0;
+            break;
+        }
+        if (set_size(sets[op->dst]) != m->size) {
+            snprintf(msg, len, "size is %d, expected %d", set_size(sets[op->dst]), m->size);
+            return i;
+        }
+    }
+
+    *progress = n;
+    for (k = 0; k < NUM_SLOTS; k++) {
+        if (!check(sets[k], &models[k], msg, len))
+            return n;
+        set_destroy(sets[k]);
+        free(models[k].keys);
+    }
+    free(tmp->keys);
+    free(fill->keys);
+    return -1;
+}
+
+/*
+ * Runs the given program in a child process.  Returns the number of the
+ * op at which it failed or crashed, or -1 if it succeeded.  The number
+ * is n if only the final check of all sets failed.  Unless quiet, the
+ * failure is described on stderr.
+ */
+static int trial(const set_ops_t *ops, op_t *prog, int n, int quiet) {
+    char msg[256];
+    pid_t pid;
+    int status, at;
+
+    fflush(stdout);
+    fflush(stderr);
+    *progress = -1;
+    pid = fork();
+    if (pid == -1)
+        fatal_error("fork() failed");
+    if (pid == 0) {
+        at = run(ops, prog, n, msg, sizeof(msg));
+        if (at < 0)
+            _exit(0);
+        if (!quiet) {
+            if (at < n) {
+                fprintf(stderr, "%s: op %d, ", set_backendname(ops), at);
+                print_op(stderr, &prog[at]);
+            } else {
+                fprintf(stderr, "%s: after the last op\n", set_backendname(ops));
+            }
+            fprintf(stderr, "  %s\n", msg);
+        }
+        _exit(1);
+    }
+    if (waitpid(pid, &status, 0) == -1)
+        fatal_error("waitpid() failed");
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        return -1;
+    at = *progress;
+    if (WIFSIGNALED(status) && !quiet) {
+        fprintf(stderr, "%s: op %ld, killed by signal %d during ", set_backendname(ops),
+                *progress, WTERMSIG(status));
+        if (at >= 0 && at < n)
+            print_op(stderr, &prog[at]);
+        else
+            fprintf(stderr, "setup\n");
+    }
+    return at >= 0 ? at : 0;
+}
+
+/*
+ * Shrinks the given failing program to one that still fails, but from
+ * which no single chunk of ops can be removed, and no fill can be
+ * halved, without it passing.  Returns the new length.
+ */
+static int shrink(const set_ops_t *ops, op_t *prog, int n) {
+    op_t *cand = malloc(sizeof(op_t) * (n > 0 ? n : 1));
+    int at, start, chunk, i, changed = 1;
+
+    if (cand == NULL)
+        fatal_error("out of memory");
+    at = trial(ops, prog, n, 1);
+    if (at >= 0 && at < n)
+        n = at + 1;
+
+    while (changed) {
+        changed = 0;
+
+        /* Remove chunks of ops, halving the chunk size when none can go */
+        for (chunk = n / 2 > 0 ? n / 2 : 1; chunk >= 1; chunk /= 2) {
+            for (start = 0; start < n; ) {
+                int len = start + chunk <= n ? chunk : n - start;
+
+                memcpy(cand, prog, sizeof(op_t) * start);
+                memcpy(cand + start, prog + start + len, sizeof(op_t) * (n - start - len));
+                at = trial(ops, cand, n - len, 1);
+                if (at < 0) {
+                    start += chunk;
+                    continue;
+                }
+                n = n - len;
+                memcpy(prog, cand, sizeof(op_t) * n);
+                if (at < n)
+                    n = at + 1;
+                changed = 1;
+            }
+        }
+
+        /* Make fills smaller */
+        for (i = 0; i < n; i++) {
+            while (prog[i].kind == OP_FILL && prog[i].count > 1) {
+                int count = prog[i].count;
+
+                prog[i].count = count / 2;
+                if (trial(ops, prog, n, 1) < 0) {
+                    prog[i].count = count;
+                    break;
+                }
+                changed = 1;
+            }
+        }
+    }
+    free(cand);
+    return n;
+}
+
+static void usage(char *prog) {
+    fprintf(stderr,
+            "usage: %s [-b backends] [-n ops] [-p programs] [-m maxsize] [-s seed]\n"
+            "          [-r reproducer]\n"
+            "  backends: comma-separated list of set backends, or all (default all)\n"
+            "  -n:    ops per program (default 100000)\n"
+            "  -p:    programs per backend (default 10)\n"
+            "  -m:    largest fill, in keys (default 1024)\n"
+            "  -r:    run the program in the given file instead, as written\n"
+            "         to stdout when a backend fails\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const set_ops_t *backends[MAX_BACKENDS];
+    int nbackends = 0, nops = 100000, nprogs = 10, maxsize = 1024;
+    unsigned long long seed = 1;
+    char *reproducer = NULL;
+    op_t *prog;
+    int opt, k, p, i, n, at, failed = 0;
+
+    while ((opt = getopt(argc, argv, "b:n:p:m:s:r:")) != -1) {
+        switch (opt) {
+        case 'b':
+            if ((nbackends = set_selectbackends(optarg, backends, nbackends, MAX_BACKENDS)) < 0)
+                usage(argv[0]);
+            break;
+        case 'n':
+            nops = atoi(optarg);
+            break;
+        case 'p':
+            nprogs = atoi(optarg);
+            break;
+        case 'm':
+            maxsize = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'r':
+            reproducer = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc || nops < 1 || nprogs < 1 || maxsize < 1 || maxsize > (1 << 29))
+        usage(argv[0]);
+    if (nbackends == 0)
+        nbackends = set_selectbackends("all", backends, 0, MAX_BACKENDS);
+
+    progress = mmap(NULL, sizeof(long), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (progress == MAP_FAILED)
+        fatal_error("mmap() failed");
+
+    if (reproducer != NULL) {
+        prog = load(reproducer, &n);
+        if (prog == NULL) {
+            fprintf(stderr, "%s: cannot read %s\n", argv[0], reproducer);
+            return 1;
+        }
+        for (k = 0; k < nbackends; k++) {
+            if (trial(backends[k], prog, n, 0) >= 0)
+                failed = 1;
+            else
+                fprintf(stderr, "%s: ok\n", set_backendname(backends[k]));
+        }
+        free(prog);
+        return failed;
+    }
+
+    for (k = 0; k < nbackends; k++) {
+        for (p = 0; p < nprogs; p++) {
+            prog = generate(nops, maxsize, seed + p);
+            at = trial(backends[k], prog, nops, 1);
+            if (at >= 0) {
+                fprintf(stderr, "%s: program %d (seed %llu) fails at op %d; shrinking\n",
+                        set_backendname(backends[k]), p, seed + p, at);
+                n = shrink(backends[k], prog, nops);
+                trial(backends[k], prog, n, 0);
+                printf("# %s, %d ops\n", set_backendname(backends[k]), n);
+                for (i = 0; i < n; i++)
+                    print_op(stdout, &prog[i]);
+                free(prog);
+                failed = 1;
+                break;
+            }
+            free(prog);
+        }
+        if (p == nprogs)
+            fprintf(stderr, "%s: %d programs of %d ops ok\n",
+                    set_backendname(backends[k]), nprogs, nops);
+    }
+    return failed;
+}
@@ -0,0 +1,155 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "strsort.h"
+
+/* Buckets smaller than this are sorted with insertion sort */
+#define MIN_RADIX 32
+
+/*
+ * A bucket of strings still to be sorted, strs[low] to strs[high - 1],
+ * which agree on their first depth characters.
+ */
+typedef struct bucket {
+    int low;
+    int high;
+    int depth;
+} bucket_t;
+
+/*
+ * The buckets wait on an explicit stack, so long common prefixes do not
+ * risk deep recursion.  chars caches the character of each string at
+ * the depth being distributed on.
+ */
+typedef struct sorter {
+    char **strs;
+    char **aux;
+    unsigned char *chars;
+    int nocase;
+    bucket_t *stack;
+    int nstack;
+    int maxstack;
+} sorter_t;
+
+static int charat(sorter_t *s, char *str, int depth) {
+    unsigned char c = str[depth];
+
+    return s->nocase ? tolower(c) : c;
+}
+
+/*
+ * Compares two strings from the given depth on.
+ */
+static int compare(sorter_t *s, char *a, char *b, int depth) {
+    int ca, cb;
+
+    if (!s->nocase)
+        return strcmp(a + depth, b + depth);
+    a += depth;
+    b += depth;
+    do {
+        ca = tolower((unsigned char) *a++);
+        cb = tolower((unsigned char) *b++);
+    } while (ca == cb && ca != 0);
+    return ca - cb;
+}
+
+static void push(sorter_t *s, int low, int high, int depth) {
+    if (s->nstack == s->maxstack) {
+        s->maxstack = s->maxstack > 0 ? 2 * s->maxstack : 64;
+        s->stack = realloc(s->stack, sizeof(bucket_t) * s->maxstack);
+        if (s->stack == NULL)
+            fatal_error("out of memory");
+    }
+    s->stack[s->nstack].low = low;
+    s->stack[s->nstack].high = high;
+    s->stack[s->nstack].depth = depth;
+    s->nstack++;
+}
+
+/*
+ * Stable insertion sort of a small bucket.
+ */
+static void insertionsort(sorter_t *s, bucket_t *b) {
+    char *str;
+    int i, j;
+
+    for (i = b->low + 1; i < b->high; i++) {
+        str = s->strs[i];
+        for (j = i; j > b->low && compare(s, s->strs[j - 1], str, b->depth) > 0; j--)
+            s->strs[j] = s->strs[j - 1];
+        s->strs[j] = str;
+    }
+}
+
+/*
+ * Distributes a bucket on the character at its depth, and pushes the
+ * new buckets that need further sorting.  Strings that end at this
+ * depth are equal, and stay first in their order.
+ */
+static void distribute(sorter_t *s, bucket_t *b) {
+    int count[256], next[256], i, c, pos;
+
+    memset(count, 0, sizeof(count));
+    for (i = b->low; i < b->high; i++) {
+        c = s->chars[i] = charat(s, s->strs[i], b->depth);
+        count[c]++;
+    }
+
+    /* A shared character needs no moving; go on to the next one */
+    c = s->chars[b->low];
+    if (count[c] == b->high - b->low) {
+        if (c != 0)
+            push(s, b->low, b->high, b->depth + 1);
+        return;
+    }
+
+    pos = b->low;
+    for (c = 0; c < 256; c++) {
+        next[c] = pos;
+        pos += count[c];
+    }
+    for (i = b->low; i < b->high; i++)
+        s->aux[next[s->chars[i]]++] = s->strs[i];
+    memcpy(s->strs + b->low, s->aux + b->low, sizeof(char *) * (b->high - b->low));
+
+    pos = b->low + count[0];
+    for (c = 1; c < 256; c++) {
+        if (count[c] > 1)
+            push(s, pos, pos + count[c], b->depth + 1);
+        pos += count[c];
+    }
+}
+
+void strsort(char **strs, int n, int nocase) {
+    sorter_t s;
+    bucket_t b;
+
+    if (n < 2)
+        return;
+
+    s.strs = strs;
+    s.nocase = nocase;
+    s.aux = malloc(sizeof(char *) * n);
+    s.chars = malloc(n);
+    if (s.aux == NULL || s.chars == NULL)
+        fatal_error("out of memory");
+    s.stack = NULL;
+    s.nstack = 0;
+    s.maxstack = 0;
+
+    push(&s, 0, n, 0);
+    while (s.nstack > 0) {
+        b = s.stack[--s.nstack];
+        if (b.high - b.low < MIN_RADIX)
+            insertionsort(&s, &b);
+        else
+            distribute(&s, &b);
+    }
+
+    free(s.stack);
+    free(s.chars);
+    free(s.aux);
+}
@@ -0,0 +1,15 @@
+#ifndef STRSORT_H
+#define STRSORT_H
+
+/*
+ * Sorts the given array of n strings into the order of strcmp(), or of
+ * strcasecmp() if nocase is set, with a most significant digit first
+ * radix sort.  Strings are distributed into buckets by one character at
+ * a time, so each character that tells strings apart is looked at about
+ * once, instead of a common prefix being rescanned by every comparison.
+ * The sort is stable: strings that compare equal keep their order.
+ * Case is folded as in the C locale.
+ */
+void strsort(char **strs, int n, int nocase);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "common.h"
+
+/* Spans kept per thread, and the longest detail kept per span */
+#define RING_SIZE 16384
+#define MAX_DETAIL 48
+
+typedef struct span {
+    char *name;
+    unsigned long long start;
+    unsigned long long duration;
+    char detail[MAX_DETAIL];
+} span_t;
+
+typedef struct ring {
+    int tid;
+    unsigned long long count;
+    struct ring *next;
+    span_t spans[RING_SIZE];
+} ring_t;
+
+/* All rings, linked through next; only taken when a thread starts tracing */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static ring_t *rings;
+static int nthreads;
+
+/* The calling thread's ring */
+static __thread ring_t *ring;
+
+unsigned long long trace_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Creates and registers the calling thread's ring.
+ */
+static ring_t *newring(void) {
+    ring_t *r = malloc(sizeof(ring_t));
+
+    if (r == NULL)
+        fatal_error("out of memory");
+    r->count = 0;
+
+    pthread_mutex_lock(&lock);
+    r->tid = ++nthreads;
+    r->next = rings;
+    rings = r;
+    pthread_mutex_unlock(&lock);
+    return r;
+}
+
+void trace_span(char *name, char *detail, unsigned long long start) {
+    unsigned long long end = trace_now();
+    span_t *span;
+    size_t len;
+
+    if (ring == NULL)
+        ring = newring();
+
+    span = &ring->spans[ring->count++ % RING_SIZE];
+    span->name = name;
+    span->start = start;
+    span->duration = end - start;
+    if (detail != NULL) {
+        /* Keep the end, which tells paths with a shared prefix apart */
+        len = strlen(detail);
+        if (len > MAX_DETAIL - 1) {
+            detail += len - (MAX_DETAIL - 1);
+            /* Don't start inside a UTF-8 sequence */
+            while ((*detail & 0xc0) == 0x80)
+                detail++;
+        }
+        strcpy(span->detail, detail);
+    } else {
+        span->detail[0] = 0;
+    }
+}
+
+/*
+ * Writes the given string as a JSON string literal.
+ */
+static void writestring(FILE *f, char *s) {
+    fputc('"', f);
+    for (; *s != 0; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+int trace_write(char *filename) {
+    unsigned long long i, first, epoch = ~0ULL;
+    FILE *f = fopen(filename, "w");
+    int any = 0;
+    span_t *span;
+    ring_t *r;
+
+    if (f == NULL)
+        return 0;
+
+    /* Timestamps are relative to the earliest recorded span */
+    for (r = rings; r != NULL; r = r->next) {
+        first = r->count > RING_SIZE ? r->count - RING_SIZE : 0;
+        for (i = first; i < r->count; i++) {
+            if (r->spans[i % RING_SIZE].start < epoch)
+                epoch = r->spans[i % RING_SIZE].start;
+        }
+    }
+
+    fprintf(f, "{\"traceEvents\": [");
+    for (r = rings; r != NULL; r = r->next) {
+        first = r->count > RING_SIZE ? r->count - RING_SIZE : 0;
+        for (i = first; i < r->count; i++) {
+            span = &r->spans[i % RING_SIZE];
+            fprintf(f, "%s\n  {\"name\": ", any ? "," : "");
+            writestring(f, span->name);
+            fprintf(f, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                    r->tid, (span->start - epoch) / 1e3, span->duration / 1e3);
+            if (span->detail[0] != 0) {
+                fprintf(f, ", \"args\": {\"detail\": ");
+                writestring(f, span->detail);
+                fprintf(f, "}");
+            }
+            fprintf(f, "}");
+            any = 1;
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    return fclose(f) == 0;
+}
@@ -0,0 +1,49 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Lightweight tracing spans.
+ *
+ * A span records the name, start time and duration of a piece of work,
+ * and optionally a short detail string such as a file name.  Spans are
+ * appended to a ring buffer owned by the calling thread, so recording
+ * takes no locks; when a ring is full, its oldest spans are overwritten.
+ * trace_write() writes all rings as Chrome trace-event JSON, which can
+ * be opened in chrome://tracing or Perfetto.
+ *
+ * The TRACE_BEGIN() and TRACE_END() macros compile to nothing unless
+ * TRACE is defined, so the spans can be left in the code:
+ *
+ *     TRACE_BEGIN(t);
+ *     ...
+ *     TRACE_END(t, "tokenize", filename);
+ */
+
+/*
+ * Returns the current time of the trace clock, in nanoseconds.
+ */
+unsigned long long trace_now(void);
+
+/*
+ * Records a span with the given name that started at the given time and
+ * ends now.  The name must be a string constant; the detail may be NULL,
+ * and is copied; a long one keeps only its end.
+ */
+void trace_span(char *name, char *detail, unsigned long long start);
+
+/*
+ * Writes the recorded spans of all threads to the given file.  Should
+ * only be called when no other thread is recording.  Returns 0 if the
+ * file could not be written, otherwise 1.
+ */
+int trace_write(char *filename);
+
+#ifdef TRACE
+#define TRACE_BEGIN(var) unsigned long long var = trace_now()
+#define TRACE_END(var, name, detail) trace_span(name, detail, var)
+#else
+#define TRACE_BEGIN(var)
+#define TRACE_END(var, name, detail) ((void) 0)
+#endif
+
+#endif
@@ -0,0 +1,884 @@
+#include "list.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "instrument.h"
+#include "strsort.h"
+
+/*
+ * An unrolled list: the elements are kept in a doubly-linked list of
+ * chunks, each holding up to CHUNK_ELEMS elements in elems[start] to
+ * elems[start + count - 1].  Chunks are CHUNK_BYTES long and aligned to
+ * cache lines, so walking the list reads whole lines of elements
+ * instead of one node per element.  A chunk added at the front is
+ * filled from its end, and one added at the back from its start, so
+ * adding and popping at either end never moves elements.
+ *
+ * Build with LIST_IMPL=unrolledlist.c to use it instead of linkedlist.c.
+ */
+
+#define CACHE_LINE 64
+#define CHUNK_BYTES 256
+#define CHUNK_ELEMS ((int) ((CHUNK_BYTES - 2 * sizeof(void *) - 2 * sizeof(int)) / sizeof(void *)))
+
+typedef struct chunk chunk_t;
+
+struct chunk {
+    chunk_t *next;
+    chunk_t *prev;
+    int start;
+    int count;
+    void *elems[CHUNK_ELEMS];
+};
+
+/*
+ * spare keeps the last emptied chunk, so that a list that grows and
+ * shrinks across a chunk boundary does not allocate every time.
+ */
+struct list {
+    chunk_t *head;
+    chunk_t *tail;
+    chunk_t *spare;
+    int size;
+    cmpfunc_t cmpfunc;
+};
+
+static chunk_t *newchunk(list_t *list, int start)
+{
+    chunk_t *chunk = list->spare;
+
+    if (chunk != NULL)
+        list->spare = NULL;
+    else if ((chunk = aligned_alloc(CACHE_LINE, sizeof(chunk_t))) == NULL)
+        return NULL;
+
+    chunk->next = NULL;
+    chunk->prev = NULL;
+    chunk->start = start;
+    chunk->count = 0;
+    return chunk;
+}
+
+/*
+ * Unlinks the given empty chunk, and keeps it as the spare.
+ */
+static void dropchunk(list_t *list, chunk_t *chunk)
+{
+    if (chunk->prev != NULL)
+        chunk->prev->next = chunk->next;
+    else
+        list->head = chunk->next;
+    if (chunk->next != NULL)
+        chunk->next->prev = chunk->prev;
+    else
+        list->tail = chunk->prev;
+
+    free(list->spare);
+    list->spare = chunk;
+}
+
+/*
+ * Chunks already amortize allocation over many elements, so the
+ * unrolled list does not use node pools.
+ */
+void list_usepool(pool_t *pool)
+{
+    (void) pool;
+}
+
+list_t *list_create(cmpfunc_t cmpfunc)
+{
+    INSTR_ENTER(INSTR_LIST_CREATE);
+    list_t *list = malloc(sizeof(list_t));
+    if (list == NULL)
+        INSTR_RETURN(INSTR_LIST_CREATE, NULL);
+
+    list->head = NULL;
+    list->tail = NULL;
+    list->spare = NULL;
+    list->size = 0;
+    list->cmpfunc = INSTR_WRAPCMP(cmpfunc);
+    INSTR_RETURN(INSTR_LIST_CREATE, list);
+}
+
+void list_destroy(list_t *list)
+{
+    INSTR_ENTER(INSTR_LIST_DESTROY);
+    chunk_t *chunk = list->head;
+    while (chunk != NULL) {
+        chunk_t *tmp = chunk;
+        chunk = chunk->next;
+        free(tmp);
+    }
+    free(list->spare);
+    free(list);
+    INSTR_LEAVE(INSTR_LIST_DESTROY);
+}
+
+int list_size(list_t *list)
+{
+    return list->size;
+}
+
+int list_addfirst(list_t *list, void *elem)
+{
+    INSTR_ENTER(INSTR_LIST_ADDFIRST);
+    chunk_t *chunk = list->head;
+
+    if (chunk == NULL || chunk->start == 0) {
+        chunk = newchunk(list, CHUNK_ELEMS);
+        if (chunk == NULL)
+            INSTR_RETURN(INSTR_LIST_ADDFIRST, 0);
+        chunk->next = list->head;
+        if (list->head != NULL)
+            list->head->prev = chunk;
+        else
+            list->tail = chunk;
+        list->head = chunk;
+    }
+    chunk->elems[--chunk->start] = elem;
+    chunk->count++;
+    list->size++;
+    INSTR_RETURN(INSTR_LIST_ADDFIRST, 1);
+}
+
+int list_addlast(list_t *list, void *elem)
+{
+    INSTR_ENTER(INSTR_LIST_ADDLAST);
+    chunk_t *chunk = list->tail;
+
+    if (chunk == NULL || chunk->start + chunk->count == CHUNK_ELEMS) {
+        chunk = newchunk(list, 0);
+        if (chunk == NULL)
+            INSTR_RETURN(INSTR_LIST_ADDLAST, 0);
+        chunk->prev = list->tail;
+        if (list->tail != NULL)
+            list->tail->next = chunk;
+        else
+            list->head = chunk;
+        list->tail = chunk;
+    }
+    chunk->elems[chunk->start + chunk->count++] = elem;
+    list->size++;
+    INSTR_RETURN(INSTR_LIST_ADDLAST, 1);
+}
+
+/*
+ * Fills whole chunks from the array, one copy per chunk.
+ */
+list_t *list_from_array(cmpfunc_t cmpfunc, void **elems, int n)
+{
+    INSTR_ENTER(INSTR_LIST_FROMARRAY);
+    list_t *list = list_create(cmpfunc);
+    chunk_t *chunk;
+    int count;
+
+    if (list == NULL)
+        INSTR_RETURN(INSTR_LIST_FROMARRAY, NULL);
+
+    while (list->size < n) {
+        chunk = newchunk(list, 0);
+        if (chunk == NULL) {
+            list_destroy(list);
+            INSTR_RETURN(INSTR_LIST_FROMARRAY, NULL);
+        }
+        count = n - list->size < CHUNK_ELEMS ? n - list->size : CHUNK_ELEMS;
+        memcpy(chunk->elems, elems + list->size, count * sizeof(void *));
+        chunk->count = count;
+        chunk->prev = list->tail;
+        if (list->tail != NULL)
+            list->tail->next = chunk;
+        else
+            list->head = chunk;
+        list->tail = chunk;
+        list->size += count;
+    }
+    INSTR_RETURN(INSTR_LIST_FROMARRAY, list);
+}
+
+int list_to_array(list_t *list, void **elems)
+{
+    chunk_t *chunk;
+    int n = 0;
+
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+        memcpy(elems + n, chunk->elems + chunk->start, chunk->count * sizeof(void *));
+        n += chunk->count;
+    }
+    return n;
+}
+
+/*
+ * Chunks belong to no pool, so splicing always just joins the chunk
+ * lists.  other keeps its spare chunk.
+ */
+int list_splice(list_t *list, list_t *other)
+{
+    INSTR_ENTER(INSTR_LIST_SPLICE);
+    if (other->head == NULL)
+        INSTR_RETURN(INSTR_LIST_SPLICE, 1);
+
+    if (list->tail == NULL) {
+        list->head = other->head;
+    }
+    else {
+        list->tail->next = other->head;
+        other->head->prev = list->tail;
+    }
+    list->tail = other->tail;
+    list->size += other->size;
+    other->head = other->tail = NULL;
+    other->size = 0;
+    INSTR_RETURN(INSTR_LIST_SPLICE, 1);
+}
+
+void *list_popfirst(list_t *list)
+{
+    INSTR_ENTER(INSTR_LIST_POPFIRST);
+    chunk_t *chunk = list->head;
+    void *elem;
+
+    if (chunk == NULL)
+        INSTR_RETURN(INSTR_LIST_POPFIRST, NULL);
+
+    elem = chunk->elems[chunk->start++];
+    list->size--;
+    if (--chunk->count == 0)
+        dropchunk(list, chunk);
+    INSTR_RETURN(INSTR_LIST_POPFIRST, elem);
+}
+
+void *list_poplast(list_t *list)
+{
+    INSTR_ENTER(INSTR_LIST_POPLAST);
+    chunk_t *chunk = list->tail;
+    void *elem;
+
+    if (chunk == NULL)
+        INSTR_RETURN(INSTR_LIST_POPLAST, NULL);
+
+    elem = chunk->elems[chunk->start + --chunk->count];
+    list->size--;
+    if (chunk->count == 0)
+        dropchunk(list, chunk);
+    INSTR_RETURN(INSTR_LIST_POPLAST, elem);
+}
+
+int list_contains(list_t *list, void *elem)
+{
+    INSTR_ENTER(INSTR_LIST_CONTAINS);
+    chunk_t *chunk;
+    int i;
+
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+        for (i = chunk->start; i < chunk->start + chunk->count; i++) {
+            if (list->cmpfunc(elem, chunk->elems[i]) == 0)
+                INSTR_RETURN(INSTR_LIST_CONTAINS, 1);
+        }
+    }
+    INSTR_RETURN(INSTR_LIST_CONTAINS, 0);
+}
+
+/*
+ * The array sort is a natural merge sort in the style of TimSort, like
+ * list_sort in linkedlist.c.  The array is cut into runs that are
+ * already in order: ascending runs are kept as they are, strictly
+ * descending runs are reversed (strictly, so that equal elements keep
+ * their order), and runs shorter than minrun are extended with binary
+ * insertion sort.  The runs are pushed on a stack and merged whenever
+ * the lengths at the top of the stack break TimSort's invariants.  A
+ * merge copies the first run to a scratch array and merges it back.  The
+ * ends of the two runs that are already in place are found by binary
+ * search and left alone, and so are runs that are already in order, so a
+ * sorted or reversed array is a single run and costs n - 1 comparisons.
+ */
+
+/* Arrays shorter than this are sorted with insertion sort alone */
+#define MIN_MERGE 32
+
+/* Run lengths on the stack grow faster than the Fibonacci numbers */
+#define MAX_RUNS 64
+
+typedef struct run {
+    int start;
+    int len;
+} run_t;
+
+typedef struct sorter {
+    cmpfunc_t cmpfunc;
+    void **elems;
+    void **tmp;
+    int nruns;
+    run_t runs[MAX_RUNS];
+} sorter_t;
+
+/*
+ * Returns the minimum run length for an array of n elements: n itself
+ * if the array is short, and otherwise a length between MIN_MERGE / 2
+ * and MIN_MERGE such that n / minrun is a power of two, or just below
+ * one.
+ */
+static int minrunlength(int n)
+{
+    int r = 0;
+
+    while (n >= MIN_MERGE) {
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+/*
+ * Extends the sorted elems[low..start) to elems[low..end) by inserting
+ * the elements after it one at a time, each after any equal elements.
+ */
+static void insertionsort(void **elems, int low, int start, int end, cmpfunc_t cmpfunc)
+{
+    void *elem;
+    int lo, hi, mid;
+
+    for (; start < end; start++) {
+        elem = elems[start];
+        lo = low;
+        hi = start;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (cmpfunc(elem, elems[mid]) < 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        memmove(elems + lo + 1, elems + lo, sizeof(void *) * (start - lo));
+        elems[lo] = elem;
+    }
+}
+
+/*
+ * Finds the run starting at elems[low], reverses it if it is strictly
+ * descending, and returns its length.
+ */
+static int countrun(void **elems, int low, int high, cmpfunc_t cmpfunc)
+{
+    int end = low + 1, i, j;
+    void *tmp;
+
+    if (end == high)
+        return 1;
+    if (cmpfunc(elems[end++], elems[low]) < 0) {
+        while (end < high && cmpfunc(elems[end], elems[end - 1]) < 0)
+            end++;
+        for (i = low, j = end - 1; i < j; i++, j--) {
+            tmp = elems[i];
+            elems[i] = elems[j];
+            elems[j] = tmp;
+        }
+    } else {
+        while (end < high && cmpfunc(elems[end], elems[end - 1]) >= 0)
+            end++;
+    }
+    return end - low;
+}
+
+/*
+ * Returns the index of the first element of elems[low..high) that is
+ * greater than key, or with ties set, not less than it.  The elements
+ * must be sorted.
+ */
+static int search(void **elems, int low, int high, void *key, int ties, cmpfunc_t cmpfunc)
+{
+    int mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (ties ? cmpfunc(elems[mid], key) < 0 : cmpfunc(elems[mid], key) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/*
+ * Merges the runs at index i and i + 1 on the stack.  Ties are taken
+ * from the first run, so the sort is stable.
+ */
+static void mergeat(sorter_t *s, int i)
+{
+    void **elems = s->elems, **tmp = s->tmp;
+    int low = s->runs[i].start, mid = low + s->runs[i].len;
+    int high = mid + s->runs[i + 1].len, x, y = mid, k;
+
+    s->runs[i].len += s->runs[i + 1].len;
+    if (i + 2 < s->nruns)
+        s->runs[i + 1] = s->runs[i + 2];
+    s->nruns--;
+
+    /* Runs that are already in order are left as they are */
+    if (s->cmpfunc(elems[mid], elems[mid - 1]) >= 0)
+        return;
+
+    /*
+     * So are the elements of the first run that go before all of the
+     * second, and those of the second that go after all of the first.
+     */
+    low = search(elems, low, mid, elems[mid], 0, s->cmpfunc);
+    high = search(elems, mid, high, elems[mid - 1], 1, s->cmpfunc);
+
+    memcpy(tmp + low, elems + low, sizeof(void *) * (mid - low));
+    x = k = low;
+    while (x < mid && y < high) {
+        if (s->cmpfunc(elems[y], tmp[x]) < 0)
+            elems[k++] = elems[y++];
+        else
+            elems[k++] = tmp[x++];
+    }
+    /* What is left of the second run is already in place */
+    while (x < mid)
+        elems[k++] = tmp[x++];
+}
+
+/*
+ * Merges runs at the top of the stack until TimSort's invariants hold
+ * for the top four runs again: each run is longer than the one above
+ * it, and than the two above it together.
+ */
+static void collapse(sorter_t *s)
+{
+    run_t *r = s->runs;
+    int i;
+
+    while (s->nruns > 1) {
+        i = s->nruns - 2;
+        if ((i > 0 && r[i - 1].len <= r[i].len + r[i + 1].len) ||
+            (i > 1 && r[i - 2].len <= r[i - 1].len + r[i].len)) {
+            if (r[i - 1].len < r[i + 1].len)
+                i--;
+        } else if (r[i].len > r[i + 1].len) {
+            break;
+        }
+        mergeat(s, i);
+    }
+}
+
+/*
+ * Sorts src[low..high), using dst[low..high) as scratch space.
+ */
+static void sortrange(void **src, void **dst, int low, int high, cmpfunc_t cmpfunc)
+{
+    sorter_t s;
+    int minrun = minrunlength(high - low), len, i;
+
+    s.cmpfunc = cmpfunc;
+    s.elems = src;
+    s.tmp = dst;
+    s.nruns = 0;
+
+    /* Push the runs one by one, merging as they come */
+    while (low < high) {
+        len = countrun(src, low, high, cmpfunc);
+        if (len < minrun) {
+            i = low + len;
+            len = high - low < minrun ? high - low : minrun;
+            insertionsort(src, low, i, low + len, cmpfunc);
+        }
+        s.runs[s.nruns].start = low;
+        s.runs[s.nruns].len = len;
+        s.nruns++;
+        low += len;
+        collapse(&s);
+    }
+    /* Merge what is left on the stack */
+    while (s.nruns > 1) {
+        i = s.nruns - 2;
+        if (i > 0 && s.runs[i - 1].len < s.runs[i + 1].len)
+            i--;
+        mergeat(&s, i);
+    }
+}
+
+/*
+ * Copies the elements of the given list to an array, in order.
+ */
+static void gather(list_t *list, void **elems)
+{
+    chunk_t *chunk;
+    int n = 0;
+
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+        memcpy(elems + n, chunk->elems + chunk->start, sizeof(void *) * chunk->count);
+        n += chunk->count;
+    }
+}
+
+/*
+ * Writes the elements of the given array back into the chunks of the
+ * given list, so the chunk layout is unchanged.
+ */
+static void scatter(list_t *list, void **elems)
+{
+    chunk_t *chunk;
+    int n = 0;
+
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+        memcpy(chunk->elems + chunk->start, elems + n, sizeof(void *) * chunk->count);
+        n += chunk->count;
+    }
+}
+
+/*
+ * Sorts the list in place with insertion sort, walking the elements by
+ * chunk and position.  This needs no memory, but takes quadratic time
+ * unless the list is nearly sorted, so it is only used when there is no
+ * memory for the array sort.  Chunks in the list are never empty.
+ */
+static void sortinplace(list_t *list)
+{
+    chunk_t *chunk, *hole, *prev;
+    int i, pos, prevpos;
+    void *elem;
+
+    for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+        for (i = chunk->start; i < chunk->start + chunk->count; i++) {
+            elem = chunk->elems[i];
+            hole = chunk;
+            pos = i;
+            /* Move the hole back past the greater elements before it */
+            for (;;) {
+                prev = hole;
+                prevpos = pos - 1;
+                if (prevpos < prev->start) {
+                    prev = prev->prev;
+                    if (prev == NULL)
+                        break;
+                    prevpos = prev->start + prev->count - 1;
+                }
+                if (list->cmpfunc(elem, prev->elems[prevpos]) >= 0)
+                    break;
+                hole->elems[pos] = prev->elems[prevpos];
+                hole = prev;
+                pos = prevpos;
+            }
+            hole->elems[pos] = elem;
+        }
+    }
+}
+
+/*
+ * The elements are copied out of the chunks into an array, sorted there
+ * with sortrange(), and written back into the same chunks.  Without
+ * memory for the array, the list is sorted in place instead.
+ */
+static void mergesort_(list_t *list)
+{
+    void **buf = malloc(2 * sizeof(void *) * list->size);
+
+    if (buf == NULL) {
+        sortinplace(list);
+        return;
+    }
+    gather(list, buf);
+    sortrange(buf, buf + list->size, 0, list->size, list->cmpfunc);
+    scatter(list, buf);
+    free(buf);
+}
+
+void list_sort(list_t *list)
+{
+    INSTR_ENTER(INSTR_LIST_SORT);
+    if (list->size > 1)
+        mergesort_(list);
+    INSTR_LEAVE(INSTR_LIST_SORT);
+}
+
+/*
+ * list_parallelsort sorts the same flat array as list_sort.  The array
+ * is cut into one segment per thread, and the threads sort their
+ * segments concurrently.  The segments are then merged pairwise, in
+ * rounds, between the array and a second one, with each thread producing
+ * an equal share of the output of every round.  Where its share starts
+ * on the merge path of a pair of segments is found by binary search
+ * along a diagonal, as in linkedlist.c.  Ties are always taken from the
+ * earlier segment, so the result is the same as that of list_sort.
+ */
+
+/* Lists with fewer elements than this per thread use fewer threads */
+#define MIN_SEGMENT 8192
+
+#define MAX_THREADS 64
+
+/* The state shared by all threads of a parallel sort */
+typedef struct sortstate {
+    cmpfunc_t cmpfunc;
+    int size;
+    int nthreads;
+    /* Segment i is at bounds[i] to bounds[i + 1] in the arrays */
+    int nsegs;
+    int bounds[MAX_THREADS + 1];
+    void **src;
+    void **dst;
+} sortstate_t;
+
+typedef struct sortjob {
+    sortstate_t *state;
+    int id;
+    pthread_t thread;
+} sortjob_t;
+
+/*
+ * Runs func on every job and waits for them all.  The first job runs in
+ * the calling thread, and the others in threads of their own.  A job
+ * whose thread cannot be created also runs in the calling thread.
+ */
+static void runjobs(sortjob_t *jobs, int n, void *(*func)(void *))
+{
+    int started[MAX_THREADS], i;
+
+    for (i = 1; i < n; i++)
+        started[i] = pthread_create(&jobs[i].thread, NULL, func, &jobs[i]) == 0;
+    func(&jobs[0]);
+    for (i = 1; i < n; i++) {
+        if (started[i])
+            pthread_join(jobs[i].thread, NULL);
+        else
+            func(&jobs[i]);
+    }
+}
+
+/*
+ * Returns the first index of the share of the given job in an array of
+ * the sort's size.
+ */
+static int sharestart(sortstate_t *state, int id)
+{
+    return (long) state->size * id / state->nthreads;
+}
+
+static void *sortsegment(void *arg)
+{
+    sortjob_t *job = arg;
+    sortstate_t *state = job->state;
+
+    sortrange(state->src, state->dst, state->bounds[job->id],
+              state->bounds[job->id + 1], state->cmpfunc);
+    return NULL;
+}
+
+/*
+ * Returns how many of the first d elements of the merge of a and b come
+ * from a.  Ties are taken from a.
+ */
+static int splitpath(void **a, int na, void **b, int nb, int d, cmpfunc_t cmpfunc)
+{
+    int low = d > nb ? d - nb : 0, high = d < na ? d : na, mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (cmpfunc(a[mid], b[d - mid - 1]) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/*
+ * Writes elements first to last - 1 of the merge of a and b to out.
+ */
+static void mergepath(void **a, int na, void **b, int nb,
+                      int first, int last, void **out, cmpfunc_t cmpfunc)
+{
+    int i = splitpath(a, na, b, nb, first, cmpfunc), j = first - i, k;
+
+    for (k = first; k < last; k++) {
+        if (j == nb || (i < na && cmpfunc(a[i], b[j]) <= 0))
+            out[k] = a[i++];
+        else
+            out[k] = b[j++];
+    }
+}
+
+/*
+ * Produces the job's share of the next round of merges, from src to dst.
+ * The last segment has no partner if the number of segments is odd, and
+ * is merged with an empty one.
+ */
+static void *mergeshare(void *arg)
+{
+    sortjob_t *job = arg;
+    sortstate_t *state = job->state;
+    int low = sharestart(state, job->id), high = sharestart(state, job->id + 1);
+    int k, start, mid, end, first, last;
+
+    for (k = 0; k < state->nsegs; k += 2) {
+        start = state->bounds[k];
+        mid = state->bounds[k + 1];
+        end = k + 2 <= state->nsegs ? state->bounds[k + 2] : mid;
+        if (end <= low || start >= high)
+            continue;
+        first = low > start ? low : start;
+        last = high < end ? high : end;
+        mergepath(state->src + start, mid - start, state->src + mid, end - mid,
+                  first - start, last - start, state->dst + start, state->cmpfunc);
+    }
+    return NULL;
+}
+
+void list_parallelsort(list_t *list, int nthreads)
+{
+    INSTR_ENTER(INSTR_LIST_SORT);
+    sortstate_t state;
+    sortjob_t jobs[MAX_THREADS];
+    void **buf = NULL, **tmp;
+    int i;
+
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+    if (nthreads > list->size / MIN_SEGMENT)
+        nthreads = list->size / MIN_SEGMENT;
+    if (nthreads > 1)
+        buf = malloc(2 * sizeof(void *) * list->size);
+    if (buf == NULL) {
+        if (list->size > 1)
+            mergesort_(list);
+        INSTR_LEAVE(INSTR_LIST_SORT);
+        return;
+    }
+    gather(list, buf);
+
+    state.cmpfunc = list->cmpfunc;
+    state.size = list->size;
+    state.nthreads = nthreads;
+    state.nsegs = nthreads;
+    state.src = buf;
+    state.dst = buf + list->size;
+    for (i = 0; i < nthreads; i++) {
+        state.bounds[i] = sharestart(&state, i);
+        jobs[i].state = &state;
+        jobs[i].id = i;
+    }
+    state.bounds[nthreads] = list->size;
+    runjobs(jobs, nthreads, sortsegment);
+
+    while (state.nsegs > 1) {
+        runjobs(jobs, nthreads, mergeshare);
+        for (i = 0; 2 * i < state.nsegs; i++)
+            state.bounds[i] = state.bounds[2 * i];
+        state.nsegs = i;
+        state.bounds[i] = list->size;
+        tmp = state.src;
+        state.src = state.dst;
+        state.dst = tmp;
+    }
+
+    scatter(list, state.src);
+    free(buf);
+    INSTR_LEAVE(INSTR_LIST_SORT);
+}
+
+void list_sortstrings(list_t *list, int nocase)
+{
+    INSTR_ENTER(INSTR_LIST_SORT);
+    char **strs;
+    chunk_t *chunk;
+    int i, n = 0;
+
+    if (list->size > 1) {
+        strs = malloc(sizeof(char *) * list->size);
+        if (strs == NULL)
+            fatal_error("out of memory");
+
+        for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+            for (i = chunk->start; i < chunk->start + chunk->count; i++)
+                strs[n++] = chunk->elems[i];
+        }
+        strsort(strs, n, nocase);
+        n = 0;
+        for (chunk = list->head; chunk != NULL; chunk = chunk->next) {
+            for (i = chunk->start; i < chunk->start + chunk->count; i++)
+                chunk->elems[i] = strs[n++];
+        }
+        free(strs);
+    }
+    INSTR_LEAVE(INSTR_LIST_SORT);
+}
+
+/*
+ * Points the given iterator at the elements of the given chunk.  An
+ * iterator walks the elements of its chunk, iter->node, from pos to
+ * end, before moving on to the next chunk.
+ */
+static void enter(list_iter_t *iter, chunk_t *chunk)
+{
+    iter->node = chunk;
+    if (chunk != NULL) {
+        iter->pos = chunk->elems + chunk->start;
+        iter->end = chunk->elems + chunk->start + chunk->count;
+    }
+}
+
+list_iter_t *list_createiter(list_t *list)
+{
+    INSTR_ENTER(INSTR_LIST_CREATEITER);
+    list_iter_t *iter = malloc(sizeof(list_iter_t));
+    if (iter == NULL)
+        INSTR_RETURN(INSTR_LIST_CREATEITER, NULL);
+
+    list_iter_init(iter, list);
+    INSTR_RETURN(INSTR_LIST_CREATEITER, iter);
+}
+
+list_iter_t *list_iter_init(list_iter_t *iter, list_t *list)
+{
+    enter(iter, list->head);
+    return iter;
+}
+
+void list_destroyiter(list_iter_t *iter)
+{
+    INSTR_ENTER(INSTR_LIST_DESTROYITER);
+    free(iter);
+    INSTR_LEAVE(INSTR_LIST_DESTROYITER);
+}
+
+int list_hasnext(list_iter_t *iter)
+{
+    return iter->node != NULL;
+}
+
+void *list_next(list_iter_t *iter)
+{
+    void **pos = iter->pos;
+
+    if (iter->node == NULL)
+        return NULL;
+
+    iter->pos = pos + 1;
+    if (iter->pos == iter->end)
+        enter(iter, ((chunk_t *) iter->node)->next);
+    return *pos;
+}
+
+/*
+ * Copies whole runs of elements out of each chunk.
+ */
+int list_next_batch(list_iter_t *iter, void **buf, int max)
+{
+    void **pos;
+    int n = 0, count;
+
+    while (n < max && iter->node != NULL) {
+        pos = iter->pos;
+        count = (void **) iter->end - pos;
+        if (count > max - n)
+            count = max - n;
+        memcpy(buf + n, pos, count * sizeof(void *));
+        n += count;
+        iter->pos = pos + count;
+        if (iter->pos == iter->end)
+            enter(iter, ((chunk_t *) iter->node)->next);
+    }
+    return n;
+}
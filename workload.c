@@ -0,0 +1,459 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "workload.h"
+
+void workload_seed(workload_rng_t *rng, unsigned long long seed) {
+    rng->state = seed;
+}
+
+unsigned long long workload_rand(workload_rng_t *rng) {
+    unsigned long long z = (rng->state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+unsigned long long workload_below(workload_rng_t *rng, unsigned long long n) {
+    unsigned long long limit, r;
+
+    if (n == 0)
+        return 0;
+
+    /* Reject the top partial range, so that all values are equally likely */
+    limit = -n % n;
+    do {
+        r = workload_rand(rng);
+    } while (r < limit);
+    return r % n;
+}
+
+double workload_uniform(workload_rng_t *rng) {
+    return (workload_rand(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+struct workload_zipf {
+    int n;
+    double *cdf;
+};
+
+workload_zipf_t *workload_zipf_create(int n, double skew) {
+    workload_zipf_t *zipf = malloc(sizeof(workload_zipf_t));
+    double sum = 0;
+    int i;
+
+    if (zipf == NULL)
+        return NULL;
+    zipf->n = n;
+    zipf->cdf = malloc(sizeof(double) * (n > 0 ? n : 1));
+    if (zipf->cdf == NULL) {
+        free(zipf);
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, skew);
+        zipf->cdf[i] = sum;
+    }
+    for (i = 0; i < n; i++)
+        zipf->cdf[i] /= sum;
+
+    return zipf;
+}
+
+void workload_zipf_destroy(workload_zipf_t *zipf) {
+    free(zipf->cdf);
+    free(zipf);
+}
+
+int workload_zipf_next(workload_zipf_t *zipf, workload_rng_t *rng) {
+    double u = workload_uniform(rng);
+    int lo = 0, hi = zipf->n - 1, mid;
+
+    /* Find the first rank whose cumulative probability exceeds u */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (zipf->cdf[mid] > u)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+/* Relative frequencies of word lengths 1 to 15 in English text, per mille */
+static int length_freqs[WORKLOAD_MAX_WORD] = {
+    30, 170, 210, 160, 110, 85, 80, 55, 40, 25, 15, 10, 5, 3, 2
+};
+
+/* Relative frequencies of the letters a to z in English text, per mille */
+static int letter_freqs[26] = {
+    82, 15, 28, 43, 127, 22, 20, 61, 70, 2, 8, 40, 24,
+    67, 75, 19, 1, 60, 63, 91, 28, 10, 24, 2, 20, 1
+};
+
+/*
+ * Draws an index from the given table of relative frequencies.
+ */
+static int draw(workload_rng_t *rng, int *freqs, int n) {
+    int i, total = 0, r;
+
+    for (i = 0; i < n; i++)
+        total += freqs[i];
+    r = workload_below(rng, total);
+    for (i = 0; i < n - 1 && r >= freqs[i]; i++)
+        r -= freqs[i];
+    return i;
+}
+
+int workload_word(workload_rng_t *rng, char *buf) {
+    int len = draw(rng, length_freqs, WORKLOAD_MAX_WORD) + 1;
+    int i;
+
+    for (i = 0; i < len; i++)
+        buf[i] = 'a' + draw(rng, letter_freqs, 26);
+    buf[len] = 0;
+    return len;
+}
+
+static int compare_ints(void *a, void *b) {
+    int x = *(int *) a;
+    int y = *(int *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Allocates the element arrays and integer keys of the given workload,
+ * pointing the elements at the keys.  Returns the keys, with a's keys
+ * first, or NULL if out of memory.
+ */
+static int *alloc_ints(workload_t *w, int na, int nb) {
+    int *keys;
+    int i;
+
+    w->na = na;
+    w->nb = nb;
+    w->cmpfunc = compare_ints;
+    w->a = malloc(sizeof(void *) * (na > 0 ? na : 1));
+    w->b = malloc(sizeof(void *) * (nb > 0 ? nb : 1));
+    w->storage = keys = malloc(sizeof(int) * (na + nb > 0 ? na + nb : 1));
+    if (w->a == NULL || w->b == NULL || keys == NULL)
+        return NULL;
+
+    for (i = 0; i < na; i++)
+        w->a[i] = &keys[i];
+    for (i = 0; i < nb; i++)
+        w->b[i] = &keys[na + i];
+    return keys;
+}
+
+/*
+ * Shuffles the given keys.
+ */
+static void shuffle(workload_rng_t *rng, int *keys, int n) {
+    int i, j, tmp;
+
+    for (i = n - 1; i > 0; i--) {
+        j = workload_below(rng, i + 1);
+        tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+static int gen_sorted(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int *keys = alloc_ints(w, n, n);
+    int i;
+
+    if (keys == NULL)
+        return 0;
+    for (i = 0; i < n; i++) {
+        keys[i] = i;
+        keys[n + i] = n / 2 + i;
+    }
+    return 1;
+}
+
+static int gen_reversed(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int *keys = alloc_ints(w, n, n);
+    int i;
+
+    if (keys == NULL)
+        return 0;
+    for (i = 0; i < n; i++) {
+        keys[i] = n - 1 - i;
+        keys[n + i] = n / 2 + n - 1 - i;
+    }
+    return 1;
+}
+
+static int gen_nearly(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int *keys = alloc_ints(w, n, n);
+    int i, j, k, tmp, swaps = (int) (param * n + 0.5);
+
+    if (keys == NULL)
+        return 0;
+    for (i = 0; i < n; i++) {
+        keys[i] = i;
+        keys[n + i] = n / 2 + i;
+    }
+    if (n < 2)
+        return 1;
+
+    /* Swap random pairs within each operand */
+    for (k = 0; k < 2 * swaps; k++) {
+        int *base = keys + (k < swaps ? 0 : n);
+
+        i = workload_below(rng, n);
+        j = workload_below(rng, n);
+        tmp = base[i];
+        base[i] = base[j];
+        base[j] = tmp;
+    }
+    return 1;
+}
+
+static int gen_random(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int *keys = alloc_ints(w, n, n);
+    int i;
+
+    if (keys == NULL)
+        return 0;
+    for (i = 0; i < 2 * n; i++)
+        keys[i] = workload_below(rng, 4 * (unsigned long long) n);
+    return 1;
+}
+
+static int gen_zipf(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int *keys = alloc_ints(w, n, n);
+    int *perm, i, universe = 4 * n;
+    workload_zipf_t *zipf;
+
+    if (keys == NULL)
+        return 0;
+    zipf = workload_zipf_create(universe, param);
+    perm = malloc(sizeof(int) * universe);
+    if (zipf == NULL || perm == NULL) {
+        if (zipf != NULL)
+            workload_zipf_destroy(zipf);
+        free(perm);
+        return 0;
+    }
+
+    /* Scatter the ranks, so that the popular keys are not the smallest */
+    for (i = 0; i < universe; i++)
+        perm[i] = i;
+    shuffle(rng, perm, universe);
+    for (i = 0; i < 2 * n; i++)
+        keys[i] = perm[workload_zipf_next(zipf, rng)];
+
+    workload_zipf_destroy(zipf);
+    free(perm);
+    return 1;
+}
+
+static int gen_clustered(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int *keys = alloc_ints(w, n, n);
+    int i, len = (int) param, start = 0;
+
+    if (keys == NULL)
+        return 0;
+    for (i = 0; i < 2 * n; i++) {
+        if (i % n % len == 0)
+            start = workload_below(rng, 4 * (unsigned long long) n);
+        keys[i] = start + i % n % len;
+    }
+    return 1;
+}
+
+static int gen_overlap(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int *keys = alloc_ints(w, n, n);
+    int *pool, i, shared = (int) (param * n + 0.5);
+
+    if (keys == NULL)
+        return 0;
+    pool = malloc(sizeof(int) * 2 * (n > 0 ? n : 1));
+    if (pool == NULL)
+        return 0;
+
+    /* a gets n distinct keys; b gets shared of those, and keys not in a */
+    for (i = 0; i < 2 * n; i++)
+        pool[i] = i;
+    shuffle(rng, pool, 2 * n);
+    memcpy(keys, pool, sizeof(int) * n);
+    shuffle(rng, pool, n);
+    memcpy(keys + n, pool, sizeof(int) * shared);
+    memcpy(keys + n + shared, pool + n, sizeof(int) * (n - shared));
+    shuffle(rng, keys + n, n);
+
+    free(pool);
+    return 1;
+}
+
+static int gen_unequal(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int nb = (int) (n / param);
+    int *keys = alloc_ints(w, n, nb > 0 ? nb : 1);
+    int i;
+
+    if (keys == NULL)
+        return 0;
+    for (i = 0; i < w->na + w->nb; i++)
+        keys[i] = workload_below(rng, 4 * (unsigned long long) n);
+    return 1;
+}
+
+static int gen_strings(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int i, words = 4 * n;
+    char *vocab;
+
+    w->na = n;
+    w->nb = n;
+    w->cmpfunc = compare_strings;
+    w->a = malloc(sizeof(void *) * (n > 0 ? n : 1));
+    w->b = malloc(sizeof(void *) * (n > 0 ? n : 1));
+    w->storage = vocab = malloc((WORKLOAD_MAX_WORD + 1) * words);
+    if (w->a == NULL || w->b == NULL || vocab == NULL)
+        return 0;
+
+    for (i = 0; i < words; i++)
+        workload_word(rng, vocab + i * (WORKLOAD_MAX_WORD + 1));
+    for (i = 0; i < n; i++) {
+        w->a[i] = vocab + workload_below(rng, words) * (WORKLOAD_MAX_WORD + 1);
+        w->b[i] = vocab + workload_below(rng, words) * (WORKLOAD_MAX_WORD + 1);
+    }
+    return 1;
+}
+
+static int gen_duplicates(workload_t *w, int n, double param, workload_rng_t *rng) {
+    int *keys = alloc_ints(w, n, n);
+    int i, distinct = (int) (n / param);
+
+    if (keys == NULL)
+        return 0;
+    for (i = 0; i < 2 * n; i++)
+        keys[i] = workload_below(rng, distinct > 0 ? distinct : 1);
+    return 1;
+}
+
+typedef struct generator {
+    char *name;
+    int (*func)(workload_t *w, int n, double param, workload_rng_t *rng);
+    double param;       /* default parameter, or 0 if none is taken */
+    double min;         /* smallest valid parameter */
+    double max;         /* largest valid parameter */
+    char *synopsis;
+    char *description;
+} generator_t;
+
+static generator_t generators[] = {
+    { "sorted", gen_sorted, 0, 0, 0, "sorted",
+      "a is 0..n-1, b is n/2..n/2+n-1" },
+    { "reversed", gen_reversed, 0, 0, 0, "reversed",
+      "as sorted, in descending order" },
+    { "nearly", gen_nearly, 0.05, 0, 1, "nearly[:f]",
+      "as sorted, with f*n random pairs swapped (default 0.05)" },
+    { "random", gen_random, 0, 0, 0, "random",
+      "uniform keys from a range of 4n" },
+    { "zipf", gen_zipf, 1.0, 0.01, 10, "zipf[:s]",
+      "Zipf-distributed keys with exponent s (default 1.0)" },
+    { "clustered", gen_clustered, 16, 1, 1e9, "clustered[:l]",
+      "runs of l consecutive keys at random places (default 16)" },
+    { "overlap", gen_overlap, 0.5, 0, 1, "overlap[:f]",
+      "n distinct keys each, a fraction f shared (default 0.5)" },
+    { "unequal", gen_unequal, 16, 1, 1e9, "unequal[:r]",
+      "a has n random keys, b has n/r (default 16)" },
+    { "strings", gen_strings, 0, 0, 0, "strings",
+      "random words from a vocabulary of 4n" },
+    { "duplicates", gen_duplicates, 8, 1, 1e9, "duplicates[:k]",
+      "each distinct key repeated about k times (default 8)" },
+};
+
+#define NUM_GENERATORS ((int) (sizeof(generators) / sizeof(generators[0])))
+
+/*
+ * Parses the given spec.  Returns its generator and stores its
+ * parameter in *param, or returns NULL if the spec is not valid.
+ */
+static generator_t *parse(char *spec, double *param) {
+    char *colon = strchr(spec, ':'), *end;
+    size_t len = colon != NULL ? (size_t) (colon - spec) : strlen(spec);
+    generator_t *gen;
+    int i;
+
+    for (i = 0; i < NUM_GENERATORS; i++) {
+        gen = &generators[i];
+        if (strlen(gen->name) != len || strncmp(spec, gen->name, len) != 0)
+            continue;
+
+        *param = gen->param;
+        if (colon == NULL)
+            return gen;
+        if (gen->param == 0)
+            return NULL;
+        *param = strtod(colon + 1, &end);
+        if (end == colon + 1 || *end != 0 || *param < gen->min || *param > gen->max)
+            return NULL;
+        return gen;
+    }
+    return NULL;
+}
+
+int workload_valid(char *spec) {
+    double param;
+
+    return parse(spec, &param) != NULL;
+}
+
+int workload_select(char *names, char **specs, int max) {
+    char *name;
+    int num = 0;
+
+    for (name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+        if (!workload_valid(name) || num == max)
+            return -1;
+        specs[num++] = name;
+    }
+    return num;
+}
+
+workload_t *workload_create(char *spec, int n, unsigned long long seed) {
+    generator_t *gen;
+    workload_t *w;
+    workload_rng_t rng;
+    double param;
+
+    gen = parse(spec, &param);
+    if (gen == NULL || n < 0)
+        return NULL;
+    w = calloc(1, sizeof(workload_t));
+    if (w == NULL)
+        return NULL;
+
+    /* Each size gets its own stream, so a run can be redone at any size */
+    workload_seed(&rng, seed);
+    workload_seed(&rng, workload_rand(&rng) ^ (unsigned long long) n);
+
+    w->name = spec;
+    if (!gen->func(w, n, param, &rng)) {
+        workload_destroy(w);
+        return NULL;
+    }
+    return w;
+}
+
+void workload_destroy(workload_t *workload) {
+    free(workload->a);
+    free(workload->b);
+    free(workload->storage);
+    free(workload);
+}
+
+void workload_list(FILE *out) {
+    int i;
+
+    for (i = 0; i < NUM_GENERATORS; i++)
+        fprintf(out, "  %-16s %s\n", generators[i].synopsis, generators[i].description);
+}
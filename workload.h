@@ -0,0 +1,123 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "common.h"
+
+/*
+ * Reproducible benchmark workloads.
+ *
+ * All randomness comes from a small seeded generator (splitmix64), so a
+ * workload depends only on its spec, its size and its seed, and not on
+ * the C library or on what else the program has drawn.
+ */
+
+/*
+ * The type of random number generators.
+ */
+typedef struct workload_rng {
+    unsigned long long state;
+} workload_rng_t;
+
+/*
+ * Seeds the given generator.
+ */
+void workload_seed(workload_rng_t *rng, unsigned long long seed);
+
+/*
+ * Returns the next 64 random bits.
+ */
+unsigned long long workload_rand(workload_rng_t *rng);
+
+/*
+ * Returns a uniformly distributed integer in [0, n), or 0 if n is 0.
+ */
+unsigned long long workload_below(workload_rng_t *rng, unsigned long long n);
+
+/*
+ * Returns a uniformly distributed double in [0, 1).
+ */
+double workload_uniform(workload_rng_t *rng);
+
+/*
+ * The type of Zipf distributions over the ranks 0 to n - 1, where rank
+ * r is drawn with probability proportional to 1 / (r + 1)^skew.
+ */
+struct workload_zipf;
+typedef struct workload_zipf workload_zipf_t;
+
+/*
+ * Creates a Zipf distribution over n ranks.  Returns NULL if out of
+ * memory.
+ */
+workload_zipf_t *workload_zipf_create(int n, double skew);
+
+void workload_zipf_destroy(workload_zipf_t *zipf);
+
+/*
+ * Draws a rank from the given distribution.
+ */
+int workload_zipf_next(workload_zipf_t *zipf, workload_rng_t *rng);
+
+/*
+ * Writes a random lowercase word to buf, which must hold at least
+ * WORKLOAD_MAX_WORD + 1 characters.  Word lengths follow the length
+ * distribution of English running text.  Returns the length.
+ */
+#define WORKLOAD_MAX_WORD 15
+
+int workload_word(workload_rng_t *rng, char *buf);
+
+/*
+ * A generated workload: the elements of two operands a and b, and the
+ * comparison function for them.  The elements point into storage owned
+ * by the workload, and may repeat.
+ */
+typedef struct workload {
+    char *name;
+    int na;
+    int nb;
+    void **a;
+    void **b;
+    cmpfunc_t cmpfunc;
+    void *storage;
+} workload_t;
+
+/*
+ * Returns 1 if the given spec names a workload, or 0 if not.  A spec is
+ * a generator name, optionally followed by a colon and a parameter:
+ *
+ *   sorted        a is 0..n-1, b is n/2..n/2+n-1
+ *   reversed      as sorted, in descending order
+ *   nearly:f      as sorted, with f*n random pairs swapped (default 0.05)
+ *   random        uniform keys from a range of 4n
+ *   zipf:s        Zipf-distributed keys with exponent s (default 1.0)
+ *   clustered:l   runs of l consecutive keys at random places (default 16)
+ *   overlap:f     n distinct keys each, a fraction f shared (default 0.5)
+ *   unequal:r     a has n random keys, b has n/r (default 16)
+ *   strings       random words from a vocabulary of 4n
+ *   duplicates:k  each distinct key repeated about k times (default 8)
+ */
+int workload_valid(char *spec);
+
+/*
+ * Splits the given comma-separated list of workload specs into the
+ * specs array, in place.  Returns the number of specs, or -1 if one is
+ * not valid or there are more than max.
+ */
+int workload_select(char *names, char **specs, int max);
+
+/*
+ * Generates the workload with the given spec and size from the given
+ * seed.  Returns NULL if the spec is not valid or out of memory.
+ */
+workload_t *workload_create(char *spec, int n, unsigned long long seed);
+
+void workload_destroy(workload_t *workload);
+
+/*
+ * Writes the workload specs and their descriptions to the given file,
+ * one per line.
+ */
+void workload_list(FILE *out);
+
+#endif